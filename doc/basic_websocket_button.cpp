@@ -1,5 +1,6 @@
 #include <WiFi.h>
 #include <WebSocketsClient.h>
+#include "nikola_core/NikolaCore.h"  // nikola::ReconnectBackoff
 #include <ArduinoJson.h>
 
 // WiFi credentials
@@ -16,6 +17,8 @@ WebSocketsClient webSocket;
 unsigned long lastPingTime = 0;
 const unsigned long pingInterval = 50000; // 50 seconds
 
+nikola::ReconnectBackoff wsBackoff;  // Paces every connection attempt to the relay
+
 void setup() {
   Serial.begin(115200);
 
@@ -28,7 +31,7 @@ void setup() {
 
 void loop() {
   // Maintain WebSocket connection
-  webSocket.loop();
+  serviceWebSocket();
 
   // Send a ping periodically
   unsigned long currentMillis = millis();
@@ -55,14 +58,28 @@ void connectToWiFi() {
 }
 
 void initializeWebSocket() {
+  // Every attempt moves the next one further out
+  webSocket.setReconnectInterval(wsBackoff.startAttempt());
   webSocket.beginSSL(websocket_server_host, websocket_port, websocket_path); // Use SSL for wss
   webSocket.onEvent(webSocketEvent);                                         // Define event handler
 }
 
+// Stands in for webSocket.loop(): attempts are started here, and between them the
+// client is not run, so the library cannot retry at its own fixed interval
+void serviceWebSocket() {
+  if (wsBackoff.attemptDue()) {
+    initializeWebSocket();
+  }
+  if (wsBackoff.active()) {
+    webSocket.loop();
+  }
+}
+
 void webSocketEvent(WStype_t type, uint8_t* payload, size_t length) {
   switch (type) {
     case WStype_CONNECTED:
       Serial.println("WebSocket connected!");
+      wsBackoff.connected();
       break;
 
     case WStype_TEXT: {
@@ -117,10 +134,13 @@ void webSocketEvent(WStype_t type, uint8_t* payload, size_t length) {
       break;
     }
 
-    case WStype_DISCONNECTED:
-      Serial.println("WebSocket disconnected! Reconnecting...");
-      initializeWebSocket(); // Reinitialize WebSocket
+    case WStype_DISCONNECTED: {
+      unsigned long delayMs = wsBackoff.disconnected();
+      if (delayMs != 0) {
+        Serial.printf("WebSocket disconnected! Reconnecting in %lu ms\n", delayMs);
+      }
       break;
+    }
 
     default:
       break;
@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+#include <sdkconfig.h>  // CONFIG_IDF_TARGET_*, whatever was included before this header
+
+// Compile-time GPIO capability tables for the supported ESP32 families.
+// Bit N of every mask stands for GPIO N. The active profile is picked from the
+// IDF target the sketch is built for, so all pin checks fold into constants.
+// Targets without a profile fail to build rather than borrow another chip's pins.
+
+struct BoardProfile {
+  const char* name;
+  uint64_t gpio;       // Pins that exist on the package
+  uint64_t output;     // Pins that may be driven (excludes flash and input-only pins)
+  uint64_t adc;        // Pins usable with analogRead()
+  uint64_t strapping;  // Pins sampled at boot; loads on them can change the boot mode
+};
+
+constexpr uint64_t pinBit(int pin) {
+  return (pin >= 0 && pin < 64) ? (uint64_t(1) << pin) : 0;
+}
+
+constexpr uint64_t pinRange(int first, int last) {
+  return first > last ? 0 : (pinBit(first) | pinRange(first + 1, last));
+}
+
+constexpr int pinCount(uint64_t mask) {
+  return mask == 0 ? 0 : int(mask & 1) + pinCount(mask >> 1);
+}
+
+// Classic ESP32: GPIO 6-11 drive the SPI flash, 34-39 are input only
+constexpr BoardProfile esp32Profile = {
+  "ESP32",
+  pinRange(0, 19) | pinRange(21, 23) | pinRange(25, 27) | pinRange(32, 39),
+  (pinRange(0, 19) | pinRange(21, 23) | pinRange(25, 27) | pinRange(32, 33)) & ~pinRange(6, 11),
+  pinBit(0) | pinBit(2) | pinBit(4) | pinRange(12, 15) | pinRange(25, 27) | pinRange(32, 39),
+  pinBit(0) | pinBit(2) | pinBit(5) | pinBit(12) | pinBit(15)
+};
+
+// ESP32-S3: GPIO 26-32 drive the SPI flash/PSRAM
+constexpr BoardProfile esp32s3Profile = {
+  "ESP32-S3",
+  pinRange(0, 21) | pinRange(26, 48),
+  pinRange(0, 21) | pinRange(33, 48),
+  pinRange(1, 20),
+  pinBit(0) | pinBit(3) | pinBit(45) | pinBit(46)
+};
+
+// ESP32-C3: GPIO 12-17 drive the SPI flash
+constexpr BoardProfile esp32c3Profile = {
+  "ESP32-C3",
+  pinRange(0, 21),
+  pinRange(0, 11) | pinRange(18, 21),
+  pinRange(0, 4),
+  pinBit(2) | pinBit(8) | pinBit(9)
+};
+
+#if defined(CONFIG_IDF_TARGET_ESP32S3)
+constexpr BoardProfile activeBoard = esp32s3Profile;
+#elif defined(CONFIG_IDF_TARGET_ESP32C3)
+constexpr BoardProfile activeBoard = esp32c3Profile;
+#elif defined(CONFIG_IDF_TARGET_ESP32)
+constexpr BoardProfile activeBoard = esp32Profile;
+#else
+#error "board_profiles.h has no GPIO profile for this target; add one before building"
+#endif
+
+constexpr bool isValidPin(int pin) {
+  return (activeBoard.gpio & pinBit(pin)) != 0;
+}
+
+constexpr bool isOutputPin(int pin) {
+  return (activeBoard.output & pinBit(pin)) != 0;
+}
+
+constexpr bool isAdcPin(int pin) {
+  return (activeBoard.adc & pinBit(pin)) != 0;
+}
+
+constexpr bool isStrappingPin(int pin) {
+  return (activeBoard.strapping & pinBit(pin)) != 0;
+}
+
+static_assert((activeBoard.output & ~activeBoard.gpio) == 0, "output pins must exist on the board");
+static_assert((activeBoard.adc & ~activeBoard.gpio) == 0, "ADC pins must exist on the board");
+static_assert(!isValidPin(-1), "pin -1 must never validate");
+static_assert(pinCount(esp32Profile.output) == 22, "unexpected ESP32 output pin count");
+
+// Iterates the set bits of a mask, lowest pin first:
+//   for (uint64_t m = activeBoard.output; m; m &= m - 1) { int pin = lowestPin(m); ... }
+inline int lowestPin(uint64_t mask) {
+  return __builtin_ctzll(mask);
+}
@@ -4,6 +4,7 @@
 #include <Preferences.h>
 #include <ArduinoJson.h>
 #include <WebSocketsClient.h>
+#include "nikola_core/NikolaCore.h"  // nikola::ReconnectBackoff
 // AP Mode credentials
 const char* apSSID = "NIKOLAINDUSTRY_Setup";
 const char* apPassword = "0123456789";
@@ -35,6 +36,8 @@ const uint16_t websocket_port = 443;
 unsigned long lastPingTime = 0;
 const unsigned long pingInterval = 50000;  // 50 seconds
 
+nikola::ReconnectBackoff wsBackoff;  // Paces every connection attempt to the relay
+
 
 void setup() {
   Serial.begin(115200);
@@ -63,7 +66,7 @@ const int maxRetries = 6;  // Switch to AP mode after 6 attempts
 void loop() {
   dnsServer.processNextRequest();
   server.handleClient();
-  webSocket.loop();
+  serviceWebSocket();
 
   if (!ssid.isEmpty() && !password.isEmpty() && !deviceid.isEmpty()) {
     if (WiFi.status() != WL_CONNECTED) {
@@ -112,6 +115,8 @@ void getcredentials() {
 
 
 void initializeWebSocket() {
+  // Each attempt, even one skipped for lack of Wi-Fi, moves the next one further out
+  webSocket.setReconnectInterval(wsBackoff.startAttempt());
 
   if (!ssid.isEmpty() && !password.isEmpty() && !deviceid.isEmpty()) {
     if (WiFi.status() == WL_CONNECTED) {
@@ -142,11 +147,23 @@ void sendMessage(const char* message) {
 }
 
 
+// Stands in for webSocket.loop(): attempts are started here, and between them the
+// client is not run, so the library cannot retry at its own fixed interval
+void serviceWebSocket() {
+  if (wsBackoff.attemptDue()) {
+    initializeWebSocket();
+  }
+  if (wsBackoff.active()) {
+    webSocket.loop();
+  }
+}
+
 void webSocketEvent(WStype_t type, uint8_t* payload, size_t length) {
 
   switch (type) {
     case WStype_CONNECTED:
       Serial.println("WebSocket connected!");
+      wsBackoff.connected();
       break;
 
     case WStype_TEXT:
@@ -203,10 +220,13 @@ void webSocketEvent(WStype_t type, uint8_t* payload, size_t length) {
         break;
       }
 
-    case WStype_DISCONNECTED:
-      Serial.println("WebSocket disconnected! Reconnecting...");
-      initializeWebSocket();  // Reinitialize WebSocket
+    case WStype_DISCONNECTED: {
+      unsigned long delayMs = wsBackoff.disconnected();
+      if (delayMs != 0) {
+        Serial.printf("WebSocket disconnected! Reconnecting in %lu ms\n", delayMs);
+      }
       break;
+    }
 
     default:
       break;
@@ -0,0 +1,23 @@
+// MQTT variant: GPIO control, timed blink/pulse tasks and OTA over the relay's MQTT broker.
+// Same core as the WebSocket variants; only the transport policy differs.
+#include "nikola_core/NikolaCore.h"
+#include "nikola_core/MqttTransport.h"
+#include "nikola_core/GpioControl.h"
+#include "nikola_core/TaskScheduler.h"
+#include "nikola_core/OtaUpdate.h"
+#include "nikola_core/Provisioning.h"
+
+nikola::NikolaDevice<nikola::MqttTransport,
+                     nikola::PersistentGpioControl,
+                     nikola::TaskScheduler,
+                     nikola::OtaUpdate,
+                     nikola::ApProvisioning>
+  device;
+
+void setup() {
+  device.begin();
+}
+
+void loop() {
+  device.loop();
+}
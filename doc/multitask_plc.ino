@@ -5,7 +5,13 @@
 #include <Preferences.h>
 #include <ArduinoJson.h>
 #include <WebSocketsClient.h>
+#include "nikola_core/NikolaCore.h"  // nikola::ReconnectBackoff, nikola::forEachFrame
 #include <Update.h>
+#include <WiFiUdp.h>
+#include <ESPmDNS.h>
+#include <mbedtls/md.h>
+#include "portal_assets.h"  // Generated by tools/build-portal.js
+#include "board_profiles.h"
 // #include <NTPClient.h>
 // #include <WiFiUdp.h>
 
@@ -13,6 +19,7 @@
 const char* apSSID = "NIKOLAINDUSTRY_Setup";
 const char* apPassword = "0123456789";
 String fversion = "0.0.4";
+String currentFirmware;  // Installed firmware version, loaded once at boot
 // NTP Client settings
 // const long utcOffsetInSeconds = 19800;  // For IST, adjust as needed for your timezone
 // const char* ntpServer = "pool.ntp.org";
@@ -38,18 +45,65 @@ void handleConfigPage();
 void handleConfigSubmit();
 void clearConfig();
 void handleSetWiFi();
+void handleDeviceInfo();
+void handleWifiScan();
+void requestWifiScan();
+void updateWifiScan();
+void scheduleRestart(unsigned long delayMs);
 void connectToWiFi();
 void getcredentials();
 void initializeWebSocket();
 void restoreAllGPIOStates();
 void performOTA();
+void startLanDirect();
+void lanLoop();
+void processCommandFrame(const uint8_t* payload, size_t length);
+void routeMessage(const char* targetId, const String& message);
 // WebSocket server details
 const char* websocket_server_host = "nikolaindustry-realtime.onrender.com";  // Replace with your server address
 const uint16_t websocket_port = 443;
 
 unsigned long lastPingTime = 0;
 const unsigned long pingInterval = 50000;  // 50 seconds
+
+nikola::ReconnectBackoff wsBackoff;  // Paces every connection attempt to the relay
 String setwebsoket = "false";
+
+// Wi-Fi scan results for the provisioning portal. Scans run asynchronously in the
+// radio driver and the JSON is built once per scan, so /scan never blocks the loop.
+const unsigned long wifiScanTtl = 30000;        // Results older than 30 seconds trigger a rescan
+const uint32_t wifiScanChannelTimeMs = 120;     // Short dwell per channel keeps the AP responsive
+const int maxScanResults = 20;
+String wifiScanCache = "[]";
+unsigned long wifiScanCachedAt = 0;
+bool wifiScanRequested = false;
+bool wifiScanRunning = false;
+
+// Restarts are deferred to loop() so HTTP handlers can return immediately
+bool restartPending = false;
+unsigned long restartAt = 0;
+
+// LAN direct mode: peers on the same network exchange targetId frames over UDP
+// and only fall back to the cloud relay when the target has not been seen locally
+const IPAddress lanMulticastGroup(239, 255, 42, 99);
+const uint16_t lanPort = 4210;
+const unsigned long lanAnnounceInterval = 30000;  // Announce presence every 30 seconds
+const unsigned long lanPeerTimeout = 90000;       // Forget peers silent for 90 seconds
+// Anyone on the network can reach the LAN port, so LAN mode stays off until a site key
+// ("lankey", set through /setwifi) is provisioned on every device of the site. The key
+// never goes on the wire: each datagram is an HMAC-SHA256 of its JSON body under the key
+// (64 hex digits) followed by the body. Against replays, every frame carries the
+// sender's counter ("seq", kept increasing across reboots) and frames to a device name
+// its boot session ("to"), announced in its lan_hello. Only GPIO commands and feedback
+// are taken from the LAN (never OTA, restart or device info).
+String lanKey;
+WiFiUDP lanUdp;
+bool lanStarted = false;
+unsigned long lastLanAnnounce = 0;
+uint32_t lanSession = 0;               // Random per boot; frames for this device must name it
+uint32_t lanSeq = 0;                   // Last counter value sent
+uint32_t lanSeqLimit = 0;              // Counter values up to here are reserved in flash
+const uint32_t lanSeqReserve = 1000;   // Reserved at a time, so flash is written every 1000 frames
 // Create an NTPClient instance
 //NTPClient timeClient(ntpUDP, ntpServer, utcOffsetInSeconds, 3600000);  // Sync every 1 hour
 
@@ -72,7 +126,11 @@ void setup() {
   }
 
   // Configure web server routes
+  const char* portalHeaders[] = { "If-None-Match" };
+  server.collectHeaders(portalHeaders, 1);
   server.on("/", handleConfigPage);
+  server.on("/info", HTTP_GET, handleDeviceInfo);
+  server.on("/scan", HTTP_GET, handleWifiScan);
   server.on("/submit", HTTP_POST, handleConfigSubmit);
   server.on("/setwifi", HTTP_GET, handleSetWiFi);
   server.on("/clearwifi", HTTP_GET, clearConfig);
@@ -88,7 +146,11 @@ const int maxRetries = 6;  // Switch to AP mode after 6 attempts
 void loop() {
   dnsServer.processNextRequest();
   server.handleClient();
-  webSocket.loop();
+  serviceWebSocket();
+  if (restartPending && (long)(millis() - restartAt) >= 0) {
+    ESP.restart();
+  }
+  updateWifiScan();
   updateBlinkTasks();
   updateFadeTasks();
   updatePulseTasks();
@@ -101,6 +163,11 @@ void loop() {
 
         lastReconnectAttempt = now;
 
+        if (lanStarted) {
+          lanUdp.stop();
+          lanStarted = false;
+        }
+
         Serial.println("Attempting to reconnect to WiFi...");
         WiFi.disconnect();
         delay(1000);
@@ -148,6 +215,11 @@ void loop() {
         initializeWebSocket();
         Serial.println("soket found true");
       }
+
+      if (!lanStarted) {
+        startLanDirect();
+      }
+      lanLoop();
     }
   }
 
@@ -170,6 +242,8 @@ void getcredentials() {
   deviceid = preferences.getString("deviceid", "");
   productid = preferences.getString("productid", "");
   firstimecall = preferences.getString("APICALL", "");
+  lanKey = preferences.getString("lankey", "");
+  currentFirmware = preferences.getString("firmware", fversion);
   macid = WiFi.macAddress();
   Serial.println(ssid);
   Serial.println(password);
@@ -190,7 +264,9 @@ int loadGPIOState(int pin) {
   return gpioPreferences.getInt(("pin_" + String(pin)).c_str(), LOW);
 }
 void restoreAllGPIOStates() {
-  for (int pin = 0; pin < 40; pin++) {  // Adjust for your pin range
+  // Only output-capable pins of the target board can hold a saved state
+  for (uint64_t pins = activeBoard.output; pins != 0; pins &= pins - 1) {
+    int pin = lowestPin(pins);
     String key = "pin_" + String(pin);
     if (gpioPreferences.isKey(key.c_str())) {
       int state = gpioPreferences.getInt(key.c_str(), LOW);
@@ -203,9 +279,12 @@ void restoreAllGPIOStates() {
 
 
 void initializeWebSocket() {
+  // Each attempt, even one skipped for lack of Wi-Fi, moves the next one further out
+  webSocket.setReconnectInterval(wsBackoff.startAttempt());
 
   if (!ssid.isEmpty() && !password.isEmpty() && !deviceid.isEmpty() && WiFi.status() == WL_CONNECTED) {
-    String websocket_path = "/connect?id=" + deviceid;
+    // batch=1: the relay may combine bursts of commands into one array frame
+    String websocket_path = "/connect?id=" + deviceid + "&batch=1";
     webSocket.beginSSL(websocket_server_host, websocket_port, websocket_path.c_str());
     webSocket.onEvent(webSocketEvent);
   } else {
@@ -227,6 +306,253 @@ void sendMessage(const char* message) {
 }
 
 
+struct LanPeer {
+  char id[40];
+  IPAddress ip;
+  unsigned long lastSeen;
+  uint32_t session;  // The peer's boot session, named in frames sent to it
+  uint32_t lastSeq;  // Highest counter accepted from the peer
+  bool active;       // Slot in use; kept after the peer goes quiet so its counter is remembered
+};
+
+const int MAX_LAN_PEERS = 16;
+LanPeer lanPeers[MAX_LAN_PEERS];
+char lanBuffer[1024];
+
+void startLanDirect() {
+  if (lanKey.isEmpty() || deviceid.isEmpty() || WiFi.status() != WL_CONNECTED) {
+    return;
+  }
+  if (!lanUdp.beginMulticast(lanMulticastGroup, lanPort)) {
+    Serial.println("Failed to start LAN direct mode.");
+    return;
+  }
+  if (MDNS.begin(deviceid.c_str())) {
+    MDNS.addService("nikola", "udp", lanPort);
+  }
+  if (lanSession == 0) {
+    lanSession = esp_random() | 1;
+    Preferences lanPreferences;
+    lanPreferences.begin("lan", true);
+    lanSeq = lanPreferences.getUInt("seq", 0);
+    lanPreferences.end();
+    lanSeqLimit = lanSeq;
+  }
+  lanStarted = true;
+  lastLanAnnounce = 0;  // Announce on the next lanLoop()
+  Serial.println("LAN direct mode started on port " + String(lanPort));
+}
+
+// Counter for the next outgoing frame; values are claimed in flash ahead of use, so
+// after a reboot the counter continues above anything already sent
+uint32_t nextLanSeq() {
+  if (lanSeq >= lanSeqLimit) {
+    lanSeqLimit = lanSeq + lanSeqReserve;
+    Preferences lanPreferences;
+    lanPreferences.begin("lan", false);
+    lanPreferences.putUInt("seq", lanSeqLimit);
+    lanPreferences.end();
+  }
+  return ++lanSeq;
+}
+
+// HMAC-SHA256 of a frame body under the site key, as 64 hex digits
+void lanMac(const char* body, size_t length, char* hex) {
+  uint8_t mac[32];
+  mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), (const uint8_t*)lanKey.c_str(), lanKey.length(),
+                  (const uint8_t*)body, length, mac);
+  for (int i = 0; i < 32; i++) {
+    sprintf(hex + i * 2, "%02x", mac[i]);
+  }
+}
+
+bool sendLanFrame(IPAddress ip, const String& body) {
+  char mac[65];
+  lanMac(body.c_str(), body.length(), mac);
+  lanUdp.beginPacket(ip, lanPort);
+  lanUdp.write((const uint8_t*)mac, 64);
+  lanUdp.write((const uint8_t*)body.c_str(), body.length());
+  return lanUdp.endPacket();
+}
+
+// Slot of a peer, also one that has gone quiet
+LanPeer* findLanPeerSlot(const char* id) {
+  for (int i = 0; i < MAX_LAN_PEERS; i++) {
+    if (lanPeers[i].active && strcmp(lanPeers[i].id, id) == 0) {
+      return &lanPeers[i];
+    }
+  }
+  return nullptr;
+}
+
+// A peer heard from recently enough to send to directly
+LanPeer* findLanPeer(const char* id) {
+  LanPeer* peer = findLanPeerSlot(id);
+  if (peer == nullptr || millis() - peer->lastSeen > lanPeerTimeout) {
+    return nullptr;  // Unknown or stale, let the relay handle it
+  }
+  return peer;
+}
+
+// Records an authenticated lan_hello. Returns true when the peer was not known before;
+// a hello that is not newer than what the peer last sent is a replay and is ignored.
+bool rememberLanPeer(const char* id, IPAddress ip, uint32_t session, uint32_t seq) {
+  if (strlen(id) >= sizeof(lanPeers[0].id) || deviceid == id || session == 0) {
+    return false;
+  }
+  unsigned long now = millis();
+  LanPeer* peer = findLanPeerSlot(id);
+  if (peer != nullptr) {
+    if (seq <= peer->lastSeq) {
+      return false;
+    }
+    bool returning = now - peer->lastSeen > lanPeerTimeout || peer->session != session;
+    peer->ip = ip;
+    peer->lastSeen = now;
+    peer->session = session;
+    peer->lastSeq = seq;
+    return returning;
+  }
+
+  // Reuse a free slot, otherwise evict the peer heard from least recently
+  int slot = 0;
+  for (int i = 0; i < MAX_LAN_PEERS; i++) {
+    if (!lanPeers[i].active) {
+      slot = i;
+      break;
+    }
+    if (lanPeers[i].lastSeen < lanPeers[slot].lastSeen) {
+      slot = i;
+    }
+  }
+  strcpy(lanPeers[slot].id, id);
+  lanPeers[slot].ip = ip;
+  lanPeers[slot].lastSeen = now;
+  lanPeers[slot].session = session;
+  lanPeers[slot].lastSeq = seq;
+  lanPeers[slot].active = true;
+  Serial.printf("LAN peer %s at %s\n", id, ip.toString().c_str());
+  return true;
+}
+
+void sendLanHello(IPAddress ip) {
+  String hello = "{\"type\":\"lan_hello\",\"id\":\"" + deviceid + "\",\"session\":" + String(lanSession) +
+                 ",\"seq\":" + String(nextLanSeq()) + "}";
+  sendLanFrame(ip, hello);
+}
+
+// Sends a {"targetId":...,"payload":...} frame straight to a LAN peer.
+// The frame gets a "from" field so the receiver sees the same shape the relay delivers.
+bool sendLanMessage(const char* targetId, const String& message) {
+  if (!lanStarted || message.length() < 2 || message[0] != '{') {
+    return false;
+  }
+  LanPeer* peer = findLanPeer(targetId);
+  if (peer == nullptr) {
+    return false;
+  }
+
+  String frame = "{\"from\":\"" + deviceid + "\",\"to\":" + String(peer->session) + ",\"seq\":" + String(nextLanSeq()) +
+                 "," + message.substring(1);
+  if (!sendLanFrame(peer->ip, frame)) {
+    return false;
+  }
+  Serial.print("Sent (LAN): ");
+  Serial.println(frame);
+  return true;
+}
+
+// Deliver a frame to targetId over the LAN when possible, otherwise through the relay
+void routeMessage(const char* targetId, const String& message) {
+  if (targetId != nullptr && sendLanMessage(targetId, message)) {
+    return;
+  }
+  sendMessage(message.c_str());
+}
+
+void lanLoop() {
+  if (!lanStarted) {
+    return;
+  }
+
+  unsigned long now = millis();
+  if (lastLanAnnounce == 0 || now - lastLanAnnounce >= lanAnnounceInterval) {
+    lastLanAnnounce = now;
+    sendLanHello(lanMulticastGroup);
+  }
+
+  int packetSize = lanUdp.parsePacket();
+  if (packetSize <= 0) {
+    return;
+  }
+  if (packetSize >= (int)sizeof(lanBuffer)) {
+    lanUdp.flush();  // Too large for a LAN frame, drop it
+    return;
+  }
+  int len = lanUdp.read(lanBuffer, sizeof(lanBuffer) - 1);
+  if (len <= 64) {
+    return;
+  }
+  lanBuffer[len] = '\0';
+  IPAddress sender = lanUdp.remoteIP();
+
+  // Without the site key nobody can produce the MAC; compare in constant time
+  char expected[65];
+  const char* body = lanBuffer + 64;
+  size_t bodyLength = len - 64;
+  lanMac(body, bodyLength, expected);
+  uint8_t diff = 0;
+  for (int i = 0; i < 64; i++) {
+    diff |= expected[i] ^ lanBuffer[i];
+  }
+  if (diff != 0) {
+    return;
+  }
+
+  StaticJsonDocument<192> filter;
+  filter["type"] = true;
+  filter["id"] = true;
+  filter["session"] = true;
+  filter["seq"] = true;
+  filter["from"] = true;
+  filter["to"] = true;
+  filter["targetId"] = true;
+  filter["payload"]["commands"] = true;
+  StaticJsonDocument<256> header;
+  if (deserializeJson(header, body, bodyLength, DeserializationOption::Filter(filter))) {
+    return;
+  }
+  uint32_t seq = header["seq"] | 0u;
+
+  const char* type = header["type"] | "";
+  if (strcmp(type, "lan_hello") == 0) {
+    // Answer newcomers directly so both sides learn each other without waiting for the next announce
+    if (rememberLanPeer(header["id"] | "", sender, header["session"] | 0u, seq)) {
+      sendLanHello(sender);
+    }
+    return;
+  }
+
+  // Commands come from announced peers, for this boot, and each one only once
+  LanPeer* peer = findLanPeerSlot(header["from"] | "");
+  if (peer == nullptr || (header["to"] | 0u) != lanSession || seq <= peer->lastSeq) {
+    return;
+  }
+  const char* target = header["targetId"] | "";
+  if (deviceid != target) {
+    return;
+  }
+  const char* command = header["payload"]["commands"] | "";
+  if (*command != '\0' && strcmp(command, "control_gpio") != 0) {
+    Serial.printf("Ignoring LAN command %s from %s\n", command, sender.toString().c_str());
+    return;
+  }
+  peer->lastSeq = seq;
+  peer->ip = sender;
+  peer->lastSeen = now;
+  processCommandFrame((const uint8_t*)body, bodyLength);
+}
+
 struct BlinkTask {
   int pin;
   int onDuration;
@@ -263,6 +589,9 @@ PulseTask pulseTasks[MAX_TASKS];
 
 // add tasks
 void addBlinkTask(int pin, int onDuration, int offDuration, int repeat) {
+  if (!isOutputPin(pin)) {
+    return;
+  }
   for (int i = 0; i < MAX_TASKS; i++) {
     if (!blinkTasks[i].active) {
       blinkTasks[i] = { pin, onDuration, offDuration, repeat, 0, millis(), false, true };
@@ -273,6 +602,9 @@ void addBlinkTask(int pin, int onDuration, int offDuration, int repeat) {
 }
 
 void addFadeTask(int pin, int startBrightness, int endBrightness, int duration) {
+  if (!isOutputPin(pin)) {
+    return;
+  }
   for (int i = 0; i < MAX_TASKS; i++) {
     if (!fadeTasks[i].active) {
       fadeTasks[i] = { pin, startBrightness, endBrightness, duration, millis(), true };
@@ -284,6 +616,9 @@ void addFadeTask(int pin, int startBrightness, int endBrightness, int duration)
 
 
 void addPulseTask(int pin, int duration, int state) {
+  if (!isOutputPin(pin)) {
+    return;
+  }
   for (int i = 0; i < MAX_TASKS; i++) {
     if (!pulseTasks[i].active) {
       pulseTasks[i] = { pin, duration, millis(), true, state };
@@ -354,220 +689,41 @@ void updatePulseTasks() {
 
 
 
-void webSocketEvent(WStype_t type, uint8_t* payload, size_t length) {
-  String feedback;
-  StaticJsonDocument<256> feedbackDoc;
-
+// Stands in for webSocket.loop(): attempts are started here, and between them the
+// client is not run, so the library cannot retry at its own fixed interval
+void serviceWebSocket() {
+  if (wsBackoff.attemptDue()) {
+    initializeWebSocket();
+  }
+  if (wsBackoff.active()) {
+    webSocket.loop();
+  }
+}
 
+void webSocketEvent(WStype_t type, uint8_t* payload, size_t length) {
   switch (type) {
     case WStype_CONNECTED:
       Serial.println("WebSocket connected!");
+      wsBackoff.connected();
 
 
       break;
 
     case WStype_TEXT:
-      {
-        Serial.print("Message from server: ");
-        Serial.println((char*)payload);
-
-        // Parse the JSON payload
-        StaticJsonDocument<2048> doc;
-        DeserializationError error = deserializeJson(doc, payload);
-
-        if (error) {
-          Serial.print("Failed to parse JSON: ");
-          Serial.println(error.f_str());
-          return;
-        }
-
-        // Extract details
-        const char* targetId = doc["from"];
-        String controlid = doc["payload"]["controlid"].isNull() ? "notavailable" : doc["payload"]["controlid"].as<String>();
-
-        const char* deviceid = doc["payload"]["deviceid"].isNull() ? "notavailable" : doc["payload"]["deviceid"].as<const char*>();
-        const char* commands = doc["payload"]["commands"].isNull() ? "notavailable" : doc["payload"]["commands"].as<const char*>();
-        const char* action = doc["payload"]["actions"].isNull() ? "notavailable" : doc["payload"]["actions"].as<const char*>();
-        int pin = doc["payload"]["pin"].isNull() ? -1 : doc["payload"]["pin"].as<int>();
-        newtarget = targetId;
-        Serial.println("Command Received");
-        Serial.println(commands);
-
-
-        if (strcmp(commands, "control_gpio") == 0) {
-
-          Serial.println("Performing GPIO control");
-          if (strcmp(action, "toggle") == 0) {
-            pinMode(pin, OUTPUT);
-            int newState = !digitalRead(pin);
-            digitalWrite(pin, newState);
-            saveGPIOState(pin, newState);  // Save state
-
-            feedbackDoc["targetId"] = targetId;
-            JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
-            feedbackPayload["deviceid"] = deviceid;
-            feedbackPayload["pin"] = pin;
-            feedbackPayload["controlid"] = controlid;
-            feedbackPayload["status"] = digitalRead(pin) == HIGH ? "HIGH" : "LOW";  // Current status of GPIO
-            serializeJson(feedbackDoc, feedback);
-
-          } else if (strcmp(action, "HIGH") == 0) {
-            pinMode(pin, OUTPUT);
-            digitalWrite(pin, HIGH);
-            saveGPIOState(pin, HIGH);  // Save state
-
-            feedbackDoc["targetId"] = targetId;
-            JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
-            feedbackPayload["deviceid"] = deviceid;
-            feedbackPayload["pin"] = pin;
-            feedbackPayload["controlid"] = controlid;
-            feedbackPayload["status"] = digitalRead(pin) == HIGH ? "HIGH" : "LOW";  // Current status of GPIO
-            serializeJson(feedbackDoc, feedback);
-
-          } else if (strcmp(action, "LOW") == 0) {
-            pinMode(pin, OUTPUT);
-            digitalWrite(pin, LOW);
-            saveGPIOState(pin, LOW);  // Save state
-
-            feedbackDoc["targetId"] = targetId;
-            JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
-            feedbackPayload["deviceid"] = deviceid;
-            feedbackPayload["pin"] = pin;
-            feedbackPayload["controlid"] = controlid;
-            feedbackPayload["status"] = digitalRead(pin) == HIGH ? "HIGH" : "LOW";  // Current status of GPIO
-            serializeJson(feedbackDoc, feedback);
-
-          } else if (strcmp(action, "pwm") == 0) {
-            int duty_cycle = doc["payload"]["pwm"]["duty_cycle"];
-            int frequency = doc["payload"]["pwm"]["frequency"];
-            // ledcSetup(0, frequency, 8);
-            // ledcAttachPin(pin, 0);
-            ledcWrite(0, duty_cycle * 255 / 100);
-            feedbackDoc["targetId"] = targetId;
-            JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
-            feedbackPayload["deviceid"] = deviceid;
-            feedbackPayload["pin"] = pin;
-            feedbackPayload["controlid"] = controlid;
-            feedbackPayload["status"] = digitalRead(pin) == HIGH ? "HIGH" : "LOW";  // Current status of GPIO
-            serializeJson(feedbackDoc, feedback);
-
-          } else if (strcmp(action, "blink") == 0) {
-            int on_duration = doc["payload"]["params"]["on_duration"].isNull() ? -1 : doc["payload"]["params"]["on_duration"].as<int>();
-            int off_duration = doc["payload"]["params"]["off_duration"].isNull() ? -1 : doc["payload"]["params"]["off_duration"].as<int>();
-            int repeat = doc["payload"]["params"]["repeat"].isNull() ? -1 : doc["payload"]["params"]["repeat"].as<int>();
-            addBlinkTask(pin, on_duration, off_duration, repeat);
-            feedbackDoc["targetId"] = targetId;
-            JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
-            feedbackPayload["deviceid"] = deviceid;
-            feedbackPayload["pin"] = pin;
-            feedbackPayload["controlid"] = controlid;
-            feedbackPayload["status"] = "started";//digitalRead(pin) == HIGH ? "HIGH" : "LOW";  // Current status of GPIO
-            serializeJson(feedbackDoc, feedback);
-
-          } else if (strcmp(action, "fade_in") == 0) {
-            int start_duty = doc["payload"]["params"]["start_duty"].isNull() ? -1 : doc["payload"]["params"]["start_duty"].as<int>();
-            int end_duty = doc["payload"]["params"]["end_duty"].isNull() ? -1 : doc["payload"]["params"]["end_duty"].as<int>();
-            int duration = doc["payload"]["params"]["duration"].isNull() ? -1 : doc["payload"]["params"]["duration"].as<int>();
-            int step_delay = doc["payload"]["params"]["step_delay"].isNull() ? -1 : doc["payload"]["params"]["step_delay"].as<int>();
-            // ledcSetup(0, 5000, 8);
-            // ledcAttachPin(pin, 0);
-            addFadeTask(pin, 0, 255, duration);
-            feedbackDoc["targetId"] = targetId;
-            JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
-            feedbackPayload["deviceid"] = deviceid;
-            feedbackPayload["pin"] = pin;
-            feedbackPayload["controlid"] = controlid;
-            feedbackPayload["status"] = "started"; //digitalRead(pin) == HIGH ? "HIGH" : "LOW";  // Current status of GPIO
-            serializeJson(feedbackDoc, feedback);
-          } else if (strcmp(action, "fade_out") == 0) {
-            int start_duty = doc["payload"]["params"]["start_duty"].isNull() ? -1 : doc["payload"]["params"]["start_duty"].as<int>();
-            int end_duty = doc["payload"]["params"]["end_duty"].isNull() ? -1 : doc["payload"]["params"]["end_duty"].as<int>();
-            int duration = doc["payload"]["params"]["duration"].isNull() ? -1 : doc["payload"]["params"]["duration"].as<int>();
-            int step_delay = doc["payload"]["params"]["step_delay"].isNull() ? -1 : doc["payload"]["params"]["step_delay"].as<int>();
-            //ledcSetup(0, 5000, 8);
-            //ledcAttachPin(pin, 0);
-            addFadeTask(pin, 255, 0, duration);
-            feedbackDoc["targetId"] = targetId;
-            JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
-            feedbackPayload["deviceid"] = deviceid;
-            feedbackPayload["pin"] = pin;
-            feedbackPayload["controlid"] = controlid;
-            feedbackPayload["status"] = "started";//digitalRead(pin) == HIGH ? "HIGH" : "LOW";  // Current status of GPIO
-            serializeJson(feedbackDoc, feedback);
-          } else if (strcmp(action, "pulse") == 0) {
-            int duration = doc["payload"]["params"]["duration"].isNull() ? 1000 : doc["payload"]["params"]["duration"].as<int>();
-            int state = doc["payload"]["params"]["state"].isNull() ? HIGH : doc["payload"]["params"]["state"].as<int>();
-
-            addPulseTask(pin, duration, state);
-            feedbackDoc["targetId"] = targetId;
-            JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
-            feedbackPayload["deviceid"] = deviceid;
-            feedbackPayload["pin"] = pin;
-            feedbackPayload["controlid"] = controlid;
-            feedbackPayload["status"] = "started";//digitalRead(pin) == HIGH ? "HIGH" : "LOW";  // Current status of GPIO
-            serializeJson(feedbackDoc, feedback);
-
-          } else if (strcmp(action, "get_gpio_status") == 0) {
-
-            feedbackDoc["targetId"] = targetId;
-            JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
-            feedbackPayload["deviceid"] = deviceid;
-            feedbackPayload["pin"] = pin;
-            feedbackPayload["controlid"] = controlid;
-            feedbackPayload["status"] = digitalRead(pin) == HIGH ? "HIGH" : "LOW";  // Current status of GPIO
-            feedbackPayload["device"] = true;
-            serializeJson(feedbackDoc, feedback);
-          } else if (strcmp(action, "ping") == 0) {
-
-            feedbackDoc["targetId"] = targetId;
-            JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
-            feedbackPayload["status"] = true;
-            serializeJson(feedbackDoc, feedback);
-          }
-        } else if (strcmp(commands, "sensor") == 0) {
-
-          const char* sensor_type = doc["payload"]["sensor_type"];
-          float value = 0.0;
-
-          if (strcmp(sensor_type, "DS18B20") == 0) {
-            // value = readTemperatureDS18B20();
-          } else if (strcmp(sensor_type, "DHT11") == 0) {
-            // value = readHumidityDHT11();
-          } else if (strcmp(sensor_type, "ADC") == 0) {
-            int adc_channel = doc["payload"]["adc_channel"];
-            float scale_factor = doc["payload"]["scale_factor"];
-            value = analogRead(adc_channel) * scale_factor;
-          }
-        } else if (strcmp(commands, "ota_update") == 0) {
-          const char* otaUrl = doc["payload"]["url"];
-          const char* ver = doc["payload"]["version"];
-          versionid = String(ver);
-          if (otaUrl != nullptr) {
-            performOTA(otaUrl);  // Trigger OTA update
-          } else {
-            Serial.println("Invalid OTA URL received.");
-          }
-        } else if (strcmp(commands, "get_device_info") == 0) {
-          preferences.begin("wifi-creds", false);
-
-          String firmversion = preferences.getString("firmware", fversion);
-          feedbackDoc["targetId"] = targetId;
-          JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
-          feedbackPayload["status"] = "online";
-          feedbackPayload["version"] = firmversion;
-          serializeJson(feedbackDoc, feedback);
-          preferences.end();
-        }
-
-        sendMessage(feedback.c_str());
-      }
+      Serial.print("Message from server: ");
+      Serial.println((char*)payload);
+      // A batched burst arrives as a JSON array; each frame is handled on its own
+      nikola::forEachFrame(payload, length, processCommandFrame);
       break;
 
 
-    case WStype_DISCONNECTED:
-      Serial.println("WebSocket disconnected! Reconnecting...");
-      initializeWebSocket();  // Reinitialize WebSocket
+    case WStype_DISCONNECTED: {
+      unsigned long delayMs = wsBackoff.disconnected();
+      if (delayMs != 0) {
+        Serial.printf("WebSocket disconnected! Reconnecting in %lu ms\n", delayMs);
+      }
       break;
+    }
 
     default:
       break;
@@ -575,6 +731,217 @@ void webSocketEvent(WStype_t type, uint8_t* payload, size_t length) {
 }
 
 
+// Handles a command frame from the relay or from a LAN peer; both use the same format
+void processCommandFrame(const uint8_t* payload, size_t length) {
+  String feedback;
+  StaticJsonDocument<256> feedbackDoc;
+
+  // Parse the JSON payload
+  StaticJsonDocument<2048> doc;
+  DeserializationError error = deserializeJson(doc, payload, length);
+
+  if (error) {
+    Serial.print("Failed to parse JSON: ");
+    Serial.println(error.f_str());
+    return;
+  }
+
+  // Extract details
+  const char* targetId = doc["from"];
+  String controlid = doc["payload"]["controlid"].isNull() ? "notavailable" : doc["payload"]["controlid"].as<String>();
+
+  const char* deviceid = doc["payload"]["deviceid"].isNull() ? "notavailable" : doc["payload"]["deviceid"].as<const char*>();
+  const char* commands = doc["payload"]["commands"].isNull() ? "notavailable" : doc["payload"]["commands"].as<const char*>();
+  const char* action = doc["payload"]["actions"].isNull() ? "notavailable" : doc["payload"]["actions"].as<const char*>();
+  int pin = doc["payload"]["pin"].isNull() ? -1 : doc["payload"]["pin"].as<int>();
+  newtarget = targetId;
+  Serial.println("Command Received");
+  Serial.println(commands);
+
+
+  if (strcmp(commands, "control_gpio") == 0) {
+
+    Serial.println("Performing GPIO control");
+    // Reads accept any pin on the package, everything else needs an output-capable pin
+    bool readOnly = strcmp(action, "get_gpio_status") == 0;
+    if (strcmp(action, "ping") != 0 && !(readOnly ? isValidPin(pin) : isOutputPin(pin))) {
+      Serial.printf("Rejected GPIO command for pin %d on %s\n", pin, activeBoard.name);
+      feedbackDoc["targetId"] = targetId;
+      JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
+      feedbackPayload["deviceid"] = deviceid;
+      feedbackPayload["pin"] = pin;
+      feedbackPayload["controlid"] = controlid;
+      feedbackPayload["status"] = "invalid_pin";
+      serializeJson(feedbackDoc, feedback);
+
+    } else if (strcmp(action, "toggle") == 0) {
+      pinMode(pin, OUTPUT);
+      int newState = !digitalRead(pin);
+      digitalWrite(pin, newState);
+      saveGPIOState(pin, newState);  // Save state
+
+      feedbackDoc["targetId"] = targetId;
+      JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
+      feedbackPayload["deviceid"] = deviceid;
+      feedbackPayload["pin"] = pin;
+      feedbackPayload["controlid"] = controlid;
+      feedbackPayload["status"] = digitalRead(pin) == HIGH ? "HIGH" : "LOW";  // Current status of GPIO
+      serializeJson(feedbackDoc, feedback);
+
+    } else if (strcmp(action, "HIGH") == 0) {
+      pinMode(pin, OUTPUT);
+      digitalWrite(pin, HIGH);
+      saveGPIOState(pin, HIGH);  // Save state
+
+      feedbackDoc["targetId"] = targetId;
+      JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
+      feedbackPayload["deviceid"] = deviceid;
+      feedbackPayload["pin"] = pin;
+      feedbackPayload["controlid"] = controlid;
+      feedbackPayload["status"] = digitalRead(pin) == HIGH ? "HIGH" : "LOW";  // Current status of GPIO
+      serializeJson(feedbackDoc, feedback);
+
+    } else if (strcmp(action, "LOW") == 0) {
+      pinMode(pin, OUTPUT);
+      digitalWrite(pin, LOW);
+      saveGPIOState(pin, LOW);  // Save state
+
+      feedbackDoc["targetId"] = targetId;
+      JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
+      feedbackPayload["deviceid"] = deviceid;
+      feedbackPayload["pin"] = pin;
+      feedbackPayload["controlid"] = controlid;
+      feedbackPayload["status"] = digitalRead(pin) == HIGH ? "HIGH" : "LOW";  // Current status of GPIO
+      serializeJson(feedbackDoc, feedback);
+
+    } else if (strcmp(action, "pwm") == 0) {
+      int duty_cycle = doc["payload"]["pwm"]["duty_cycle"];
+      int frequency = doc["payload"]["pwm"]["frequency"];
+      // ledcSetup(0, frequency, 8);
+      // ledcAttachPin(pin, 0);
+      ledcWrite(0, duty_cycle * 255 / 100);
+      feedbackDoc["targetId"] = targetId;
+      JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
+      feedbackPayload["deviceid"] = deviceid;
+      feedbackPayload["pin"] = pin;
+      feedbackPayload["controlid"] = controlid;
+      feedbackPayload["status"] = digitalRead(pin) == HIGH ? "HIGH" : "LOW";  // Current status of GPIO
+      serializeJson(feedbackDoc, feedback);
+
+    } else if (strcmp(action, "blink") == 0) {
+      int on_duration = doc["payload"]["params"]["on_duration"].isNull() ? -1 : doc["payload"]["params"]["on_duration"].as<int>();
+      int off_duration = doc["payload"]["params"]["off_duration"].isNull() ? -1 : doc["payload"]["params"]["off_duration"].as<int>();
+      int repeat = doc["payload"]["params"]["repeat"].isNull() ? -1 : doc["payload"]["params"]["repeat"].as<int>();
+      addBlinkTask(pin, on_duration, off_duration, repeat);
+      feedbackDoc["targetId"] = targetId;
+      JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
+      feedbackPayload["deviceid"] = deviceid;
+      feedbackPayload["pin"] = pin;
+      feedbackPayload["controlid"] = controlid;
+      feedbackPayload["status"] = "started";//digitalRead(pin) == HIGH ? "HIGH" : "LOW";  // Current status of GPIO
+      serializeJson(feedbackDoc, feedback);
+
+    } else if (strcmp(action, "fade_in") == 0) {
+      int start_duty = doc["payload"]["params"]["start_duty"].isNull() ? -1 : doc["payload"]["params"]["start_duty"].as<int>();
+      int end_duty = doc["payload"]["params"]["end_duty"].isNull() ? -1 : doc["payload"]["params"]["end_duty"].as<int>();
+      int duration = doc["payload"]["params"]["duration"].isNull() ? -1 : doc["payload"]["params"]["duration"].as<int>();
+      int step_delay = doc["payload"]["params"]["step_delay"].isNull() ? -1 : doc["payload"]["params"]["step_delay"].as<int>();
+      // ledcSetup(0, 5000, 8);
+      // ledcAttachPin(pin, 0);
+      addFadeTask(pin, 0, 255, duration);
+      feedbackDoc["targetId"] = targetId;
+      JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
+      feedbackPayload["deviceid"] = deviceid;
+      feedbackPayload["pin"] = pin;
+      feedbackPayload["controlid"] = controlid;
+      feedbackPayload["status"] = "started"; //digitalRead(pin) == HIGH ? "HIGH" : "LOW";  // Current status of GPIO
+      serializeJson(feedbackDoc, feedback);
+    } else if (strcmp(action, "fade_out") == 0) {
+      int start_duty = doc["payload"]["params"]["start_duty"].isNull() ? -1 : doc["payload"]["params"]["start_duty"].as<int>();
+      int end_duty = doc["payload"]["params"]["end_duty"].isNull() ? -1 : doc["payload"]["params"]["end_duty"].as<int>();
+      int duration = doc["payload"]["params"]["duration"].isNull() ? -1 : doc["payload"]["params"]["duration"].as<int>();
+      int step_delay = doc["payload"]["params"]["step_delay"].isNull() ? -1 : doc["payload"]["params"]["step_delay"].as<int>();
+      //ledcSetup(0, 5000, 8);
+      //ledcAttachPin(pin, 0);
+      addFadeTask(pin, 255, 0, duration);
+      feedbackDoc["targetId"] = targetId;
+      JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
+      feedbackPayload["deviceid"] = deviceid;
+      feedbackPayload["pin"] = pin;
+      feedbackPayload["controlid"] = controlid;
+      feedbackPayload["status"] = "started";//digitalRead(pin) == HIGH ? "HIGH" : "LOW";  // Current status of GPIO
+      serializeJson(feedbackDoc, feedback);
+    } else if (strcmp(action, "pulse") == 0) {
+      int duration = doc["payload"]["params"]["duration"].isNull() ? 1000 : doc["payload"]["params"]["duration"].as<int>();
+      int state = doc["payload"]["params"]["state"].isNull() ? HIGH : doc["payload"]["params"]["state"].as<int>();
+
+      addPulseTask(pin, duration, state);
+      feedbackDoc["targetId"] = targetId;
+      JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
+      feedbackPayload["deviceid"] = deviceid;
+      feedbackPayload["pin"] = pin;
+      feedbackPayload["controlid"] = controlid;
+      feedbackPayload["status"] = "started";//digitalRead(pin) == HIGH ? "HIGH" : "LOW";  // Current status of GPIO
+      serializeJson(feedbackDoc, feedback);
+
+    } else if (strcmp(action, "get_gpio_status") == 0) {
+
+      feedbackDoc["targetId"] = targetId;
+      JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
+      feedbackPayload["deviceid"] = deviceid;
+      feedbackPayload["pin"] = pin;
+      feedbackPayload["controlid"] = controlid;
+      feedbackPayload["status"] = digitalRead(pin) == HIGH ? "HIGH" : "LOW";  // Current status of GPIO
+      feedbackPayload["device"] = true;
+      serializeJson(feedbackDoc, feedback);
+    } else if (strcmp(action, "ping") == 0) {
+
+      feedbackDoc["targetId"] = targetId;
+      JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
+      feedbackPayload["status"] = true;
+      serializeJson(feedbackDoc, feedback);
+    }
+  } else if (strcmp(commands, "sensor") == 0) {
+
+    const char* sensor_type = doc["payload"]["sensor_type"];
+    float value = 0.0;
+
+    if (strcmp(sensor_type, "DS18B20") == 0) {
+      // value = readTemperatureDS18B20();
+    } else if (strcmp(sensor_type, "DHT11") == 0) {
+      // value = readHumidityDHT11();
+    } else if (strcmp(sensor_type, "ADC") == 0) {
+      int adc_channel = doc["payload"]["adc_channel"];
+      float scale_factor = doc["payload"]["scale_factor"];
+      if (isAdcPin(adc_channel)) {
+        value = analogRead(adc_channel) * scale_factor;
+      }
+    }
+  } else if (strcmp(commands, "ota_update") == 0) {
+    const char* otaUrl = doc["payload"]["url"];
+    const char* ver = doc["payload"]["version"];
+    versionid = String(ver);
+    if (otaUrl != nullptr) {
+      performOTA(otaUrl);  // Trigger OTA update
+    } else {
+      Serial.println("Invalid OTA URL received.");
+    }
+  } else if (strcmp(commands, "get_device_info") == 0) {
+    preferences.begin("wifi-creds", false);
+
+    String firmversion = preferences.getString("firmware", fversion);
+    feedbackDoc["targetId"] = targetId;
+    JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
+    feedbackPayload["status"] = "online";
+    feedbackPayload["version"] = firmversion;
+    serializeJson(feedbackDoc, feedback);
+    preferences.end();
+  }
+
+  routeMessage(targetId, feedback);
+}
+
+
 
 
 
@@ -637,37 +1004,116 @@ void startAPMode() {
   WiFi.disconnect(true);
   const char* customHostname = "NIKOLAINDUSTRY_AP_Config";
   WiFi.setHostname(customHostname);
-  WiFi.mode(WIFI_AP);
+  WiFi.mode(WIFI_AP_STA);  // STA side stays idle but lets the portal scan for networks
   WiFi.softAP(apSSID, apPassword);
   WiFi.softAPConfig(IPAddress(192, 168, 4, 1), IPAddress(192, 168, 4, 1), IPAddress(255, 255, 255, 0));
 
   dnsServer.start(53, "*", WiFi.softAPIP());
   Serial.println("AP Mode started. Connect to: " + String(apSSID));
   Serial.println("Open the browser and access: http://192.168.4.1");
+  requestWifiScan();  // Have results ready by the time someone opens the portal
+}
+
+void scheduleRestart(unsigned long delayMs) {
+  restartPending = true;
+  restartAt = millis() + delayMs;
 }
 
 void restratesp() {
   server.send(200, "application/json", "{\"status\":\"Restart\",\"message\":\"Restarting.....!!!\"}");
-  delay(1000);
-  ESP.restart();
+  scheduleRestart(1000);
 }
 
 
+// Serves the prebuilt gzip portal straight from flash; browsers revalidate with the ETag
 void handleConfigPage() {
-  preferences.begin("wifi-creds", false);
-  String firmversion = preferences.getString("firmware", fversion);
-  String htmlPage =
-    "<!DOCTYPE html>"
-    "<html><head><title>NIKOLAINDUSTRY_Config </title></head><body>"
-    "<h1>WiFi Configuration of Device ID:"
-    + deviceid + " Firmware Version:" + firmversion + "</h1>"
-                                                      "<form action=\"/submit\" method=\"POST\">"
-                                                      "SSID: <input type=\"text\" name=\"ssid\"><br>"
-                                                      "Password: <input type=\"password\" name=\"password\"><br>"
-                                                      "<input type=\"submit\" value=\"Save\">"
-                                                      "</form></body></html>";
-  server.send(200, "text/html", htmlPage);
-  preferences.end();
+  server.sendHeader("ETag", PORTAL_HTML_ETAG);
+  server.sendHeader("Cache-Control", "max-age=3600");
+  if (server.header("If-None-Match") == PORTAL_HTML_ETAG) {
+    server.send(304);
+    return;
+  }
+  server.sendHeader("Content-Encoding", "gzip");
+  server.send_P(200, "text/html", (const char*)PORTAL_HTML_GZ, PORTAL_HTML_GZ_LEN);
+}
+
+void handleDeviceInfo() {
+  server.sendHeader("Cache-Control", "no-store");
+  server.send(200, "application/json", "{\"deviceid\":\"" + deviceid + "\",\"firmware\":\"" + currentFirmware + "\"}");
+}
+
+void requestWifiScan() {
+  wifiScanRequested = true;
+}
+
+// Polls the background scan from loop(); starts a new one only when requested
+void updateWifiScan() {
+  if (wifiScanRunning) {
+    int16_t found = WiFi.scanComplete();
+    if (found == WIFI_SCAN_RUNNING) {
+      return;
+    }
+    wifiScanRunning = false;
+    if (found < 0) {
+      Serial.println("WiFi scan failed.");
+      return;
+    }
+
+    // One entry per SSID, keeping the strongest signal
+    DynamicJsonDocument scanDoc(2048);
+    JsonArray networks = scanDoc.to<JsonArray>();
+    for (int i = 0; i < found; i++) {
+      String name = WiFi.SSID(i);
+      if (name.isEmpty()) {
+        continue;
+      }
+      int32_t rssi = WiFi.RSSI(i);
+      bool seen = false;
+      for (JsonObject net : networks) {
+        if (name == net["ssid"].as<const char*>()) {
+          if (rssi > net["rssi"].as<int32_t>()) {
+            net["rssi"] = rssi;
+          }
+          seen = true;
+          break;
+        }
+      }
+      if (seen || networks.size() >= maxScanResults) {
+        continue;
+      }
+      JsonObject net = networks.createNestedObject();
+      net["ssid"] = name;
+      net["rssi"] = rssi;
+      net["secure"] = WiFi.encryptionType(i) != WIFI_AUTH_OPEN;
+    }
+    WiFi.scanDelete();
+
+    wifiScanCache = "";
+    serializeJson(scanDoc, wifiScanCache);
+    wifiScanCachedAt = millis();
+    return;
+  }
+
+  if (wifiScanRequested && (WiFi.getMode() & WIFI_STA)) {
+    wifiScanRequested = false;
+    if (WiFi.scanNetworks(true, false, false, wifiScanChannelTimeMs) == WIFI_SCAN_FAILED) {
+      Serial.println("Could not start WiFi scan.");
+      return;
+    }
+    wifiScanRunning = true;
+  }
+}
+
+// Answers from the cache right away; stale results schedule a background rescan
+void handleWifiScan() {
+  bool fresh = wifiScanCachedAt != 0 && millis() - wifiScanCachedAt < wifiScanTtl;
+  if (!fresh && !wifiScanRunning) {
+    requestWifiScan();
+  }
+  bool scanning = wifiScanRunning || wifiScanRequested;
+  unsigned long age = wifiScanCachedAt == 0 ? 0 : (millis() - wifiScanCachedAt) / 1000;
+  server.sendHeader("Cache-Control", "no-store");
+  server.send(200, "application/json", "{\"scanning\":" + String(scanning ? "true" : "false") + ",\"age\":" + String(age) + ",\"networks\":" + wifiScanCache + "}");
 }
 
 void handleConfigSubmit() {
@@ -679,8 +1125,7 @@ void handleConfigSubmit() {
     preferences.putString("password", password);
     preferences.end();
     server.send(200, "application/json", "{\"status\":\"saved\",\"message\":\"WiFi credentials saved. Restarting...\"}");
-    delay(1000);
-    ESP.restart();
+    scheduleRestart(1000);
   } else {
     server.send(400, "application/json", "{\"status\":\"failed\",\"message\":\"Invalid input. Try again.\"}");
   }
@@ -697,8 +1142,7 @@ void clearConfig() {
   preferences.putString("deviceid", "");
   preferences.end();
   server.send(200, "application/json", "{\"status\":\"cleared\",\"message\":\"WiFi credentials cleared. Restarting...\"}");
-  delay(1000);
-  ESP.restart();
+  scheduleRestart(1000);
 }
 
 
@@ -727,14 +1171,17 @@ void handleSetWiFi() {
       preferences.putString("email", email);
       preferences.putString("productid", productid);
       preferences.putString("APICALL", "true");
+      if (server.hasArg("lankey")) {
+        lanKey = server.arg("lankey");
+        preferences.putString("lankey", lanKey);
+      }
       preferences.end();
       Serial.println("200");
       server.send(200, "application/json", "{\"status\":\"success\",\"message\":\"WiFi saved. Restarting...\"}");
 
 
       // WiFi.begin(ssid.c_str(), password.c_str());
-      delay(500);
-      ESP.restart();
+      scheduleRestart(500);
     } else {
       server.send(404, "application/json", "{\"status\":\"missing\",\"message\":\"WiFi not saved.\"}");
     }
@@ -742,7 +1189,6 @@ void handleSetWiFi() {
   } else {
     server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"Missing parameters.\"}");
     Serial.println("400");
-    delay(5000);
   }
 }
 
@@ -0,0 +1,105 @@
+#pragma once
+// Feature policy: "control_gpio" toggle / HIGH / LOW / get_gpio_status / ping.
+// PersistentGpioControl also saves pin states and restores them at boot.
+#include <Preferences.h>
+#include "NikolaCore.h"
+#include "../board_profiles.h"
+
+namespace nikola {
+
+template <bool Persist>
+class BasicGpioControl : public Feature {
+public:
+  template <class Device> void begin(Device&) {
+    if (Persist) {
+      gpioPreferences.begin("gpio-states", false);
+      restoreAllGPIOStates();
+    }
+  }
+
+  template <class Device> bool handle(Device&, CommandContext& ctx) {
+    if (strcmp(ctx.commands, "control_gpio") != 0) {
+      return false;
+    }
+
+    int pin = ctx.pin;
+    if (strcmp(ctx.action, "ping") == 0) {
+      ctx.reply()["status"] = true;
+      return true;
+    }
+    if (strcmp(ctx.action, "get_gpio_status") == 0) {
+      if (!isValidPin(pin)) {
+        return rejectPin(ctx);
+      }
+      JsonObject payload = statusReply(ctx);
+      payload["device"] = true;
+      return true;
+    }
+
+    int state;
+    if (strcmp(ctx.action, "toggle") == 0) {
+      state = -1;
+    } else if (strcmp(ctx.action, "HIGH") == 0) {
+      state = HIGH;
+    } else if (strcmp(ctx.action, "LOW") == 0) {
+      state = LOW;
+    } else {
+      return false;  // Leave timed actions to other features
+    }
+    if (!isOutputPin(pin)) {
+      return rejectPin(ctx);
+    }
+
+    pinMode(pin, OUTPUT);
+    if (state == -1) {
+      state = !digitalRead(pin);
+    }
+    digitalWrite(pin, state);
+    if (Persist) {
+      gpioPreferences.putInt(("pin_" + String(pin)).c_str(), state);
+    }
+    statusReply(ctx);
+    return true;
+  }
+
+private:
+  Preferences gpioPreferences;
+
+  static JsonObject statusReply(CommandContext& ctx) {
+    JsonObject payload = ctx.reply();
+    payload["deviceid"] = ctx.doc["payload"]["deviceid"];
+    payload["pin"] = ctx.pin;
+    payload["controlid"] = ctx.controlid;
+    payload["status"] = digitalRead(ctx.pin) == HIGH ? "HIGH" : "LOW";  // Current status of GPIO
+    return payload;
+  }
+
+  static bool rejectPin(CommandContext& ctx) {
+    Serial.printf("Rejected GPIO command for pin %d on %s\n", ctx.pin, activeBoard.name);
+    JsonObject payload = ctx.reply();
+    payload["deviceid"] = ctx.doc["payload"]["deviceid"];
+    payload["pin"] = ctx.pin;
+    payload["controlid"] = ctx.controlid;
+    payload["status"] = "invalid_pin";
+    return true;
+  }
+
+  void restoreAllGPIOStates() {
+    // Only output-capable pins of the target board can hold a saved state
+    for (uint64_t pins = activeBoard.output; pins != 0; pins &= pins - 1) {
+      int pin = lowestPin(pins);
+      String key = "pin_" + String(pin);
+      if (gpioPreferences.isKey(key.c_str())) {
+        int state = gpioPreferences.getInt(key.c_str(), LOW);
+        pinMode(pin, OUTPUT);
+        digitalWrite(pin, state);
+        Serial.printf("Restored pin %d to state %d\n", pin, state);
+      }
+    }
+  }
+};
+
+using GpioControl = BasicGpioControl<false>;
+using PersistentGpioControl = BasicGpioControl<true>;
+
+}  // namespace nikola
@@ -0,0 +1,83 @@
+#pragma once
+// Transport policy: MQTT client on the relay's broker.
+// Commands arrive on device/{id}/commands; feedback goes to device/{id}/send/{targetId}.
+#include <PubSubClient.h>
+#include "NikolaCore.h"
+
+namespace nikola {
+
+class MqttTransport {
+public:
+  const char* host = "nikolaindustry-realtime.onrender.com";
+  uint16_t port = 1883;
+  ReconnectBackoff backoff;
+
+  template <class Device> void connect(Device& device) {
+    deviceId = device.credentials.deviceid;
+    client.setClient(wifiClient);
+    client.setServer(host, port);
+    client.setBufferSize(2048);
+    client.setCallback([&device](char* topic, uint8_t* payload, unsigned int length) {
+      device.handleFrame(payload, length);
+    });
+    retryAt = 0;
+    wasConnected = false;
+  }
+
+  void disconnect() {
+    client.disconnect();
+  }
+
+  template <class Device> void loop(Device&) {
+    if (!client.connected()) {
+      if (wasConnected) {
+        wasConnected = false;
+        scheduleRetry("MQTT disconnected!");
+      }
+      if (retryAt != 0 && (long)(millis() - retryAt) < 0) {
+        return;
+      }
+      if (!client.connect(deviceId.c_str())) {
+        scheduleRetry("MQTT connect failed!");
+        return;
+      }
+      String commandTopic = "device/" + deviceId + "/commands";
+      client.subscribe(commandTopic.c_str(), 1);
+      Serial.println("MQTT connected!");
+      backoff.connected();
+      wasConnected = true;
+      retryAt = 0;
+    }
+    client.loop();
+  }
+
+  // The relay wraps what arrives on a /send/ topic as the payload, so only that part is published
+  bool send(JsonDocument& frame) {
+    const char* targetId = frame["targetId"] | "";
+    if (*targetId == '\0' || !client.connected()) {
+      return false;
+    }
+    String topic = "device/" + deviceId + "/send/" + targetId;
+    String message;
+    serializeJson(frame["payload"], message);
+    return client.publish(topic.c_str(), message.c_str());
+  }
+
+private:
+  WiFiClient wifiClient;
+  PubSubClient client;
+  String deviceId;
+  unsigned long retryAt = 0;  // 0: connect on the next loop
+  bool wasConnected = false;
+
+  void scheduleRetry(const char* reason) {
+    unsigned long delayMs = backoff.next();
+    retryAt = millis() + delayMs;
+    if (retryAt == 0) {
+      retryAt = 1;
+    }
+    Serial.printf("%s State %d, reconnecting in %lu ms\n", reason, client.state(), delayMs);
+  }
+};
+
+}  // namespace nikola
@@ -0,0 +1,382 @@
+#pragma once
+// Shared firmware core for NIKOLAINDUSTRY devices.
+//
+// A device is assembled at compile time from one transport policy and any number
+// of feature policies:
+//
+//   #include "nikola_core/NikolaCore.h"
+//   #include "nikola_core/WebSocketClientTransport.h"
+//   #include "nikola_core/GpioControl.h"
+//
+//   nikola::NikolaDevice<nikola::WebSocketClientTransport, nikola::PersistentGpioControl> device;
+//
+//   void setup() { device.begin(); }
+//   void loop() { device.loop(); }
+//
+// Everything is header-only and dispatched statically, so a sketch only pulls in
+// the libraries of the policies it names.
+#include <WiFi.h>
+#include <Preferences.h>
+#include <ArduinoJson.h>
+
+namespace nikola {
+
+const char* const deviceHostname = "NIKOLAINDUSTRY_Device";
+const unsigned long wifiConnectTimeout = 30000;  // First connection attempt at boot
+const unsigned long reconnectInterval = 10000;   // Attempt every 10 seconds if disconnected
+const int maxRetries = 6;                        // Give up (and let features react) after 6 attempts
+
+// Provisioning data stored in the "wifi-creds" namespace by every firmware variant
+struct Credentials {
+  String ssid, password, userid, deviceid, productid, email, firstimecall, macid;
+
+  void load() {
+    Preferences preferences;
+    preferences.begin("wifi-creds", true);
+    ssid = preferences.getString("ssid", "");
+    password = preferences.getString("password", "");
+    userid = preferences.getString("userid", "");
+    email = preferences.getString("email", "");
+    deviceid = preferences.getString("deviceid", "");
+    productid = preferences.getString("productid", "");
+    firstimecall = preferences.getString("APICALL", "");
+    preferences.end();
+    macid = WiFi.macAddress();
+  }
+
+  bool hasWifi() const {
+    return !ssid.isEmpty() && !password.isEmpty();
+  }
+
+  bool complete() const {
+    return hasWifi() && !deviceid.isEmpty();
+  }
+};
+
+// The relay may combine several frames into one JSON array when the device connects
+// with batch=1. Calls handle(frame, length) for each object in such an array, or once
+// for a plain frame. Elements are found by tracking strings and nesting, so each one
+// is parsed on its own and the JSON document only ever has to hold one command.
+template <class Handler>
+void forEachFrame(const uint8_t* payload, size_t length, Handler handle) {
+  size_t i = 0;
+  while (i < length && isspace(payload[i])) {
+    i++;
+  }
+  if (i == length || payload[i] != '[') {
+    handle(payload, length);
+    return;
+  }
+
+  int depth = 0;
+  bool inString = false;
+  size_t start = 0;
+  for (i++; i < length; i++) {
+    char c = payload[i];
+    if (inString) {
+      if (c == '\\') {
+        i++;
+      } else if (c == '"') {
+        inString = false;
+      }
+    } else if (c == '"') {
+      inString = true;
+    } else if (c == '{' || c == '[') {
+      if (depth++ == 0) {
+        start = i;
+      }
+    } else if (c == '}' || c == ']') {
+      if (depth == 0) {
+        return;  // End of the batch
+      }
+      if (--depth == 0) {
+        handle(payload + start, i + 1 - start);
+      }
+    }
+  }
+}
+
+// Delay before the next reconnect to the relay. When the relay restarts every device
+// drops at once; doubling the delay (up to maxDelay) and picking a random point in its
+// upper half keeps the fleet from reconnecting, and handshaking, in the same second.
+//
+// Clients that connect synchronously (PubSubClient) just wait next() after a failure.
+// WebSocketsClient retries on its own instead, at a fixed interval, and only reports
+// WStype_DISCONNECTED for connections that were up, so a relay that is down never
+// shows up as a failure. For it every attempt is started by the caller:
+//
+//   if (backoff.attemptDue()) { webSocket.setReconnectInterval(backoff.startAttempt()); webSocket.begin...; }
+//   if (backoff.active()) { webSocket.loop(); }
+//
+// An attempt that has not connected when the next one comes due has failed, and the
+// delay keeps growing; between attempts the library is not run, so it cannot retry early.
+struct ReconnectBackoff {
+  unsigned long initialDelay = 1000;
+  unsigned long maxDelay = 60000;
+  unsigned long stableAfter = 60000;    // A connection up this long starts over at initialDelay
+  unsigned long attemptTimeout = 5000;  // Time an attempt gets for TCP, TLS and the upgrade
+
+  void connected() {
+    connectedAt = millis();
+    up = true;
+    attempting = false;
+  }
+
+  // A connection that was up has dropped; returns the wait before the next attempt, or 0
+  // if there was no connection (a failed attempt, which its deadline already covers)
+  unsigned long disconnected() {
+    if (!up) {
+      return 0;
+    }
+    up = false;
+    attempting = false;
+    unsigned long delayMs = next();
+    retryAt = millis() + delayMs;
+    return delayMs;
+  }
+
+  // Records an attempt and returns the time until the next one, which is also the
+  // shortest interval the client library may retry at on its own
+  unsigned long startAttempt() {
+    started = true;
+    attempting = true;
+    unsigned long delayMs = attemptTimeout + next();
+    retryAt = millis() + delayMs;
+    return delayMs;
+  }
+
+  bool attemptDue() const {
+    return started && !up && (long)(millis() - retryAt) >= 0;
+  }
+
+  // The client library may run: connected, or an attempt is under way
+  bool active() const {
+    return up || attempting;
+  }
+
+  unsigned long next() {
+    if (connectedAt != 0 && millis() - connectedAt >= stableAfter) {
+      step = 0;
+    }
+    connectedAt = 0;
+    step = step == 0 ? initialDelay : min(step * 2, maxDelay);
+    return step / 2 + random(step / 2 + 1);
+  }
+
+private:
+  unsigned long step = 0;
+  unsigned long connectedAt = 0;
+  unsigned long retryAt = 0;
+  bool started = false;
+  bool up = false;
+  bool attempting = false;
+};
+
+// One parsed command frame and the feedback being built for it.
+// Feedback is sent back to the sender once a feature has filled it in.
+struct CommandContext {
+  JsonDocument& doc;
+  const char* from;
+  const char* commands;
+  const char* action;
+  const char* controlid;
+  int pin;
+  StaticJsonDocument<256> feedback;
+
+  explicit CommandContext(JsonDocument& frame)
+    : doc(frame),
+      from(frame["from"] | ""),
+      commands(frame["payload"]["commands"] | "notavailable"),
+      action(frame["payload"]["actions"] | "notavailable"),
+      controlid(frame["payload"]["controlid"] | "notavailable"),
+      pin(frame["payload"]["pin"] | -1) {}
+
+  // Starts the usual {"targetId": sender, "payload": {...}} feedback frame
+  JsonObject reply() {
+    feedback.clear();
+    feedback["targetId"] = from;
+    return feedback.createNestedObject("payload");
+  }
+};
+
+// Default hooks for feature policies; a feature overrides only what it needs
+struct Feature {
+  template <class Device> void begin(Device&) {}
+  template <class Device> void loop(Device&) {}
+  template <class Device> void wifiConnected(Device&) {}
+  template <class Device> void wifiUnavailable(Device&) {}
+  template <class Device> bool handle(Device&, CommandContext&) { return false; }
+};
+
+// Compile-time list of features, expanded into plain member calls
+template <class... Features>
+struct FeatureSet {
+  template <class Device> void begin(Device&) {}
+  template <class Device> void loop(Device&) {}
+  template <class Device> void wifiConnected(Device&) {}
+  template <class Device> void wifiUnavailable(Device&) {}
+  template <class Device> bool handle(Device&, CommandContext&) { return false; }
+};
+
+template <class First, class... Rest>
+struct FeatureSet<First, Rest...> {
+  First head;
+  FeatureSet<Rest...> tail;
+
+  template <class Device> void begin(Device& device) {
+    head.begin(device);
+    tail.begin(device);
+  }
+  template <class Device> void loop(Device& device) {
+    head.loop(device);
+    tail.loop(device);
+  }
+  template <class Device> void wifiConnected(Device& device) {
+    head.wifiConnected(device);
+    tail.wifiConnected(device);
+  }
+  template <class Device> void wifiUnavailable(Device& device) {
+    head.wifiUnavailable(device);
+    tail.wifiUnavailable(device);
+  }
+  // The first feature that recognises the command handles it
+  template <class Device> bool handle(Device& device, CommandContext& ctx) {
+    return head.handle(device, ctx) || tail.handle(device, ctx);
+  }
+};
+
+template <class Transport, class... Features>
+class NikolaDevice {
+public:
+  Credentials credentials;
+  Transport transport;
+
+  void begin() {
+    Serial.begin(115200);
+    credentials.load();
+    features.begin(*this);
+
+    if (credentials.hasWifi()) {
+      connectToWiFi();
+    } else {
+      features.wifiUnavailable(*this);
+    }
+  }
+
+  void loop() {
+    if (credentials.hasWifi()) {
+      maintainWiFi();
+    }
+    if (online) {
+      transport.loop(*this);
+    }
+    features.loop(*this);
+  }
+
+  // Sends a {"targetId": ..., "payload": {...}} frame through the transport
+  bool send(JsonDocument& frame) {
+    if (!online) {
+      return false;
+    }
+    return transport.send(frame);
+  }
+
+  // Convenience for status frames such as OTA progress
+  bool sendStatus(const char* targetId, const char* status, const char* value = nullptr) {
+    StaticJsonDocument<256> frame;
+    frame["targetId"] = targetId;
+    frame["payload"]["status"] = status;
+    if (value != nullptr) {
+      frame["payload"]["value"] = value;
+    }
+    return send(frame);
+  }
+
+  // Entry point for transports; a batched delivery is handled frame by frame
+  void handleFrame(const uint8_t* payload, size_t length) {
+    forEachFrame(payload, length, [this](const uint8_t* frame, size_t frameLength) {
+      handleSingleFrame(frame, frameLength);
+    });
+  }
+
+  // Parse once, let the features handle it, send feedback
+  void handleSingleFrame(const uint8_t* payload, size_t length) {
+    StaticJsonDocument<2048> doc;
+    DeserializationError error = deserializeJson(doc, payload, length);
+    if (error) {
+      Serial.print("Failed to parse JSON: ");
+      Serial.println(error.f_str());
+      return;
+    }
+
+    CommandContext ctx(doc);
+    if (!features.handle(*this, ctx)) {
+      Serial.print("Unhandled command: ");
+      Serial.println(ctx.commands);
+      return;
+    }
+    if (!ctx.feedback.isNull()) {
+      send(ctx.feedback);
+    }
+  }
+
+  bool isOnline() const {
+    return online;
+  }
+
+private:
+  FeatureSet<Features...> features;
+  bool online = false;
+  unsigned long lastReconnectAttempt = 0;
+  int retryCount = 0;
+
+  void connectToWiFi() {
+    WiFi.setHostname(deviceHostname);
+    WiFi.mode(WIFI_STA);
+    WiFi.setSleep(false);
+    WiFi.begin(credentials.ssid.c_str(), credentials.password.c_str());
+    Serial.println("Connecting to WiFi...");
+
+    unsigned long startAttemptTime = millis();
+    while (WiFi.status() != WL_CONNECTED && millis() - startAttemptTime < wifiConnectTimeout) {
+      delay(500);
+      Serial.print(".");
+    }
+    if (WiFi.status() != WL_CONNECTED) {
+      Serial.println("\nConnection timed out.");
+      features.wifiUnavailable(*this);
+    }
+  }
+
+  void maintainWiFi() {
+    bool connected = WiFi.status() == WL_CONNECTED;
+    if (connected && !online) {
+      online = true;
+      retryCount = 0;
+      Serial.println("WiFi connected! IP Address: " + WiFi.localIP().toString());
+      features.wifiConnected(*this);
+      transport.connect(*this);
+    } else if (!connected && online) {
+      online = false;
+      transport.disconnect();
+    }
+
+    if (connected) {
+      return;
+    }
+    unsigned long now = millis();
+    if (now - lastReconnectAttempt < reconnectInterval) {
+      return;
+    }
+    lastReconnectAttempt = now;
+    Serial.println("Attempting to reconnect to WiFi...");
+    WiFi.begin(credentials.ssid.c_str(), credentials.password.c_str());
+    if (++retryCount >= maxRetries) {
+      Serial.println("Failed to connect.");
+      retryCount = 0;
+      features.wifiUnavailable(*this);
+    }
+  }
+};
+
+}  // namespace nikola
@@ -0,0 +1,96 @@
+#pragma once
+// Feature policy: "ota_update" over HTTPS and "get_device_info" with the installed version
+#include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+#include <Update.h>
+#include "NikolaCore.h"
+
+namespace nikola {
+
+class OtaUpdate : public Feature {
+public:
+  const char* defaultVersion = "0.0.4";
+
+  template <class Device> void begin(Device&) {
+    Preferences preferences;
+    preferences.begin("wifi-creds", true);
+    firmware = preferences.getString("firmware", defaultVersion);
+    preferences.end();
+  }
+
+  template <class Device> bool handle(Device& device, CommandContext& ctx) {
+    if (strcmp(ctx.commands, "get_device_info") == 0) {
+      JsonObject payload = ctx.reply();
+      payload["status"] = "online";
+      payload["version"] = firmware;
+      return true;
+    }
+    if (strcmp(ctx.commands, "ota_update") != 0) {
+      return false;
+    }
+
+    const char* otaUrl = ctx.doc["payload"]["url"];
+    if (otaUrl == nullptr) {
+      Serial.println("Invalid OTA URL received.");
+      return true;
+    }
+    String target = ctx.from;  // The frame is reused while downloading, keep our own copy
+    String version = ctx.doc["payload"]["version"] | "";
+    performOTA(device, target.c_str(), otaUrl, version);
+    return true;
+  }
+
+private:
+  String firmware;
+
+  template <class Device> void performOTA(Device& device, const char* target, const char* otaUrl, const String& version) {
+    WiFiClientSecure client;
+    client.setInsecure();
+    HTTPClient http;
+
+    Serial.printf("Attempting to download OTA file from %s\n", otaUrl);
+    http.begin(client, otaUrl);
+    int httpCode = http.GET();
+    if (httpCode != HTTP_CODE_OK) {
+      Serial.printf("HTTP GET failed, error: %s\n", http.errorToString(httpCode).c_str());
+      device.sendStatus(target, "OTA_Download_Failed", http.errorToString(httpCode).c_str());
+      http.end();
+      return;
+    }
+
+    int contentLength = http.getSize();
+    if (contentLength <= 0) {
+      device.sendStatus(target, "OTA_Download_Failed", "No content in OTA file.");
+      http.end();
+      return;
+    }
+
+    device.sendStatus(target, "OTA_Update_Started");
+    if (!Update.begin(contentLength)) {
+      device.sendStatus(target, "OTA_Download_Failed", "Not enough space!");
+      http.end();
+      return;
+    }
+
+    size_t written = Update.writeStream(http.getStream());
+    Serial.printf("Written %d bytes\n", written);
+    if (written == (size_t)contentLength && Update.end() && Update.isFinished()) {
+      Preferences preferences;
+      preferences.begin("wifi-creds", false);
+      preferences.putString("firmware", version);
+      preferences.end();
+
+      Serial.println("OTA update successfully completed.");
+      device.sendStatus(target, "OTA_Update_Completed", "Rebooting");
+      http.end();
+      delay(2000);
+      ESP.restart();
+    }
+
+    Serial.println("OTA update failed!");
+    device.sendStatus(target, "OTA_Update_Failed", Update.errorString());
+    http.end();
+  }
+};
+
+}  // namespace nikola
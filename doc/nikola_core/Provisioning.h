@@ -0,0 +1,270 @@
+#pragma once
+// Feature policies for getting a device onto the network:
+//  - ApProvisioning: captive config portal (AP mode, /setwifi, /scan, ...)
+//  - ProductRegistration: one-time product registration after provisioning
+#include <WebServer.h>
+#include <DNSServer.h>
+#include <HTTPClient.h>
+#include "NikolaCore.h"
+#include "../portal_assets.h"  // Generated by tools/build-portal.js
+
+namespace nikola {
+
+class ApProvisioning : public Feature {
+public:
+  const char* apSSID = "NIKOLAINDUSTRY_Setup";
+  const char* apPassword = "0123456789";
+  unsigned long wifiScanTtl = 30000;         // Results older than 30 seconds trigger a rescan
+  uint32_t wifiScanChannelTimeMs = 120;      // Short dwell per channel keeps the AP responsive
+
+  template <class Device> void begin(Device& device) {
+    credentials = &device.credentials;
+    Preferences preferences;
+    preferences.begin("wifi-creds", true);
+    firmware = preferences.getString("firmware", "");
+    preferences.end();
+
+    const char* portalHeaders[] = { "If-None-Match" };
+    server.collectHeaders(portalHeaders, 1);
+    server.on("/", [this]() { handleConfigPage(); });
+    server.on("/info", HTTP_GET, [this]() { handleDeviceInfo(); });
+    server.on("/scan", HTTP_GET, [this]() { handleWifiScan(); });
+    server.on("/submit", HTTP_POST, [this]() { handleConfigSubmit(); });
+    server.on("/setwifi", HTTP_GET, [this]() { handleSetWiFi(); });
+    server.on("/clearwifi", HTTP_GET, [this]() { clearConfig(); });
+    server.on("/restart", HTTP_GET, [this]() {
+      server.send(200, "application/json", "{\"status\":\"Restart\",\"message\":\"Restarting.....!!!\"}");
+      scheduleRestart(1000);
+    });
+    // The server is started once Wi-Fi is up in some mode (startServer): opening the
+    // listen socket before WiFi.mode() has brought up the network stack can crash lwIP
+  }
+
+  template <class Device> void loop(Device&) {
+    if (apActive) {
+      dnsServer.processNextRequest();
+    }
+    if (serverStarted) {
+      server.handleClient();
+    }
+    updateWifiScan();
+    if (restartPending && (long)(millis() - restartAt) >= 0) {
+      ESP.restart();
+    }
+  }
+
+  template <class Device> void wifiUnavailable(Device&) {
+    startAPMode();
+    startServer();
+  }
+
+  template <class Device> void wifiConnected(Device&) {
+    if (apActive) {
+      Serial.println("WiFi connected, disabling AP mode...");
+      dnsServer.stop();
+      WiFi.softAPdisconnect(true);
+      WiFi.mode(WIFI_STA);
+      apActive = false;
+    }
+    startServer();
+  }
+
+private:
+  WebServer server{ 80 };
+  DNSServer dnsServer;
+  Credentials* credentials = nullptr;
+  String firmware;
+  bool apActive = false;
+  bool serverStarted = false;
+  bool restartPending = false;
+  unsigned long restartAt = 0;
+  String wifiScanCache = "[]";
+  unsigned long wifiScanCachedAt = 0;
+  bool wifiScanRequested = false;
+  bool wifiScanRunning = false;
+
+  void startAPMode() {
+    if (apActive) {
+      return;
+    }
+    WiFi.setHostname("NIKOLAINDUSTRY_AP_Config");
+    WiFi.mode(WIFI_AP_STA);  // STA side keeps retrying and lets the portal scan for networks
+    WiFi.softAP(apSSID, apPassword);
+    WiFi.softAPConfig(IPAddress(192, 168, 4, 1), IPAddress(192, 168, 4, 1), IPAddress(255, 255, 255, 0));
+    dnsServer.start(53, "*", WiFi.softAPIP());
+    apActive = true;
+    wifiScanRequested = true;  // Have results ready by the time someone opens the portal
+    Serial.println("AP Mode started. Connect to: " + String(apSSID));
+    Serial.println("Open the browser and access: http://192.168.4.1");
+  }
+
+  void startServer() {
+    if (serverStarted) {
+      return;
+    }
+    server.begin();
+    serverStarted = true;
+  }
+
+  // Restarts are deferred to loop() so handlers return immediately
+  void scheduleRestart(unsigned long delayMs) {
+    restartPending = true;
+    restartAt = millis() + delayMs;
+  }
+
+  void handleConfigPage() {
+    server.sendHeader("ETag", PORTAL_HTML_ETAG);
+    server.sendHeader("Cache-Control", "max-age=3600");
+    if (server.header("If-None-Match") == PORTAL_HTML_ETAG) {
+      server.send(304);
+      return;
+    }
+    server.sendHeader("Content-Encoding", "gzip");
+    server.send_P(200, "text/html", (const char*)PORTAL_HTML_GZ, PORTAL_HTML_GZ_LEN);
+  }
+
+  void handleDeviceInfo() {
+    server.sendHeader("Cache-Control", "no-store");
+    server.send(200, "application/json", "{\"deviceid\":\"" + credentials->deviceid + "\",\"firmware\":\"" + firmware + "\"}");
+  }
+
+  void updateWifiScan() {
+    if (wifiScanRunning) {
+      int16_t found = WiFi.scanComplete();
+      if (found == WIFI_SCAN_RUNNING) {
+        return;
+      }
+      wifiScanRunning = false;
+      if (found < 0) {
+        return;
+      }
+
+      // One entry per SSID, keeping the strongest signal
+      DynamicJsonDocument scanDoc(2048);
+      JsonArray networks = scanDoc.to<JsonArray>();
+      for (int i = 0; i < found && networks.size() < 20; i++) {
+        String name = WiFi.SSID(i);
+        if (name.isEmpty()) {
+          continue;
+        }
+        bool seen = false;
+        for (JsonObject net : networks) {
+          if (name == net["ssid"].as<const char*>()) {
+            net["rssi"] = max(net["rssi"].as<int32_t>(), WiFi.RSSI(i));
+            seen = true;
+            break;
+          }
+        }
+        if (!seen) {
+          JsonObject net = networks.createNestedObject();
+          net["ssid"] = name;
+          net["rssi"] = WiFi.RSSI(i);
+          net["secure"] = WiFi.encryptionType(i) != WIFI_AUTH_OPEN;
+        }
+      }
+      WiFi.scanDelete();
+      wifiScanCache = "";
+      serializeJson(scanDoc, wifiScanCache);
+      wifiScanCachedAt = millis();
+      return;
+    }
+
+    if (wifiScanRequested && (WiFi.getMode() & WIFI_STA)) {
+      wifiScanRequested = false;
+      wifiScanRunning = WiFi.scanNetworks(true, false, false, wifiScanChannelTimeMs) != WIFI_SCAN_FAILED;
+    }
+  }
+
+  void handleWifiScan() {
+    bool fresh = wifiScanCachedAt != 0 && millis() - wifiScanCachedAt < wifiScanTtl;
+    if (!fresh && !wifiScanRunning) {
+      wifiScanRequested = true;
+    }
+    bool scanning = wifiScanRunning || wifiScanRequested;
+    unsigned long age = wifiScanCachedAt == 0 ? 0 : (millis() - wifiScanCachedAt) / 1000;
+    server.sendHeader("Cache-Control", "no-store");
+    server.send(200, "application/json", "{\"scanning\":" + String(scanning ? "true" : "false") + ",\"age\":" + String(age) + ",\"networks\":" + wifiScanCache + "}");
+  }
+
+  void handleConfigSubmit() {
+    String ssid = server.arg("ssid");
+    String password = server.arg("password");
+    if (ssid.isEmpty() || password.isEmpty()) {
+      server.send(400, "application/json", "{\"status\":\"failed\",\"message\":\"Invalid input. Try again.\"}");
+      return;
+    }
+    Preferences preferences;
+    preferences.begin("wifi-creds", false);
+    preferences.putString("ssid", ssid);
+    preferences.putString("password", password);
+    preferences.end();
+    server.send(200, "application/json", "{\"status\":\"saved\",\"message\":\"WiFi credentials saved. Restarting...\"}");
+    scheduleRestart(1000);
+  }
+
+  void handleSetWiFi() {
+    const char* required[] = { "ssid", "password", "userid", "deviceid", "email", "productid" };
+    for (const char* name : required) {
+      if (!server.hasArg(name)) {
+        server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"Missing parameters.\"}");
+        return;
+      }
+      if (server.arg(name).isEmpty()) {
+        server.send(404, "application/json", "{\"status\":\"missing\",\"message\":\"WiFi not saved.\"}");
+        return;
+      }
+    }
+
+    Preferences preferences;
+    preferences.begin("wifi-creds", false);
+    for (const char* name : required) {
+      preferences.putString(name, server.arg(name));
+    }
+    preferences.putString("APICALL", "true");
+    preferences.end();
+    server.send(200, "application/json", "{\"status\":\"success\",\"message\":\"WiFi saved. Restarting...\"}");
+    scheduleRestart(500);
+  }
+
+  void clearConfig() {
+    Preferences preferences;
+    preferences.begin("wifi-creds", false);
+    preferences.putString("ssid", "");
+    preferences.putString("password", "");
+    preferences.putString("userid", "");
+    preferences.putString("deviceid", "");
+    preferences.end();
+    server.send(200, "application/json", "{\"status\":\"cleared\",\"message\":\"WiFi credentials cleared. Restarting...\"}");
+    scheduleRestart(1000);
+  }
+};
+
+class ProductRegistration : public Feature {
+public:
+  const char* registrationUrl = "https://nikolaindustry.wixstudio.com/hyperwisor-v2/_functions/product_registration";
+
+  template <class Device> void wifiConnected(Device& device) {
+    Credentials& creds = device.credentials;
+    if (creds.firstimecall != "true") {
+      return;
+    }
+
+    String url = String(registrationUrl) + "?ssid=" + creds.ssid + "&password=" + creds.password + "&deviceid=" + creds.deviceid + "&email=" + creds.email + "&userid=" + creds.userid + "&productid=" + creds.productid + "&macid=" + creds.macid;
+    HTTPClient http;
+    http.begin(url);
+    int httpGETCode = http.GET();
+    if (httpGETCode == 200) {
+      Preferences preferences;
+      preferences.begin("wifi-creds", false);
+      preferences.putString("APICALL", "false");
+      preferences.end();
+      creds.firstimecall = "false";
+      Serial.println("Product registered");
+    } else if (httpGETCode <= 0) {
+      Serial.printf("HTTP GET failed, error: %s\n", http.errorToString(httpGETCode).c_str());
+    }
+    http.end();
+  }
+};
+
+}  // namespace nikola
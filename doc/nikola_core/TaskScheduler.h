@@ -0,0 +1,95 @@
+#pragma once
+// Feature policy: non-blocking "blink" and "pulse" GPIO actions driven from loop()
+#include "NikolaCore.h"
+#include "../board_profiles.h"
+
+namespace nikola {
+
+template <int MaxTasks = 20>
+class BasicTaskScheduler : public Feature {
+public:
+  template <class Device> void loop(Device&) {
+    unsigned long now = millis();
+    for (int i = 0; i < MaxTasks; i++) {
+      Task& task = tasks[i];
+      if (!task.active) {
+        continue;
+      }
+      if (task.isPulse) {
+        if (now - task.lastChange >= task.onDuration) {
+          digitalWrite(task.pin, !task.state);
+          task.active = false;
+        }
+      } else if (task.state && now - task.lastChange >= task.onDuration) {
+        digitalWrite(task.pin, LOW);
+        task.state = false;
+        task.lastChange = now;
+      } else if (!task.state && now - task.lastChange >= task.offDuration) {
+        if (task.count < task.repeat) {
+          digitalWrite(task.pin, HIGH);
+          task.state = true;
+          task.lastChange = now;
+          task.count++;
+        } else {
+          task.active = false;
+        }
+      }
+    }
+  }
+
+  template <class Device> bool handle(Device&, CommandContext& ctx) {
+    if (strcmp(ctx.commands, "control_gpio") != 0) {
+      return false;
+    }
+    JsonVariant params = ctx.doc["payload"]["params"];
+    bool started;
+    if (strcmp(ctx.action, "blink") == 0) {
+      started = addTask(ctx.pin, false, params["on_duration"] | 500, params["off_duration"] | 500, params["repeat"] | 1, LOW);
+    } else if (strcmp(ctx.action, "pulse") == 0) {
+      started = addTask(ctx.pin, true, params["duration"] | 1000, 0, 1, params["state"] | HIGH);
+    } else {
+      return false;
+    }
+
+    JsonObject payload = ctx.reply();
+    payload["deviceid"] = ctx.doc["payload"]["deviceid"];
+    payload["pin"] = ctx.pin;
+    payload["controlid"] = ctx.controlid;
+    payload["status"] = started ? "started" : (isOutputPin(ctx.pin) ? "busy" : "invalid_pin");
+    return true;
+  }
+
+private:
+  struct Task {
+    int pin;
+    bool isPulse;
+    unsigned long onDuration;
+    unsigned long offDuration;
+    int repeat;
+    int count;
+    unsigned long lastChange;
+    int state;
+    bool active;
+  };
+
+  Task tasks[MaxTasks] = {};
+
+  bool addTask(int pin, bool isPulse, unsigned long onDuration, unsigned long offDuration, int repeat, int state) {
+    if (!isOutputPin(pin)) {
+      return false;
+    }
+    for (int i = 0; i < MaxTasks; i++) {
+      if (!tasks[i].active) {
+        tasks[i] = { pin, isPulse, onDuration, offDuration, repeat, 0, millis(), state, true };
+        pinMode(pin, OUTPUT);
+        digitalWrite(pin, state);
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+using TaskScheduler = BasicTaskScheduler<>;
+
+}  // namespace nikola
@@ -0,0 +1,85 @@
+#pragma once
+// Transport policy: WebSocket client connected to the cloud relay
+#include <WebSocketsClient.h>
+#include "NikolaCore.h"
+
+namespace nikola {
+
+class WebSocketClientTransport {
+public:
+  const char* host = "nikolaindustry-realtime.onrender.com";
+  uint16_t port = 443;
+  unsigned long pingInterval = 50000;  // 50 seconds
+  bool batched = true;                 // Let the relay combine bursts into array frames
+  ReconnectBackoff backoff;
+
+  template <class Device> void connect(Device& device) {
+    path = "/connect?id=" + device.credentials.deviceid;
+    if (batched) {
+      path += "&batch=1";
+    }
+    webSocket.onEvent([this, &device](WStype_t type, uint8_t* payload, size_t length) {
+      switch (type) {
+        case WStype_CONNECTED:
+          Serial.println("WebSocket connected!");
+          backoff.connected();
+          break;
+        case WStype_TEXT:
+          device.handleFrame(payload, length);
+          break;
+        case WStype_DISCONNECTED: {
+          unsigned long delayMs = backoff.disconnected();
+          if (delayMs != 0) {
+            Serial.printf("WebSocket disconnected! Reconnecting in %lu ms\n", delayMs);
+          }
+          break;
+        }
+        default:
+          break;
+      }
+    });
+    attempt();
+  }
+
+  void disconnect() {
+    webSocket.disconnect();
+  }
+
+  template <class Device> void loop(Device&) {
+    // Every attempt is started here (see ReconnectBackoff); in between the client stays idle
+    if (backoff.attemptDue()) {
+      attempt();
+    }
+    if (!backoff.active()) {
+      return;
+    }
+    webSocket.loop();
+    unsigned long now = millis();
+    if (now - lastPingTime > pingInterval) {
+      webSocket.sendPing();
+      lastPingTime = now;
+    }
+  }
+
+  bool send(JsonDocument& frame) {
+    String message;
+    serializeJson(frame, message);
+    if (!webSocket.sendTXT(message)) {
+      Serial.println("Failed to send WebSocket message.");
+      return false;
+    }
+    return true;
+  }
+
+private:
+  WebSocketsClient webSocket;
+  String path;
+  unsigned long lastPingTime = 0;
+
+  void attempt() {
+    webSocket.setReconnectInterval(backoff.startAttempt());
+    webSocket.beginSSL(host, port, path.c_str());
+  }
+};
+
+}  // namespace nikola
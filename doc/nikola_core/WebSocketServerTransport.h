@@ -0,0 +1,45 @@
+#pragma once
+// Transport policy: local WebSocket server, for setups without the cloud relay.
+// Frames from any client are handled; feedback is broadcast to all clients.
+#include <WebSocketsServer.h>
+#include "NikolaCore.h"
+
+namespace nikola {
+
+template <uint16_t Port = 8080>
+class BasicWebSocketServerTransport {
+public:
+  template <class Device> void connect(Device& device) {
+    if (started) {
+      return;
+    }
+    webSocket.begin();
+    webSocket.onEvent([&device](uint8_t num, WStype_t type, uint8_t* payload, size_t length) {
+      if (type == WStype_TEXT) {
+        device.handleFrame(payload, length);
+      }
+    });
+    started = true;
+    Serial.println("WebSocket server started on ws://" + WiFi.localIP().toString() + ":" + String(Port));
+  }
+
+  void disconnect() {}
+
+  template <class Device> void loop(Device&) {
+    webSocket.loop();
+  }
+
+  bool send(JsonDocument& frame) {
+    String message;
+    serializeJson(frame, message);
+    return webSocket.broadcastTXT(message);
+  }
+
+private:
+  WebSocketsServer webSocket{ Port };
+  bool started = false;
+};
+
+using WebSocketServerTransport = BasicWebSocketServerTransport<>;
+
+}  // namespace nikola
@@ -0,0 +1,90 @@
+// Generated by tools/build-portal.js from doc/portal/config_portal.html. Do not edit.
+#pragma once
+#include <pgmspace.h>
+
+const char PORTAL_HTML_ETAG[] = "\"8abc042041556b43\"";
+const size_t PORTAL_HTML_GZ_LEN = 1297;
+const uint8_t PORTAL_HTML_GZ[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x9d, 0x56, 0x51, 0x6f, 0xdb, 0x36,
+  0x10, 0x7e, 0xcf, 0xaf, 0xb8, 0xa9, 0xd8, 0x24, 0xa3, 0x91, 0x14, 0x07, 0x5d, 0x50, 0xd8, 0x92,
+  0x8b, 0x35, 0x49, 0xb1, 0x60, 0x59, 0x1b, 0xd4, 0xe9, 0x86, 0x3e, 0x0d, 0xb4, 0x78, 0xb2, 0xb8,
+  0x4a, 0xa4, 0x4a, 0x9e, 0xec, 0x78, 0x6e, 0xfe, 0xfb, 0x40, 0x51, 0xb2, 0xe5, 0x34, 0x59, 0x87,
+  0xbe, 0xd8, 0xd4, 0xf1, 0xee, 0xbb, 0xbb, 0xef, 0xee, 0x48, 0x26, 0x3f, 0x5c, 0xbc, 0x3b, 0xbf,
+  0xfd, 0x78, 0x73, 0x09, 0x05, 0x55, 0xe5, 0xec, 0x28, 0xe9, 0xff, 0x90, 0xf1, 0xd9, 0x11, 0x40,
+  0x52, 0x21, 0x31, 0xc8, 0x0a, 0xa6, 0x0d, 0x52, 0xea, 0x35, 0x94, 0x87, 0x2f, 0xbd, 0xfd, 0x86,
+  0x64, 0x15, 0xa6, 0xde, 0x4a, 0xe0, 0xba, 0x56, 0x9a, 0x3c, 0xc8, 0x94, 0x24, 0x94, 0x94, 0x7a,
+  0x6b, 0xc1, 0xa9, 0x48, 0x39, 0xae, 0x44, 0x86, 0x61, 0xfb, 0x71, 0x0c, 0x42, 0x0a, 0x12, 0xac,
+  0x0c, 0x4d, 0xc6, 0x4a, 0x4c, 0xc7, 0x0e, 0x86, 0x04, 0x95, 0x38, 0x7b, 0x7b, 0xf5, 0xdb, 0xbb,
+  0xeb, 0x5f, 0xae, 0xde, 0x5e, 0x7c, 0x98, 0xdf, 0xbe, 0xff, 0xf8, 0xd7, 0xb9, 0x92, 0xb9, 0x58,
+  0x26, 0xb1, 0xdb, 0xb4, 0x6a, 0x86, 0x36, 0x6e, 0x05, 0xb0, 0x50, 0x7c, 0x03, 0x5b, 0xc8, 0x95,
+  0xa4, 0x30, 0x67, 0x95, 0x28, 0x37, 0x13, 0x30, 0x4c, 0x9a, 0xd0, 0xa0, 0x16, 0xf9, 0x14, 0x2a,
+  0x76, 0xe7, 0x3c, 0x4e, 0xe0, 0xc5, 0xe9, 0x49, 0x7d, 0x67, 0x25, 0x7a, 0x29, 0xe4, 0x04, 0x4e,
+  0x5f, 0xd4, 0x77, 0xc0, 0x1a, 0x52, 0x53, 0xa8, 0x19, 0xe7, 0x42, 0x2e, 0x27, 0x70, 0x02, 0xe3,
+  0x33, 0xab, 0x73, 0xdf, 0x62, 0x97, 0x6c, 0x81, 0x25, 0x6c, 0x81, 0x0b, 0x53, 0x97, 0x6c, 0x33,
+  0x81, 0x45, 0xa9, 0xb2, 0x4f, 0x3d, 0x42, 0x48, 0xaa, 0x9e, 0xc0, 0xf8, 0x74, 0xaf, 0x2f, 0x64,
+  0xdd, 0x10, 0x6c, 0xa1, 0xf3, 0x37, 0x3e, 0x39, 0xf9, 0x71, 0x80, 0xfd, 0xd2, 0x2a, 0x2e, 0xd4,
+  0x5d, 0x68, 0xc4, 0x3f, 0xad, 0x60, 0xa1, 0x34, 0x47, 0x1d, 0x2e, 0xd4, 0x0e, 0x60, 0xd1, 0x10,
+  0x29, 0x09, 0xdb, 0x43, 0x0f, 0x6d, 0x44, 0x3b, 0x98, 0x71, 0x9b, 0xc4, 0x81, 0x0b, 0x67, 0xfc,
+  0xcc, 0x10, 0xa3, 0xc6, 0x3c, 0xb4, 0x6e, 0xe3, 0xab, 0x84, 0x0c, 0x0b, 0x14, 0xcb, 0x82, 0x26,
+  0x30, 0x8e, 0x4e, 0xb1, 0xea, 0x8d, 0x4c, 0xc5, 0x4a, 0x9b, 0x62, 0xa6, 0x4a, 0xa5, 0x27, 0xf0,
+  0xec, 0xec, 0xec, 0xcc, 0x6d, 0x25, 0x71, 0x47, 0x72, 0x12, 0xbb, 0xea, 0x27, 0x96, 0xe9, 0x96,
+  0xfd, 0x62, 0x3c, 0xfb, 0x53, 0xbc, 0x11, 0xe0, 0xea, 0xd2, 0x68, 0x46, 0x42, 0xc9, 0x24, 0x2e,
+  0xc6, 0xae, 0x36, 0x16, 0x71, 0x76, 0xd1, 0xd6, 0x1a, 0xae, 0x2e, 0x26, 0x90, 0x98, 0x9a, 0x49,
+  0x10, 0x3c, 0xf5, 0x5c, 0x03, 0x08, 0xee, 0xcd, 0xc2, 0x24, 0xb6, 0xd2, 0x19, 0xfc, 0x54, 0x09,
+  0xce, 0x15, 0x4d, 0xe1, 0x8d, 0xd0, 0xd5, 0x9a, 0x69, 0x84, 0x3f, 0x50, 0x1b, 0xa1, 0xe4, 0xd0,
+  0x2e, 0xef, 0xf6, 0xf6, 0x76, 0x49, 0xec, 0xdc, 0x58, 0x87, 0xb9, 0xd2, 0x55, 0xab, 0xb6, 0x16,
+  0xb9, 0x08, 0xed, 0x97, 0x07, 0x2c, 0xb3, 0x31, 0xa5, 0x5e, 0x6c, 0x9a, 0x45, 0x25, 0xc8, 0x83,
+  0x0a, 0xa9, 0x50, 0x3c, 0xf5, 0x6e, 0xde, 0xcd, 0x6f, 0x3d, 0xd7, 0x39, 0x49, 0x5b, 0xde, 0xd9,
+  0x7c, 0x7e, 0x75, 0x01, 0x89, 0x2b, 0x1d, 0x6d, 0x6a, 0x4c, 0x3d, 0xc2, 0x3b, 0xf2, 0xba, 0x66,
+  0x36, 0x46, 0x70, 0x0f, 0x4a, 0x61, 0x28, 0xf5, 0x24, 0xd2, 0x5a, 0xe9, 0x4f, 0xc6, 0x6b, 0xbb,
+  0x26, 0x53, 0x55, 0x5d, 0x22, 0x61, 0xea, 0xa9, 0x3c, 0xf7, 0x40, 0xe3, 0xe7, 0x46, 0x68, 0xe4,
+  0xb3, 0x24, 0x76, 0xb8, 0xce, 0x07, 0x67, 0xc4, 0xac, 0x75, 0x1b, 0xe0, 0x0e, 0x60, 0x96, 0xc4,
+  0xfd, 0x46, 0xa7, 0xe7, 0xea, 0x60, 0x95, 0x4c, 0xc6, 0x64, 0xe8, 0x4a, 0xe9, 0xcd, 0xe6, 0x19,
+  0x93, 0x52, 0xc8, 0x25, 0xe4, 0x4a, 0x43, 0x6f, 0x1e, 0x45, 0xd1, 0x20, 0xff, 0x5d, 0x22, 0x37,
+  0xcc, 0x98, 0xb5, 0xd2, 0xfc, 0x30, 0x99, 0xba, 0x93, 0xf6, 0x09, 0xed, 0xbf, 0x9f, 0x88, 0xb8,
+  0xeb, 0x41, 0x67, 0xdd, 0xd1, 0x37, 0x9b, 0xb3, 0x15, 0x26, 0xb1, 0xdb, 0x6a, 0x49, 0x8f, 0x2d,
+  0xcf, 0xed, 0x8a, 0x8b, 0x95, 0x8b, 0xbb, 0x0b, 0x39, 0x89, 0xb9, 0x58, 0xb9, 0x4e, 0xc8, 0xb4,
+  0xa8, 0xbb, 0x04, 0xe3, 0x18, 0xba, 0x96, 0xe0, 0x48, 0x4c, 0x94, 0x06, 0x6c, 0xad, 0x0d, 0xea,
+  0x15, 0x72, 0x30, 0x58, 0x33, 0xcd, 0x08, 0xcb, 0x0d, 0x18, 0x05, 0x54, 0x08, 0x03, 0x35, 0x5b,
+  0x22, 0x18, 0x62, 0x1b, 0x63, 0x7f, 0x49, 0x64, 0xc0, 0x24, 0x87, 0x8c, 0x65, 0x05, 0xb2, 0x45,
+  0x89, 0x2d, 0x66, 0x8e, 0x94, 0x15, 0x81, 0x1f, 0x0b, 0x99, 0x2b, 0x7f, 0x14, 0x51, 0x81, 0x32,
+  0xc8, 0x1b, 0xd9, 0x96, 0x1e, 0x02, 0x3d, 0x82, 0x2d, 0x68, 0xa4, 0x46, 0x4b, 0xd0, 0xd1, 0xdf,
+  0x46, 0xc9, 0x60, 0x34, 0x85, 0xfb, 0xaf, 0xf4, 0xac, 0xf5, 0x08, 0xb6, 0x2d, 0x22, 0x00, 0x57,
+  0x59, 0x53, 0xa1, 0xa4, 0x68, 0x89, 0x74, 0x59, 0xa2, 0x5d, 0xbe, 0xde, 0x5c, 0xf1, 0xc0, 0xef,
+  0x7b, 0xd7, 0x3a, 0xc2, 0x3b, 0x3a, 0x77, 0x47, 0x1b, 0xa4, 0x60, 0xed, 0xa3, 0x7e, 0x17, 0xbe,
+  0x7c, 0x01, 0x3f, 0xf4, 0xa7, 0xdf, 0x42, 0xeb, 0x3b, 0xfa, 0x71, 0xb4, 0x7e, 0xf7, 0x00, 0xed,
+  0x7e, 0x14, 0x65, 0xcc, 0x26, 0xbc, 0x0f, 0x7d, 0x04, 0xdb, 0xfb, 0xd1, 0xf4, 0xa8, 0x27, 0xf8,
+  0xb6, 0xb0, 0xec, 0xb6, 0x24, 0xdb, 0x26, 0x32, 0x20, 0x24, 0x50, 0x81, 0xb0, 0x60, 0xd9, 0xa7,
+  0xa5, 0x56, 0x8d, 0xe4, 0x53, 0xa8, 0x55, 0x59, 0x42, 0x23, 0x49, 0x94, 0x90, 0x6b, 0x34, 0x05,
+  0x68, 0x34, 0x4d, 0x49, 0xae, 0x1c, 0x42, 0x3a, 0x5e, 0x7b, 0x07, 0xa5, 0x62, 0xfc, 0x6d, 0xd7,
+  0x74, 0xc1, 0x9e, 0xa3, 0x9e, 0x77, 0xeb, 0xe4, 0xfb, 0x79, 0xb7, 0xd6, 0x7b, 0x4c, 0x80, 0x15,
+  0xd3, 0xed, 0x9c, 0x41, 0xfa, 0x34, 0x6d, 0xfd, 0x04, 0xf8, 0xa3, 0xe9, 0xce, 0xce, 0xda, 0x44,
+  0x42, 0x4a, 0xd4, 0xbf, 0xde, 0xfe, 0x7e, 0x0d, 0x29, 0xf8, 0xfe, 0x7e, 0xd3, 0x3a, 0x89, 0x76,
+  0x73, 0x93, 0x2b, 0x7d, 0xc9, 0x0e, 0x18, 0x94, 0x48, 0xc3, 0x18, 0x5c, 0x14, 0xaa, 0x6e, 0x37,
+  0x07, 0x71, 0x64, 0x1a, 0x19, 0x61, 0x17, 0x4a, 0xe0, 0x3b, 0x85, 0x61, 0x10, 0xd0, 0x19, 0x45,
+  0x2b, 0x56, 0x36, 0x08, 0xa9, 0x9d, 0xd5, 0xc8, 0x9e, 0x1d, 0x8f, 0xa8, 0xb8, 0x5b, 0x65, 0xaf,
+  0x02, 0xcf, 0xc1, 0x87, 0xc0, 0x87, 0xe7, 0xad, 0x44, 0x1b, 0x23, 0x5a, 0x09, 0x7f, 0x5d, 0x59,
+  0x59, 0xd0, 0xaa, 0x61, 0xd6, 0x68, 0x84, 0x57, 0xe0, 0x1f, 0x83, 0x5b, 0x73, 0x1f, 0x26, 0xe0,
+  0xfb, 0x23, 0xab, 0x3a, 0xf2, 0x87, 0x5e, 0x5a, 0x3e, 0x58, 0x5d, 0xa3, 0xe4, 0xe7, 0x85, 0x28,
+  0x79, 0xe0, 0xdc, 0x0e, 0x82, 0xbd, 0x1f, 0xac, 0x9f, 0xa4, 0x7a, 0x70, 0x0c, 0x7d, 0xd5, 0xa4,
+  0x2d, 0xab, 0xa6, 0x3b, 0x9a, 0x06, 0xae, 0x5f, 0x81, 0xff, 0xd4, 0x81, 0xe5, 0x0f, 0xd4, 0x26,
+  0x0f, 0xca, 0x52, 0xa2, 0x5c, 0x52, 0xd1, 0x26, 0xdd, 0xcb, 0x20, 0xb7, 0xed, 0x3a, 0xc8, 0x4b,
+  0xe4, 0xae, 0x63, 0x76, 0x6e, 0x0f, 0xcb, 0x66, 0x90, 0x6e, 0x45, 0x85, 0xaa, 0xa1, 0x60, 0xd8,
+  0xb4, 0xc7, 0x70, 0x7a, 0x72, 0x72, 0x32, 0x4c, 0xfd, 0xa8, 0xa7, 0xe0, 0xb1, 0x61, 0x3a, 0xfa,
+  0x26, 0xdc, 0xcf, 0x43, 0xb8, 0x9e, 0xc7, 0xee, 0xb1, 0x70, 0x30, 0x2c, 0xdd, 0x54, 0x3e, 0x49,
+  0xef, 0xee, 0xae, 0xf2, 0x47, 0x11, 0xe3, 0xfc, 0x72, 0x85, 0x92, 0xae, 0x85, 0x21, 0x94, 0xa8,
+  0x03, 0xdf, 0x1d, 0xbb, 0xfe, 0xf1, 0x7e, 0x14, 0x03, 0xdc, 0xc7, 0x87, 0x51, 0xad, 0xd1, 0x1a,
+  0x5c, 0x60, 0xce, 0x9a, 0x92, 0x82, 0x5d, 0x44, 0xb6, 0x7b, 0xbb, 0x57, 0xc0, 0x7f, 0x4c, 0x51,
+  0x5f, 0xd5, 0xde, 0xca, 0x7d, 0x3f, 0xa8, 0xb1, 0x3f, 0x67, 0x2b, 0x21, 0x97, 0xb6, 0x74, 0xd3,
+  0x87, 0x73, 0xdf, 0x47, 0xb7, 0x27, 0xcc, 0x5d, 0xaf, 0x13, 0xf0, 0xed, 0xfd, 0xea, 0x1f, 0xef,
+  0xe4, 0xf6, 0xe9, 0x80, 0xda, 0x4c, 0x60, 0x0b, 0x7e, 0x87, 0x1d, 0xde, 0x6e, 0x6a, 0xf4, 0x27,
+  0xe0, 0xb3, 0xba, 0x2e, 0x45, 0xd6, 0x3e, 0x1e, 0xe2, 0xbb, 0x70, 0xbd, 0x5e, 0xb7, 0x7c, 0x84,
+  0x8d, 0x2e, 0x51, 0x66, 0x8a, 0xdb, 0x16, 0xbf, 0xdf, 0x23, 0xd9, 0xd7, 0xc7, 0x04, 0x24, 0xae,
+  0xe1, 0xc3, 0xfb, 0xeb, 0x39, 0x32, 0x9d, 0x15, 0x37, 0x4c, 0xb3, 0xca, 0x04, 0x56, 0xf6, 0x46,
+  0xe9, 0xea, 0x82, 0x11, 0x0b, 0x30, 0x22, 0xa6, 0x97, 0x48, 0xa3, 0x51, 0x44, 0x6a, 0x4e, 0x5a,
+  0xc8, 0x65, 0x30, 0xda, 0x17, 0xfd, 0x3b, 0xcf, 0x2a, 0x8d, 0xe6, 0xa0, 0x3d, 0x1e, 0x23, 0x4c,
+  0xa3, 0x89, 0x2a, 0x34, 0x86, 0x2d, 0x71, 0xfa, 0x3f, 0xbb, 0xec, 0x51, 0xde, 0xbb, 0x6b, 0x52,
+  0x18, 0x8b, 0x48, 0x4c, 0xd3, 0x83, 0x2a, 0xec, 0xba, 0xae, 0xfd, 0x4f, 0xe2, 0xfe, 0x96, 0x4d,
+  0x62, 0xf7, 0x40, 0x4b, 0x62, 0xf7, 0x68, 0xff, 0x17, 0x75, 0x84, 0x47, 0xbd, 0xcc, 0x0b, 0x00,
+  0x00
+};
@@ -5,6 +5,8 @@
 #include <Preferences.h>
 #include <ArduinoJson.h>
 #include <WebSocketsClient.h>
+#include "nikola_core/NikolaCore.h"  // nikola::ReconnectBackoff
+#include "board_profiles.h"
 #include <Update.h>
 // #include <NTPClient.h>
 // #include <WiFiUdp.h>
@@ -49,6 +51,8 @@ const uint16_t websocket_port = 443;
 
 unsigned long lastPingTime = 0;
 const unsigned long pingInterval = 50000;  // 50 seconds
+
+nikola::ReconnectBackoff wsBackoff;  // Paces every connection attempt to the relay
 String setwebsoket = "false";
 // Create an NTPClient instance
 //NTPClient timeClient(ntpUDP, ntpServer, utcOffsetInSeconds, 3600000);  // Sync every 1 hour
@@ -88,7 +92,7 @@ const int maxRetries = 6;  // Switch to AP mode after 6 attempts
 void loop() {
   dnsServer.processNextRequest();
   server.handleClient();
-  webSocket.loop();
+  serviceWebSocket();
 
   if (!ssid.isEmpty() && !password.isEmpty() && !deviceid.isEmpty()) {
     if (WiFi.status() != WL_CONNECTED) {
@@ -187,7 +191,9 @@ int loadGPIOState(int pin) {
   return gpioPreferences.getInt(("pin_" + String(pin)).c_str(), LOW);
 }
 void restoreAllGPIOStates() {
-  for (int pin = 0; pin < 40; pin++) {  // Adjust for your pin range
+  // Only output-capable pins of the target board can hold a saved state
+  for (uint64_t pins = activeBoard.output; pins != 0; pins &= pins - 1) {
+    int pin = lowestPin(pins);
     String key = "pin_" + String(pin);
     if (gpioPreferences.isKey(key.c_str())) {
       int state = gpioPreferences.getInt(key.c_str(), LOW);
@@ -200,6 +206,8 @@ void restoreAllGPIOStates() {
 
 
 void initializeWebSocket() {
+  // Each attempt, even one skipped for lack of Wi-Fi, moves the next one further out
+  webSocket.setReconnectInterval(wsBackoff.startAttempt());
 
   if (!ssid.isEmpty() && !password.isEmpty() && !deviceid.isEmpty() && WiFi.status() == WL_CONNECTED) {
     String websocket_path = "/connect?id=" + deviceid;
@@ -226,6 +234,17 @@ void sendMessage(const char* message) {
 
 
 
+// Stands in for webSocket.loop(): attempts are started here, and between them the
+// client is not run, so the library cannot retry at its own fixed interval
+void serviceWebSocket() {
+  if (wsBackoff.attemptDue()) {
+    initializeWebSocket();
+  }
+  if (wsBackoff.active()) {
+    webSocket.loop();
+  }
+}
+
 void webSocketEvent(WStype_t type, uint8_t* payload, size_t length) {
   String feedback;
   StaticJsonDocument<256> feedbackDoc;
@@ -234,6 +253,7 @@ void webSocketEvent(WStype_t type, uint8_t* payload, size_t length) {
   switch (type) {
     case WStype_CONNECTED:
       Serial.println("WebSocket connected!");
+      wsBackoff.connected();
 
 
       break;
@@ -258,8 +278,8 @@ void webSocketEvent(WStype_t type, uint8_t* payload, size_t length) {
         const char* controlid = doc["payload"]["controlid"];
         const char* deviceid = doc["payload"]["deviceid"];
         const char* commands = doc["payload"]["commands"];
-        const char* action = doc["payload"]["actions"];
-        int pin = doc["payload"]["pin"];
+        const char* action = doc["payload"]["actions"].isNull() ? "notavailable" : doc["payload"]["actions"].as<const char*>();
+        int pin = doc["payload"]["pin"].isNull() ? -1 : doc["payload"]["pin"].as<int>();
         newtarget = targetId;
         Serial.println("Command Received");
         Serial.println(commands);
@@ -269,7 +289,19 @@ void webSocketEvent(WStype_t type, uint8_t* payload, size_t length) {
         if (strcmp(commands, "control_gpio") == 0) {
 
           Serial.println("Performing GPIO control");
-          if (strcmp(action, "toggle") == 0) {
+          // Reads accept any pin on the package, everything else needs an output-capable pin
+          bool readOnly = strcmp(action, "get_gpio_status") == 0;
+          if (strcmp(action, "ping") != 0 && !(readOnly ? isValidPin(pin) : isOutputPin(pin))) {
+            Serial.printf("Rejected GPIO command for pin %d on %s\n", pin, activeBoard.name);
+            feedbackDoc["targetId"] = targetId;
+            JsonObject feedbackPayload = feedbackDoc.createNestedObject("payload");
+            feedbackPayload["deviceid"] = deviceid;
+            feedbackPayload["pin"] = pin;
+            feedbackPayload["controlid"] = controlid;
+            feedbackPayload["status"] = "invalid_pin";
+            serializeJson(feedbackDoc, feedback);
+
+          } else if (strcmp(action, "toggle") == 0) {
             pinMode(pin, OUTPUT);
             int newState = !digitalRead(pin);
             digitalWrite(pin, newState);
@@ -386,7 +418,9 @@ void webSocketEvent(WStype_t type, uint8_t* payload, size_t length) {
           } else if (strcmp(sensor_type, "ADC") == 0) {
             int adc_channel = doc["payload"]["adc_channel"];
             float scale_factor = doc["payload"]["scale_factor"];
-            value = analogRead(adc_channel) * scale_factor;
+            if (isAdcPin(adc_channel)) {
+              value = analogRead(adc_channel) * scale_factor;
+            }
           }
 
         } else if (strcmp(commands, "ota_update") == 0) {
@@ -415,10 +449,13 @@ void webSocketEvent(WStype_t type, uint8_t* payload, size_t length) {
       break;
 
 
-    case WStype_DISCONNECTED:
-      Serial.println("WebSocket disconnected! Reconnecting...");
-      initializeWebSocket();  // Reinitialize WebSocket
+    case WStype_DISCONNECTED: {
+      unsigned long delayMs = wsBackoff.disconnected();
+      if (delayMs != 0) {
+        Serial.printf("WebSocket disconnected! Reconnecting in %lu ms\n", delayMs);
+      }
       break;
+    }
 
     default:
       break;
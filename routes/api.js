@@ -1,15 +1,46 @@
 const express = require('express');
-const WebSocket = require('ws');
-const { devices } = require('../utils/websocket');
-const { getAllDevices, sendToDevice, broadcastToAll } = require('../utils/mqtt');
+const path = require('path');
+const registry = require('../utils/registry');
+const { sendToDevice, sendToGroup, broadcastToAll } = require('../utils/mqtt');
+const { getQueueStats } = require('../utils/fanout');
+const logger = require('../utils/logger');
+const cluster = require('../utils/cluster');
+const heartbeat = require('../utils/heartbeat');
+const adminStream = require('../utils/adminStream');
+const topicStats = require('../utils/topicStats');
+const offlineQueue = require('../utils/offlineQueue');
+const shadow = require('../utils/shadow');
+const replies = require('../utils/replies');
+const groups = require('../utils/groups');
+const scheduler = require('../utils/scheduler');
+const capture = require('../utils/capture');
+const admission = require('../utils/admission');
+const metrics = require('../utils/metrics');
+
+const log = logger.create('api');
 
 const router = express.Router();
 
 // Middleware to parse JSON
 router.use(express.json());
 
+// Record requests while a traffic capture runs (utils/capture.js), except capture control itself
+router.use((req, res, next) => {
+    if (capture.isActive() && !req.path.startsWith('/capture')) {
+        capture.request(req.method, req.originalUrl, req.body);
+    }
+    next();
+});
+
+// Synchronous mode: ?wait=true (or "wait": true in the body) holds the request until
+// the device's feedback frame arrives, up to ?timeout= / "timeout" milliseconds
+function waitOptions(req) {
+    const wait = req.body.wait === true || req.query.wait === 'true';
+    return wait ? { timeout: replies.clampTimeout(req.body.timeout || req.query.timeout) } : null;
+}
+
 // Send message to specific device (WebSocket + MQTT)
-router.post('/send/:deviceId', (req, res) => {
+router.post('/send/:deviceId', async (req, res) => {
     const { deviceId } = req.params;
     const { payload } = req.body;
 
@@ -22,13 +53,52 @@ router.post('/send/:deviceId', (req, res) => {
     }
 
     try {
-        const result = sendToDevice(deviceId, payload, 'api');
+        const wait = waitOptions(req);
+        const pendingReply = wait ? replies.expect(deviceId, wait.timeout) : null;
+        const result = sendToDevice(deviceId, payload, 'api', pendingReply && pendingReply.id);
+        
+        if (pendingReply) {
+            if (!result.sent && !result.queued) {
+                replies.cancel(pendingReply.id);
+                return res.status(404).json({ error: `Device ${deviceId} not found or not connected` });
+            }
+            
+            // A queued command still gets its reply if the device reconnects in time
+            const reply = await pendingReply.reply;
+            if (!reply) {
+                return res.status(504).json({
+                    error: `Device ${deviceId} did not reply within ${wait.timeout}ms`,
+                    correlationId: pendingReply.id,
+                    queued: !!result.queued
+                });
+            }
+            log.debug(() => `↩️ API request ${pendingReply.id} answered by ${deviceId} in ${reply.latencyMs}ms`);
+            return res.json({
+                success: true,
+                message: `Device ${deviceId} replied`,
+                connections: result.connections,
+                protocols: result.protocols,
+                correlationId: pendingReply.id,
+                latencyMs: reply.latencyMs,
+                reply: reply.payload
+            });
+        }
+        
+        if (result.queued) {
+            // Held in the device's offline queue; no need to retry
+            return res.status(202).json({
+                success: true,
+                queued: true,
+                message: `Device ${deviceId} is offline, message queued`,
+                expiresAt: result.expiresAt
+            });
+        }
         
         if (!result.sent) {
             return res.status(404).json({ error: `Device ${deviceId} not found or not connected` });
         }
 
-        console.log(`🚀 API sent message to ${deviceId} via ${result.protocols.join(', ')}:`, JSON.stringify(payload));
+        log.debug(() => `🚀 API sent message to ${deviceId} via ${result.protocols.join(', ')}: ${JSON.stringify(payload)}`);
         res.json({ 
             success: true, 
             message: `Message sent to device ${deviceId}`,
@@ -66,7 +136,9 @@ router.post('/send-multiple', (req, res) => {
                 connections: result.connections,
                 protocols: result.protocols
             });
-            console.log(`🚀 API sent message to ${deviceId} via ${result.protocols.join(', ')}:`, JSON.stringify(payload));
+            log.debug(() => `🚀 API sent message to ${deviceId} via ${result.protocols.join(', ')}: ${JSON.stringify(payload)}`);
+        } else if (result.queued) {
+            results.push({ deviceId, status: 'queued', connections: 0, protocols: [], expiresAt: result.expiresAt });
         } else {
             results.push({ deviceId, status: 'not_found', connections: 0, protocols: [] });
         }
@@ -91,7 +163,7 @@ router.post('/broadcast', (req, res) => {
     try {
         const result = broadcastToAll(payload, 'api_broadcast');
 
-        console.log(`📢 API broadcast message to all devices:`, JSON.stringify(payload));
+        log.debug(() => `📢 API broadcast message to all devices: ${JSON.stringify(payload)}`);
         res.json({
             success: true,
             message: `Broadcast sent to all connected devices`,
@@ -104,15 +176,207 @@ router.post('/broadcast', (req, res) => {
     }
 });
 
+// Device groups: named member lists kept by the relay (utils/groups.js).
+// Names with slashes ("line-3/relays") are URL-encoded in paths: line-3%2Frelays
+function deviceIdList(value) {
+    return Array.isArray(value) ? value.filter(id => typeof id === 'string' && id) : null;
+}
+
+router.get('/groups', (req, res) => {
+    try {
+        const list = groups.list();
+        res.json({ success: true, totalGroups: list.length, groups: list });
+    } catch (error) {
+        console.error('Error listing groups:', error);
+        res.status(500).json({ error: 'Failed to list groups' });
+    }
+});
+
+router.get('/groups/:name', (req, res) => {
+    const { name } = req.params;
+
+    const group = groups.get(name);
+    if (!group) {
+        return res.status(404).json({ error: `Group ${name} not found` });
+    }
+    res.json({ success: true, ...group });
+});
+
+// Create or replace a group's members
+router.put('/groups/:name', (req, res) => {
+    const { name } = req.params;
+    const deviceIds = deviceIdList(req.body.deviceIds);
+
+    if (!groups.isValidName(name)) {
+        return res.status(400).json({ error: 'Invalid group name' });
+    }
+    if (!deviceIds) {
+        return res.status(400).json({ error: 'deviceIds array is required' });
+    }
+
+    try {
+        const result = groups.set(name, deviceIds);
+        res.json({ success: true, ...result, group: groups.get(name) });
+    } catch (error) {
+        console.error('Error setting group:', error);
+        res.status(500).json({ error: 'Failed to set group' });
+    }
+});
+
+// Incremental membership changes: { add: [...], remove: [...] }
+router.patch('/groups/:name', (req, res) => {
+    const { name } = req.params;
+    const add = deviceIdList(req.body.add || []);
+    const remove = deviceIdList(req.body.remove || []);
+
+    if (!groups.isValidName(name)) {
+        return res.status(400).json({ error: 'Invalid group name' });
+    }
+    if (!add || !remove || add.length + remove.length === 0) {
+        return res.status(400).json({ error: 'add or remove array is required' });
+    }
+
+    try {
+        const result = groups.update(name, { add, remove });
+        if (!result) {
+            return res.status(404).json({ error: `Group ${name} not found` });
+        }
+        res.json({ success: true, ...result, group: groups.get(name) });
+    } catch (error) {
+        console.error('Error updating group:', error);
+        res.status(500).json({ error: 'Failed to update group' });
+    }
+});
+
+router.delete('/groups/:name', (req, res) => {
+    const { name } = req.params;
+
+    if (!groups.remove(name)) {
+        return res.status(404).json({ error: `Group ${name} not found` });
+    }
+    res.json({ success: true, message: `Group ${name} deleted` });
+});
+
+// Send one message to every member of a group
+router.post('/groups/:name/send', (req, res) => {
+    const { name } = req.params;
+    const { payload } = req.body;
+
+    if (!payload) {
+        return res.status(400).json({ error: 'Payload is required' });
+    }
+
+    try {
+        const result = sendToGroup(name, payload, 'api_group');
+        if (!result) {
+            return res.status(404).json({ error: `Group ${name} not found` });
+        }
+
+        log.debug(() => `👥 API sent message to group ${name} (${result.connections} connections): ${JSON.stringify(payload)}`);
+        res.json({
+            success: true,
+            message: `Message sent to group ${name}`,
+            ...result
+        });
+    } catch (error) {
+        console.error('Error sending to group:', error);
+        res.status(500).json({ error: 'Failed to send message to group' });
+    }
+});
+
+// Scheduled and recurring commands run by the relay (utils/scheduler.js)
+// ?deviceId= or ?group= filters the list
+router.get('/schedules', (req, res) => {
+    try {
+        const list = scheduler.list({ deviceId: req.query.deviceId, group: req.query.group });
+        res.json({ success: true, totalSchedules: list.length, schedules: list });
+    } catch (error) {
+        console.error('Error listing schedules:', error);
+        res.status(500).json({ error: 'Failed to list schedules' });
+    }
+});
+
+router.get('/schedules/:id', (req, res) => {
+    const { id } = req.params;
+
+    const schedule = scheduler.get(id);
+    if (!schedule) {
+        return res.status(404).json({ error: `Schedule ${id} not found` });
+    }
+    res.json({ success: true, ...schedule });
+});
+
+router.post('/schedules', (req, res) => {
+    const invalid = scheduler.validate(req.body);
+    if (invalid) {
+        return res.status(400).json({ error: invalid });
+    }
+
+    try {
+        const schedule = scheduler.create(req.body);
+        if (!schedule) {
+            return res.status(400).json({ error: 'Schedule would never run' });
+        }
+        res.status(201).json({ success: true, ...schedule });
+    } catch (error) {
+        console.error('Error creating schedule:', error);
+        res.status(500).json({ error: 'Failed to create schedule' });
+    }
+});
+
+router.delete('/schedules/:id', (req, res) => {
+    const { id } = req.params;
+
+    if (!scheduler.remove(id)) {
+        return res.status(404).json({ error: `Schedule ${id} not found` });
+    }
+    res.json({ success: true, message: `Schedule ${id} deleted` });
+});
+
+// Traffic capture for replay benchmarks (tools/replay.js)
+router.get('/capture', (req, res) => {
+    res.json({ success: true, ...capture.status() });
+});
+
+// Optional "file": a plain file name, written under data/
+router.post('/capture/start', (req, res) => {
+    const { file } = req.body;
+    if (file !== undefined && (typeof file !== 'string' || !/^[\w.-]+$/.test(file) || file.startsWith('.'))) {
+        return res.status(400).json({ error: 'file must be a plain file name' });
+    }
+    if (capture.isActive()) {
+        return res.status(409).json({ error: 'A capture is already running', ...capture.status() });
+    }
+
+    try {
+        const status = capture.start(file ? path.join('data', file) : undefined);
+        res.status(201).json({ success: true, ...status });
+    } catch (error) {
+        console.error('Error starting capture:', error);
+        res.status(500).json({ error: 'Failed to start capture' });
+    }
+});
+
+router.post('/capture/stop', (req, res) => {
+    const status = capture.stop();
+    if (!status) {
+        return res.status(404).json({ error: 'No capture is running' });
+    }
+    res.json({ success: true, ...status });
+});
+
 // Send batch commands (like the existing WebSocket controlData feature)
-router.post('/batch', (req, res) => {
+// With wait, every command waits for its own reply; all share the one timeout
+router.post('/batch', async (req, res) => {
     const { commands } = req.body;
 
     if (!Array.isArray(commands) || commands.length === 0) {
         return res.status(400).json({ error: 'commands array is required' });
     }
 
+    const wait = waitOptions(req);
     const results = [];
+    const waiting = [];
     let totalSent = 0;
 
     commands.forEach(({ deviceId, payload }) => {
@@ -121,7 +385,15 @@ router.post('/batch', (req, res) => {
             return;
         }
 
-        const result = sendToDevice(deviceId, payload, 'api_batch');
+        const pendingReply = wait ? replies.expect(deviceId, wait.timeout) : null;
+        const result = sendToDevice(deviceId, payload, 'api_batch', pendingReply && pendingReply.id);
+        if (pendingReply) {
+            if (result.sent || result.queued) {
+                waiting.push({ index: results.length, pendingReply });
+            } else {
+                replies.cancel(pendingReply.id);
+            }
+        }
         if (result.sent) {
             totalSent += result.connections;
             results.push({ 
@@ -130,12 +402,34 @@ router.post('/batch', (req, res) => {
                 connections: result.connections,
                 protocols: result.protocols
             });
-            console.log(`🚀 API batch sent to ${deviceId} via ${result.protocols.join(', ')}:`, JSON.stringify(payload));
+            log.debug(() => `🚀 API batch sent to ${deviceId} via ${result.protocols.join(', ')}: ${JSON.stringify(payload)}`);
+        } else if (result.queued) {
+            results.push({ deviceId, status: 'queued', connections: 0, protocols: [], expiresAt: result.expiresAt });
         } else {
             results.push({ deviceId, status: 'not_found', connections: 0, protocols: [] });
         }
     });
 
+    if (waiting.length > 0) {
+        try {
+            const replied = await Promise.all(waiting.map(({ pendingReply }) => pendingReply.reply));
+            replied.forEach((reply, i) => {
+                const entry = results[waiting[i].index];
+                entry.correlationId = waiting[i].pendingReply.id;
+                if (reply) {
+                    entry.status = 'replied';
+                    entry.latencyMs = reply.latencyMs;
+                    entry.reply = reply.payload;
+                } else {
+                    entry.status = 'timeout';
+                }
+            });
+        } catch (error) {
+            console.error('Error waiting for batch replies:', error);
+            return res.status(500).json({ error: 'Failed to collect replies' });
+        }
+    }
+
     res.json({
         success: true,
         message: `Batch commands processed for ${commands.length} commands`,
@@ -147,16 +441,16 @@ router.post('/batch', (req, res) => {
 // Get list of connected devices (WebSocket + MQTT)
 router.get('/devices', (req, res) => {
     try {
-        const allDevices = getAllDevices();
         const connectedDevices = [];
         
-        allDevices.forEach((deviceInfo, deviceId) => {
+        registry.forEachDevice((entry) => {
+            const deviceInfo = registry.describe(entry);
             connectedDevices.push({
-                deviceId,
+                deviceId: deviceInfo.deviceId,
                 type: deviceInfo.type, // 'websocket', 'mqtt', or 'hybrid'
                 connections: deviceInfo.activeConnections || deviceInfo.connections,
                 status: (deviceInfo.activeConnections || deviceInfo.connections) > 0 ? 'online' : 'offline',
-                protocols: deviceInfo.type === 'hybrid' ? ['websocket', 'mqtt'] : [deviceInfo.type]
+                protocols: deviceInfo.protocols
             });
         });
 
@@ -176,13 +470,24 @@ router.get('/devices/:deviceId', (req, res) => {
     const { deviceId } = req.params;
 
     try {
-        const allDevices = getAllDevices();
+        const entry = registry.get(deviceId);
+        
+        // Commands held for the device while it was offline, and their delivery
+        const offline = offlineQueue.status(deviceId);
         
-        if (!allDevices.has(deviceId)) {
+        if (!entry) {
+            // Connected to another cluster node
+            const node = cluster.ownerOf(deviceId);
+            if (node) {
+                return res.json({ success: true, deviceId, status: 'online', node, offlineQueue: offline });
+            }
+            if (offline) {
+                return res.json({ success: true, deviceId, status: 'offline', connections: 0, offlineQueue: offline });
+            }
             return res.status(404).json({ error: `Device ${deviceId} not found` });
         }
 
-        const deviceInfo = allDevices.get(deviceId);
+        const deviceInfo = registry.describe(entry);
         
         res.json({
             success: true,
@@ -190,7 +495,9 @@ router.get('/devices/:deviceId', (req, res) => {
             type: deviceInfo.type,
             connections: deviceInfo.activeConnections || deviceInfo.connections,
             status: (deviceInfo.activeConnections || deviceInfo.connections) > 0 ? 'online' : 'offline',
-            protocols: deviceInfo.type === 'hybrid' ? ['websocket', 'mqtt'] : [deviceInfo.type]
+            protocols: deviceInfo.protocols,
+            queuedFrames: deviceInfo.queuedFrames,
+            offlineQueue: offline
         });
     } catch (error) {
         console.error('Error getting device status:', error);
@@ -198,6 +505,36 @@ router.get('/devices/:deviceId', (req, res) => {
     }
 });
 
+// Device shadows: last known state without a device round trip
+// ?ids=a,b,c selects devices; without it, every connected device
+router.get('/shadow', (req, res) => {
+    try {
+        const deviceIds = req.query.ids ?
+            String(req.query.ids).split(',').map(id => id.trim()).filter(Boolean) :
+            registry.deviceIds();
+        const devices = shadow.getMany(deviceIds);
+        res.json({ success: true, totalDevices: devices.length, devices });
+    } catch (error) {
+        console.error('Error getting device shadows:', error);
+        res.status(500).json({ error: 'Failed to get device shadows' });
+    }
+});
+
+router.get('/shadow/:deviceId', (req, res) => {
+    const { deviceId } = req.params;
+
+    try {
+        const result = shadow.get(deviceId);
+        if (!result) {
+            return res.status(404).json({ error: `No shadow for device ${deviceId}` });
+        }
+        res.json({ success: true, ...result });
+    } catch (error) {
+        console.error('Error getting device shadow:', error);
+        res.status(500).json({ error: 'Failed to get device shadow' });
+    }
+});
+
 // Health check endpoint
 router.get('/health', (req, res) => {
     res.json({ status: 'up', timestamp: new Date().toISOString() });
@@ -214,6 +551,10 @@ router.get('/test-info', (req, res) => {
             send: '/api/send/:deviceId',
             broadcast: '/api/broadcast',
             batch: '/api/batch',
+            shadow: '/api/shadow/:deviceId',
+            groups: '/api/groups/:name',
+            schedules: '/api/schedules',
+            capture: '/api/capture',
             mqtt: {
                 stats: '/api/mqtt/stats',
                 publish: '/api/mqtt/publish'
@@ -229,7 +570,7 @@ router.get('/test-info', (req, res) => {
 // Get MQTT broker stats
 router.get('/mqtt/stats', (req, res) => {
     try {
-        const { aedes, mqttDevices } = require('../utils/mqtt');
+        const { aedes, getBridgeStats } = require('../utils/mqtt');
         
         // Initialize stats with default values
         let stats = {
@@ -287,7 +628,12 @@ router.get('/mqtt/stats', (req, res) => {
         }
         
         // Get registered device count
-        stats.registeredDevices = mqttDevices ? mqttDevices.size : 0;
+        stats.registeredDevices = registry.mqttDeviceCount();
+        
+        // Topic totals are maintained incrementally; cost depends on prefixes, not topics
+        stats.topics = topicStats.topicCount();
+        stats.topicPrefixes = topicStats.prefixStats();
+        stats.bridge = getBridgeStats();
         
         res.json({
             success: true,
@@ -304,10 +650,12 @@ router.get('/mqtt/stats', (req, res) => {
 router.get('/mqtt/topics', (req, res) => {
     try {
         const { getMqttTopics } = require('../utils/mqtt');
-        const topics = getMqttTopics();
+        const limit = Math.min(parseInt(req.query.limit) || 100, 1000);
+        const topics = getMqttTopics(limit);
         
         res.json({
             success: true,
+            total: topicStats.topicCount(),
             topics: topics
         });
     } catch (error) {
@@ -337,7 +685,7 @@ router.post('/mqtt/publish', (req, res) => {
         // Track the published topic
         trackPublishedTopic(topic, payload);
         
-        console.log(`📡 Published to MQTT topic ${topic}:`, payload);
+        log.debug(() => [`📡 Published to MQTT topic ${topic}:`, payload]);
         res.json({
             success: true,
             message: `Published to topic ${topic}`
@@ -385,7 +733,7 @@ router.post('/mqtt/publish-device', (req, res) => {
         // Track the published topic
         trackPublishedTopic(targetTopic, message);
         
-        console.log(`📡 HTTP->MQTT Published to device ${deviceId} on topic ${targetTopic}:`, message);
+        log.debug(() => [`📡 HTTP->MQTT Published to device ${deviceId} on topic ${targetTopic}:`, message]);
         res.json({
             success: true,
             message: `Published to device ${deviceId}`,
@@ -435,7 +783,7 @@ router.post('/mqtt/topic/*', (req, res) => {
         // Track the published topic
         trackPublishedTopic(topicName, message);
         
-        console.log(`📡 HTTP->MQTT Published to topic ${topicName}:`, message);
+        log.debug(() => [`📡 HTTP->MQTT Published to topic ${topicName}:`, message]);
         res.json({
             success: true,
             message: `Published to topic ${topicName}`,
@@ -448,26 +796,44 @@ router.post('/mqtt/topic/*', (req, res) => {
 });
 
 // Get system statistics
+// Memory and CPU time of this process (CPU in milliseconds, for rate sampling)
+function processStats() {
+    const memory = process.memoryUsage();
+    const cpu = process.cpuUsage();
+    return {
+        pid: process.pid,
+        rss: memory.rss,
+        heapUsed: memory.heapUsed,
+        cpuUser: cpu.user / 1000,
+        cpuSystem: cpu.system / 1000,
+        uptime: process.uptime()
+    };
+}
+
 router.get('/stats', (req, res) => {
     try {
-        const allDevices = getAllDevices();
-        
-        // Protocol breakdown
-        const protocolStats = {
-            websocket: 0,
-            mqtt: 0,
-            hybrid: 0
-        };
-        
-        allDevices.forEach((deviceInfo) => {
-            protocolStats[deviceInfo.type]++;
-        });
+        // Maintained incrementally by the registry, no per-request scan
+        const registryStats = registry.stats();
         
         res.json({
             success: true,
             stats: {
-                totalDevices: allDevices.size,
-                protocolBreakdown: protocolStats,
+                totalDevices: registryStats.totalDevices,
+                protocolBreakdown: registryStats.protocolBreakdown,
+                websocketConnections: registryStats.websocketConnections,
+                sendQueues: getQueueStats(),
+                logging: logger.getStats(),
+                cluster: cluster.stats(),
+                heartbeat: heartbeat.stats(),
+                adminStream: adminStream.stats(),
+                offlineQueue: offlineQueue.stats(),
+                shadows: shadow.stats(),
+                replies: replies.stats(),
+                groups: groups.stats(),
+                scheduler: scheduler.stats(),
+                capture: capture.status(),
+                admission: admission.stats(),
+                process: processStats(),
                 timestamp: new Date().toISOString()
             }
         });
@@ -477,4 +843,15 @@ router.get('/stats', (req, res) => {
     }
 });
 
+// Prometheus text exposition of the relay's metrics (utils/metrics.js)
+router.get('/metrics', (req, res) => {
+    try {
+        res.set('Content-Type', 'text/plain; version=0.0.4; charset=utf-8');
+        res.send(metrics.render());
+    } catch (error) {
+        console.error('Error rendering metrics:', error);
+        res.status(500).json({ error: 'Failed to render metrics' });
+    }
+});
+
 module.exports = router;
@@ -1,45 +1,82 @@
 const express = require('express');
 const http = require('http');
 const path = require('path');
+const cluster = require('cluster');
 const WebSocket = require('ws');
 const { handleConnection, setMqttForwarders, handleAdminConnection, startHeartbeat } = require('./utils/websocket');
-const { setupMQTT, forwardWebSocketToMqtt, broadcastToAll } = require('./utils/mqtt');
+const { setupMQTT, forwardWebSocketToMqtt, broadcastToAll, sendFrameToGroup } = require('./utils/mqtt');
+const clusterNode = require('./utils/cluster');
+const admission = require('./utils/admission');
+const capture = require('./utils/capture');
 const apiRoutes = require('./routes/api');
 
-const app = express();
-const server = http.createServer(app);
-const wss = new WebSocket.Server({ server });
+// Cluster mode:
+//   CLUSTER_WORKERS=N      fork N workers sharing the ports; the primary hosts the device directory
+//   CLUSTER_HUB_PORT=port  also let nodes on other hosts join this primary's directory
+//                          (needs CLUSTER_SECRET; binds CLUSTER_HUB_HOST, default 127.0.0.1)
+//   CLUSTER_HUB=host:port  run as a node of a hub on another host
+const CLUSTER_WORKERS = parseInt(process.env.CLUSTER_WORKERS) || 0;
 
-// Middleware for parsing JSON
-app.use(express.json());
-app.use(express.urlencoded({ extended: true }));
+function startServer() {
+    const app = express();
+    const server = http.createServer(app);
+    // Device connections are admitted at a paced rate, so a reconnect storm is smoothed out
+    const wss = new WebSocket.Server({ server, verifyClient: admission.verifyClient });
 
-app.use(express.static(path.join(__dirname, 'public')));
-app.use('/api', apiRoutes);
+    // Middleware for parsing JSON
+    app.use(express.json());
+    app.use(express.urlencoded({ extended: true }));
 
-wss.on('connection', (ws, req) => {
-    // Check if this is an admin dashboard connection
-    if (req.url.startsWith('/admin')) {
-        handleAdminConnection(ws);
-    } else {
-        handleConnection(ws, req);
-    }
-});
+    app.use(express.static(path.join(__dirname, 'public')));
+    app.use('/api', apiRoutes);
+
+    wss.on('connection', (ws, req) => {
+        // Check if this is an admin dashboard connection
+        if (req.url.startsWith('/admin')) {
+            handleAdminConnection(ws);
+        } else {
+            handleConnection(ws, req);
+        }
+    });
+
+    // Start WebSocket heartbeat mechanism to detect zombie connections
+    // This pings all clients every 30 seconds and terminates unresponsive ones
+    startHeartbeat(wss);
+
+    // Setup MQTT
+    setupMQTT(server);
 
-// Start WebSocket heartbeat mechanism to detect zombie connections
-// This pings all clients every 30 seconds and terminates unresponsive ones
-startHeartbeat(wss);
+    // Connect WebSocket and MQTT forwarding
+    setMqttForwarders(forwardWebSocketToMqtt, broadcastToAll, sendFrameToGroup);
 
-// Setup MQTT
-setupMQTT(server);
+    // Record traffic from the start; tools that only decode captures don't start one
+    if (process.env.CAPTURE_FILE) {
+        capture.start(process.env.CAPTURE_FILE);
+    }
+
+    // Join the cluster directory when running as a worker or remote node
+    if (cluster.isWorker) {
+        clusterNode.startWorker();
+    } else if (process.env.CLUSTER_HUB) {
+        clusterNode.connectToHub(process.env.CLUSTER_HUB);
+    }
 
-// Connect WebSocket and MQTT forwarding
-setMqttForwarders(forwardWebSocketToMqtt, broadcastToAll);
+    const port = process.env.PORT || 3000;
+    server.listen(port, () => {
+        console.log(`🚀 Server running on port ${port}`);
+        console.log(`🔌 WebSocket available at ws://localhost:${port}`);
+        console.log(`🌐 HTTP API available at http://localhost:${port}/api`);
+        console.log(`🦟 MQTT available at mqtt://localhost:${process.env.MQTT_PORT || 1883}`);
+    });
+}
 
-const port = process.env.PORT || 3000;
-server.listen(port, () => {
-    console.log(`🚀 Server running on port ${port}`);
-    console.log(`🔌 WebSocket available at ws://localhost:${port}`);
-    console.log(`🌐 HTTP API available at http://localhost:${port}/api`);
-    console.log(`🦟 MQTT available at mqtt://localhost:${process.env.MQTT_PORT || 1883}`);
-});
+if (CLUSTER_WORKERS > 0 && cluster.isPrimary) {
+    // The primary only runs the directory and bus; workers serve all connections
+    const clusterHub = require('./utils/clusterHub');
+    clusterHub.startPrimary(CLUSTER_WORKERS);
+    if (process.env.CLUSTER_HUB_PORT) {
+        clusterHub.listenForNodes(parseInt(process.env.CLUSTER_HUB_PORT));
+    }
+} else {
+    startServer();
+}
@@ -0,0 +1,40 @@
+// Compresses the firmware config portal and embeds it as a C header.
+// Usage: node tools/build-portal.js
+const fs = require('fs');
+const path = require('path');
+const zlib = require('zlib');
+const crypto = require('crypto');
+
+const SOURCE = path.join(__dirname, '..', 'doc', 'portal', 'config_portal.html');
+const OUTPUT = path.join(__dirname, '..', 'doc', 'portal_assets.h');
+
+function toCArray(buffer) {
+    const lines = [];
+    for (let i = 0; i < buffer.length; i += 16) {
+        const bytes = Array.from(buffer.subarray(i, i + 16), (b) => '0x' + b.toString(16).padStart(2, '0'));
+        lines.push('  ' + bytes.join(', '));
+    }
+    return lines.join(',\n');
+}
+
+function buildPortal() {
+    const html = fs.readFileSync(SOURCE);
+    // gzip output from zlib has a zeroed mtime, so the same HTML always yields the same bytes and ETag
+    const gz = zlib.gzipSync(html, { level: zlib.constants.Z_BEST_COMPRESSION });
+    const etag = crypto.createHash('sha1').update(gz).digest('hex').slice(0, 16);
+
+    const header = `// Generated by tools/build-portal.js from doc/portal/config_portal.html. Do not edit.
+#pragma once
+#include <pgmspace.h>
+
+const char PORTAL_HTML_ETAG[] = "\\"${etag}\\"";
+const size_t PORTAL_HTML_GZ_LEN = ${gz.length};
+const uint8_t PORTAL_HTML_GZ[] PROGMEM = {
+${toCArray(gz)}
+};
+`;
+    fs.writeFileSync(OUTPUT, header);
+    console.log(`✅ Portal built: ${html.length} bytes -> ${gz.length} bytes gzip (ETag ${etag})`);
+}
+
+buildPortal();
@@ -0,0 +1,82 @@
+// Helpers shared by the benchmark tools (loadtest.js, replay.js)
+const http = require('http');
+const https = require('https');
+
+const MAX_SAMPLES = 500000; // reservoir size for percentiles
+
+// --kebab-case <value> pairs onto a copy of defaults; values of numeric defaults
+// are converted to numbers. --api defaults to the HTTP form of --url.
+function parseArgs(argv, defaults) {
+    const options = { ...defaults };
+    for (let i = 2; i < argv.length; i += 2) {
+        const key = argv[i].replace(/^--/, '').replace(/-([a-z])/g, (m, c) => c.toUpperCase());
+        if (!(key in options)) {
+            console.error(`❌ Unknown option ${argv[i]}`);
+            process.exit(1);
+        }
+        const value = argv[i + 1];
+        options[key] = typeof options[key] === 'number' ? Number(value) : value;
+    }
+    if ('api' in options && !options.api) {
+        options.api = options.url.replace(/^ws/, 'http').replace(/\/$/, '');
+    }
+    return options;
+}
+
+// Millisecond samples (reservoir sampling keeps memory bounded)
+function createSamples() {
+    const samples = new Float64Array(MAX_SAMPLES);
+    let count = 0;
+    let seen = 0;
+    return {
+        record(ms) {
+            seen++;
+            if (count < MAX_SAMPLES) {
+                samples[count++] = ms;
+            } else {
+                const slot = Math.floor(Math.random() * seen);
+                if (slot < MAX_SAMPLES) samples[slot] = ms;
+            }
+        },
+        percentiles() {
+            const sorted = samples.slice(0, count).sort();
+            const at = (p) => sorted.length ? sorted[Math.min(sorted.length - 1, Math.floor(p * sorted.length))] : null;
+            return {
+                p50: at(0.5),
+                p90: at(0.9),
+                p99: at(0.99),
+                p999: at(0.999),
+                max: sorted.length ? sorted[sorted.length - 1] : null
+            };
+        }
+    };
+}
+
+function now() {
+    return Number(process.hrtime.bigint()) / 1e6;
+}
+
+// GET a JSON document; resolves null on any network or parse error
+function fetchJson(url) {
+    return new Promise((resolve) => {
+        const client = url.startsWith('https') ? https : http;
+        client.get(url, (res) => {
+            let body = '';
+            res.on('data', chunk => body += chunk);
+            res.on('end', () => {
+                try {
+                    resolve(JSON.parse(body));
+                } catch (e) {
+                    resolve(null);
+                }
+            });
+        }).on('error', () => resolve(null));
+    });
+}
+
+module.exports = {
+    parseArgs,
+    createSamples,
+    now,
+    fetchJson
+};
@@ -0,0 +1,284 @@
+// Fleet load generator and end-to-end latency benchmark for the relay.
+// Usage: node tools/loadtest.js [options]
+//
+//   --url <ws url>           WebSocket endpoint (default ws://localhost:3000)
+//   --mqtt <mqtt url>        MQTT endpoint (default mqtt://localhost:1883)
+//   --api <http url>         API base for server stats (default derived from --url)
+//   --ws-devices <n>         simulated WebSocket devices (default 1000)
+//   --mqtt-devices <n>       simulated MQTT devices (default 200)
+//   --rate <n>               commands per second across the fleet (default 1000)
+//   --duration <s>           measurement time after ramp-up (default 30)
+//   --ramp <n>               new connections per second (default 500)
+//   --mix <spec>             command mix weights
+//                            (default direct=50,targetIds=20,controlData=15,mqttSend=14,broadcast=1)
+//   --fanout <n>             targets per targetIds/controlData command (default 5)
+//   --out <file>             write machine-readable results as JSON
+//
+// Each command carries a send timestamp; every delivery seen by a simulated device
+// is one latency sample. Large fleets need a raised file descriptor limit (ulimit -n), and a
+// --ramp above the server's ADMISSION_RATE needs that limit raised (or 0) on the server.
+const fs = require('fs');
+const WebSocket = require('ws');
+const mqtt = require('mqtt');
+const { parseArgs, createSamples, now, fetchJson } = require('./lib/bench');
+
+const DEFAULT_MIX = 'direct=50,targetIds=20,controlData=15,mqttSend=14,broadcast=1';
+const STATS_INTERVAL = 1000;
+const TICK = 10;
+
+const DEFAULTS = {
+    url: 'ws://localhost:3000',
+    mqtt: 'mqtt://localhost:1883',
+    api: null,
+    wsDevices: 1000,
+    mqttDevices: 200,
+    rate: 1000,
+    duration: 30,
+    ramp: 500,
+    mix: DEFAULT_MIX,
+    fanout: 5,
+    out: null
+};
+
+function parseMix(spec) {
+    const mix = [];
+    let total = 0;
+    spec.split(',').forEach((item) => {
+        const [kind, weight] = item.split('=');
+        const w = Number(weight);
+        if (w > 0) {
+            total += w;
+            mix.push({ kind: kind.trim(), upTo: total });
+        }
+    });
+    return { mix, total };
+}
+
+// Latency samples in milliseconds
+const latency = createSamples();
+
+const counters = {
+    sent: { direct: 0, targetIds: 0, controlData: 0, mqttSend: 0, broadcast: 0 },
+    delivered: 0,
+    connectErrors: 0,
+    disconnects: 0
+};
+
+let measuring = false;
+
+function onDelivery(raw) {
+    if (!measuring) return;
+    let message;
+    try {
+        message = JSON.parse(raw);
+    } catch (e) {
+        return;
+    }
+    const stamp = message.payload && message.payload.lt;
+    if (typeof stamp !== 'number') return;
+    counters.delivered++;
+    latency.record(now() - stamp);
+}
+
+function connectWsDevice(options, id) {
+    return new Promise((resolve) => {
+        const ws = new WebSocket(`${options.url}/?id=${id}`);
+        ws.on('open', () => resolve(ws));
+        ws.on('message', data => onDelivery(data.toString()));
+        ws.on('error', () => {
+            counters.connectErrors++;
+            resolve(null);
+        });
+        ws.on('close', () => {
+            if (measuring) counters.disconnects++;
+        });
+    });
+}
+
+function connectMqttDevice(options, id) {
+    return new Promise((resolve) => {
+        const client = mqtt.connect(options.mqtt, { clientId: id, reconnectPeriod: 0 });
+        client.on('connect', () => {
+            client.subscribe(`device/${id}/commands`, { qos: 0 }, () => resolve(client));
+        });
+        client.on('message', (topic, payload) => onDelivery(payload.toString()));
+        client.on('error', () => {
+            counters.connectErrors++;
+            resolve(null);
+        });
+        client.on('close', () => {
+            if (measuring) counters.disconnects++;
+        });
+    });
+}
+
+// Open connections at options.ramp per second
+async function connectFleet(options) {
+    const fleet = { ws: [], mqtt: [], ids: [] };
+    const plan = [];
+    for (let i = 0; i < options.wsDevices; i++) plan.push(['ws', `lt-ws-${i}`]);
+    for (let i = 0; i < options.mqttDevices; i++) plan.push(['mqtt', `lt-mqtt-${i}`]);
+
+    const batch = Math.max(1, Math.floor(options.ramp / 10));
+    for (let i = 0; i < plan.length; i += batch) {
+        const started = Date.now();
+        const connected = await Promise.all(plan.slice(i, i + batch).map(([kind, id]) =>
+            (kind === 'ws' ? connectWsDevice(options, id) : connectMqttDevice(options, id))
+                .then(conn => conn && { kind, id, conn })));
+        connected.filter(Boolean).forEach((device) => {
+            fleet[device.kind].push(device);
+            fleet.ids.push(device.id);
+        });
+        process.stdout.write(`\r🔌 Connected ${fleet.ws.length} WebSocket + ${fleet.mqtt.length} MQTT devices`);
+        const wait = 100 - (Date.now() - started);
+        if (wait > 0) await new Promise(r => setTimeout(r, wait));
+    }
+    process.stdout.write('\n');
+    return fleet;
+}
+
+function pick(list) {
+    return list[Math.floor(Math.random() * list.length)];
+}
+
+function sendCommand(kind, fleet, options) {
+    const payload = { lt: now(), action: 'toggle', controlid: 'lt' };
+
+    if (kind === 'mqttSend') {
+        if (fleet.mqtt.length === 0) return false;
+        const from = pick(fleet.mqtt);
+        from.conn.publish(`device/${from.id}/send/${pick(fleet.ids)}`, JSON.stringify(payload), { qos: 0 });
+        return true;
+    }
+
+    if (fleet.ws.length === 0) return false;
+    const from = pick(fleet.ws);
+    if (from.conn.readyState !== WebSocket.OPEN) return false;
+
+    let message;
+    if (kind === 'direct') {
+        message = { targetId: pick(fleet.ids), payload };
+    } else if (kind === 'targetIds') {
+        message = { targetIds: Array.from({ length: options.fanout }, () => pick(fleet.ids)), payload };
+    } else if (kind === 'controlData') {
+        message = { controlData: Array.from({ length: options.fanout }, () => ({ targetId: pick(fleet.ids), payload })) };
+    } else if (kind === 'broadcast') {
+        message = { type: 'broadcast', payload };
+    } else {
+        return false;
+    }
+    from.conn.send(JSON.stringify(message));
+    return true;
+}
+
+// Server RSS and CPU from /api/stats; CPU% is derived from successive samples
+function startServerSampling(options) {
+    const samples = [];
+    let previous = null;
+    const timer = setInterval(async () => {
+        const data = await fetchJson(`${options.api}/api/stats`);
+        const proc = data && data.stats && data.stats.process;
+        if (!proc) return;
+        if (previous) {
+            const cpuMs = (proc.cpuUser + proc.cpuSystem) - (previous.cpuUser + previous.cpuSystem);
+            const wallMs = proc.uptime * 1000 - previous.uptime * 1000;
+            samples.push({ rss: proc.rss, cpu: wallMs > 0 ? (cpuMs / wallMs) * 100 : 0 });
+        }
+        previous = proc;
+    }, STATS_INTERVAL);
+    return {
+        stop: () => clearInterval(timer),
+        summary: () => {
+            if (samples.length === 0) return null;
+            const rss = samples.map(s => s.rss);
+            const cpu = samples.map(s => s.cpu);
+            return {
+                rssMaxMB: Math.max(...rss) / 1048576,
+                rssAvgMB: rss.reduce((a, b) => a + b, 0) / rss.length / 1048576,
+                cpuMaxPercent: Math.max(...cpu),
+                cpuAvgPercent: cpu.reduce((a, b) => a + b, 0) / cpu.length
+            };
+        }
+    };
+}
+
+async function run() {
+    const options = parseArgs(process.argv, DEFAULTS);
+    const { mix, total } = parseMix(options.mix);
+
+    console.log(`🚀 Load test: ${options.wsDevices} WebSocket + ${options.mqttDevices} MQTT devices, ${options.rate} cmd/s for ${options.duration}s`);
+    const fleet = await connectFleet(options);
+
+    const server = startServerSampling(options);
+    measuring = true;
+    const started = now();
+
+    // Fixed-rate sender paced by elapsed time, so late timer ticks catch up
+    let budget = 0;
+    let lastTick = started;
+    const sender = setInterval(() => {
+        const tick = now();
+        budget += options.rate * (tick - lastTick) / 1000;
+        lastTick = tick;
+        while (budget >= 1) {
+            budget--;
+            const roll = Math.random() * total;
+            const kind = mix.find(entry => roll < entry.upTo).kind;
+            if (sendCommand(kind, fleet, options)) counters.sent[kind]++;
+        }
+    }, TICK);
+
+    const progress = setInterval(() => {
+        const elapsed = (now() - started) / 1000;
+        process.stdout.write(`\r⏱️  ${elapsed.toFixed(0)}s  delivered ${counters.delivered}  (${(counters.delivered / elapsed).toFixed(0)}/s)`);
+    }, 1000);
+
+    await new Promise(r => setTimeout(r, options.duration * 1000));
+    clearInterval(sender);
+    clearInterval(progress);
+    const sendSeconds = (now() - started) / 1000;
+
+    // Let in-flight deliveries land before closing the window
+    await new Promise(r => setTimeout(r, 1000));
+    measuring = false;
+    server.stop();
+    const elapsed = (now() - started) / 1000;
+
+    const sentTotal = Object.values(counters.sent).reduce((a, b) => a + b, 0);
+    const results = {
+        timestamp: new Date().toISOString(),
+        config: options,
+        fleet: { websocket: fleet.ws.length, mqtt: fleet.mqtt.length },
+        durationSeconds: elapsed,
+        commands: { total: sentTotal, perSecond: sentTotal / sendSeconds, byKind: counters.sent },
+        deliveries: { total: counters.delivered, perSecond: counters.delivered / elapsed },
+        latencyMs: latency.percentiles(),
+        errors: { connect: counters.connectErrors, disconnects: counters.disconnects },
+        server: server.summary()
+    };
+
+    const l = results.latencyMs;
+    const fmt = v => (v === null ? 'n/a' : v.toFixed(2));
+    console.log('\n📊 Results');
+    console.log(`   Commands:   ${sentTotal} (${results.commands.perSecond.toFixed(0)}/s)`);
+    console.log(`   Deliveries: ${counters.delivered} (${results.deliveries.perSecond.toFixed(0)}/s)`);
+    console.log(`   Latency ms: p50 ${fmt(l.p50)}  p90 ${fmt(l.p90)}  p99 ${fmt(l.p99)}  p999 ${fmt(l.p999)}  max ${fmt(l.max)}`);
+    if (results.server) {
+        console.log(`   Server:     RSS max ${results.server.rssMaxMB.toFixed(1)} MB, CPU avg ${results.server.cpuAvgPercent.toFixed(0)}% max ${results.server.cpuMaxPercent.toFixed(0)}%`);
+    }
+    console.log(`   Errors:     ${counters.connectErrors} connect, ${counters.disconnects} disconnects`);
+
+    if (options.out) {
+        fs.writeFileSync(options.out, JSON.stringify(results, null, 2));
+        console.log(`💾 Results written to ${options.out}`);
+    }
+
+    fleet.ws.forEach(device => device.conn.terminate());
+    fleet.mqtt.forEach(device => device.conn.end(true));
+    process.exit(0);
+}
+
+run().catch((error) => {
+    console.error('❌ Load test failed:', error);
+    process.exit(1);
+});
@@ -0,0 +1,259 @@
+// Replays a traffic capture (utils/capture.js) against a relay, as a repeatable benchmark.
+// Usage: node tools/replay.js --file <capture.rlyc> [options]
+//
+//   --file <path>            capture to replay (required)
+//   --url <ws url>           WebSocket endpoint (default ws://localhost:3000)
+//   --mqtt <mqtt url>        MQTT endpoint (default mqtt://localhost:1883)
+//   --api <http url>         base for REST requests and server stats (default derived from --url)
+//   --speed <n|max>          1 replays in real time, 10 ten times faster, max as fast as
+//                            the connections accept it (default 1)
+//   --out <file>             write machine-readable results as JSON
+//
+// Every recorded connection is reopened with its original request URL or client id
+// and sends its frames in recorded order; REST requests are reissued with their
+// bodies. Frames delivered to the replayed connections are counted. With a paced
+// speed, schedule lag (how late each record went out) shows whether the client kept up.
+const fs = require('fs');
+const http = require('http');
+const https = require('https');
+const WebSocket = require('ws');
+const mqtt = require('mqtt');
+const { decode } = require('../utils/capture');
+const { parseArgs: parseOptions, createSamples, now, fetchJson } = require('./lib/bench');
+
+const MAX_HTTP_SOCKETS = 64;
+const YIELD_EVERY = 1000; // records between event loop turns at max speed
+
+function parseArgs(argv) {
+    const options = parseOptions(argv, {
+        file: null,
+        url: 'ws://localhost:3000',
+        mqtt: 'mqtt://localhost:1883',
+        api: null,
+        speed: '1',
+        out: null
+    });
+    if (!options.file) {
+        console.error('❌ --file is required');
+        process.exit(1);
+    }
+    if (options.speed !== 'max' && !(Number(options.speed) > 0)) {
+        console.error('❌ --speed must be a positive number or max');
+        process.exit(1);
+    }
+    return options;
+}
+
+const lag = createSamples();
+const httpLatency = createSamples();
+
+const counters = {
+    records: 0,
+    sent: { websocket: 0, mqtt: 0, http: 0 },
+    connections: { websocket: 0, mqtt: 0 },
+    delivered: 0,
+    httpErrors: 0,
+    connectErrors: 0
+};
+
+// --- Connections ---
+
+function connectWs(options, label) {
+    return new Promise((resolve) => {
+        const ws = new WebSocket(`${options.url}${label}`);
+        ws.on('open', () => resolve(ws));
+        ws.on('message', () => counters.delivered++);
+        ws.on('error', () => {
+            counters.connectErrors++;
+            resolve(null);
+        });
+    });
+}
+
+function connectMqtt(options, clientId) {
+    return new Promise((resolve) => {
+        const client = mqtt.connect(options.mqtt, { clientId, reconnectPeriod: 0 });
+        client.on('connect', () => {
+            client.subscribe(`device/${clientId}/commands`, { qos: 0 }, () => resolve(client));
+        });
+        client.on('message', () => counters.delivered++);
+        client.on('error', () => {
+            counters.connectErrors++;
+            resolve(null);
+        });
+    });
+}
+
+// Recorded connection id -> { protocol, ready: Promise<conn|null>, chain: Promise }
+// Each connection's records run one after another on its chain, so a frame never
+// overtakes the open it belongs to, even at max speed
+const connections = new Map();
+
+function openConnection(options, record) {
+    counters.connections[record.protocol]++;
+    const ready = record.protocol === 'websocket' ? connectWs(options, record.label) : connectMqtt(options, record.label);
+    connections.set(record.connection, { protocol: record.protocol, ready, chain: ready });
+}
+
+function sendOnConnection(record) {
+    const connection = connections.get(record.connection);
+    if (!connection) return;
+    connection.chain = connection.chain.then(() => connection.ready).then((conn) => {
+        if (!conn) return;
+        if (record.protocol === 'websocket') {
+            if (conn.readyState !== WebSocket.OPEN) return;
+            conn.send(record.data);
+        } else {
+            conn.publish(record.label, record.data, { qos: 0 });
+        }
+        counters.sent[record.protocol]++;
+    });
+}
+
+function closeConnection(record) {
+    const connection = connections.get(record.connection);
+    if (!connection) return;
+    connections.delete(record.connection);
+    connection.chain.then(() => connection.ready).then((conn) => {
+        if (!conn) return;
+        if (connection.protocol === 'websocket') conn.close();
+        else conn.end();
+    });
+}
+
+// --- REST ---
+
+const agents = {
+    http: new http.Agent({ keepAlive: true, maxSockets: MAX_HTTP_SOCKETS }),
+    https: new https.Agent({ keepAlive: true, maxSockets: MAX_HTTP_SOCKETS })
+};
+const inFlight = new Set();
+
+function sendRequest(options, record) {
+    const space = record.label.indexOf(' ');
+    const method = record.label.slice(0, space);
+    const url = new URL(record.label.slice(space + 1), options.api);
+    const secure = url.protocol === 'https:';
+    const started = now();
+
+    const request = new Promise((resolve) => {
+        const req = (secure ? https : http).request(url, {
+            method,
+            agent: secure ? agents.https : agents.http,
+            headers: record.data.length > 0 ? { 'Content-Type': 'application/json', 'Content-Length': record.data.length } : {}
+        }, (res) => {
+            res.resume();
+            res.on('end', () => {
+                httpLatency.record(now() - started);
+                if (res.statusCode >= 500) counters.httpErrors++;
+                resolve();
+            });
+        });
+        req.on('error', () => {
+            counters.httpErrors++;
+            resolve();
+        });
+        req.end(record.data);
+    });
+    counters.sent.http++;
+    inFlight.add(request);
+    request.then(() => inFlight.delete(request));
+}
+
+// Server CPU time and RSS from /api/stats, before and after the replay
+async function serverProcess(options) {
+    const data = await fetchJson(`${options.api}/api/stats`);
+    return (data && data.stats && data.stats.process) || null;
+}
+
+// --- Replay ---
+
+async function run() {
+    const options = parseArgs(process.argv);
+    const records = Array.from(decode(fs.readFileSync(options.file)));
+    const speed = options.speed === 'max' ? null : Number(options.speed);
+    const span = records.length > 0 ? records[records.length - 1].time / 1000 : 0;
+
+    console.log(`🎬 Replaying ${records.length} records (${(span / 1000).toFixed(1)}s captured) at ${speed ? `${speed}x` : 'max speed'}`);
+    const before = await serverProcess(options);
+    const started = now();
+
+    for (const record of records) {
+        if (speed) {
+            const due = started + record.time / 1000 / speed;
+            const wait = due - now();
+            if (wait > 1) await new Promise(r => setTimeout(r, wait));
+            lag.record(Math.max(0, now() - due));
+        } else if (counters.records % YIELD_EVERY === 0) {
+            await new Promise(r => setImmediate(r));
+        }
+        counters.records++;
+
+        if (record.protocol === 'http') {
+            sendRequest(options, record);
+        } else if (record.kind === 'open') {
+            openConnection(options, record);
+        } else if (record.kind === 'message') {
+            sendOnConnection(record);
+        } else {
+            closeConnection(record);
+        }
+    }
+
+    // Everything queued on the connections and every request has gone out
+    await Promise.all(Array.from(connections.values(), connection => connection.chain));
+    await Promise.all(Array.from(inFlight));
+    const sendSeconds = (now() - started) / 1000;
+
+    // Let in-flight deliveries land before reading the results
+    await new Promise(r => setTimeout(r, 1000));
+    const after = await serverProcess(options);
+
+    const sentTotal = counters.sent.websocket + counters.sent.mqtt + counters.sent.http;
+    const results = {
+        timestamp: new Date().toISOString(),
+        config: options,
+        capture: { records: records.length, capturedSeconds: span / 1000 },
+        replaySeconds: sendSeconds,
+        records: { total: counters.records, perSecond: counters.records / sendSeconds },
+        sent: { total: sentTotal, perSecond: sentTotal / sendSeconds, byProtocol: counters.sent },
+        connections: counters.connections,
+        deliveries: counters.delivered,
+        scheduleLagMs: speed ? lag.percentiles() : null,
+        httpLatencyMs: counters.sent.http > 0 ? httpLatency.percentiles() : null,
+        errors: { connect: counters.connectErrors, http: counters.httpErrors },
+        server: before && after ? {
+            cpuMs: (after.cpuUser + after.cpuSystem) - (before.cpuUser + before.cpuSystem),
+            rssMB: after.rss / 1048576
+        } : null
+    };
+
+    const fmt = v => (v === null ? 'n/a' : v.toFixed(2));
+    console.log('📊 Results');
+    console.log(`   Replayed:   ${sentTotal} frames/requests in ${sendSeconds.toFixed(2)}s (${results.sent.perSecond.toFixed(0)}/s)`);
+    console.log(`   Sent:       ${counters.sent.websocket} WebSocket, ${counters.sent.mqtt} MQTT, ${counters.sent.http} REST`);
+    console.log(`   Deliveries: ${counters.delivered} to replayed connections`);
+    if (results.scheduleLagMs) {
+        const l = results.scheduleLagMs;
+        console.log(`   Lag ms:     p50 ${fmt(l.p50)}  p90 ${fmt(l.p90)}  p99 ${fmt(l.p99)}  max ${fmt(l.max)}`);
+    }
+    if (results.httpLatencyMs) {
+        const l = results.httpLatencyMs;
+        console.log(`   REST ms:    p50 ${fmt(l.p50)}  p90 ${fmt(l.p90)}  p99 ${fmt(l.p99)}  max ${fmt(l.max)}`);
+    }
+    if (results.server) {
+        console.log(`   Server:     ${results.server.cpuMs.toFixed(0)} ms CPU, RSS ${results.server.rssMB.toFixed(1)} MB`);
+    }
+    console.log(`   Errors:     ${counters.connectErrors} connect, ${counters.httpErrors} REST`);
+
+    if (options.out) {
+        fs.writeFileSync(options.out, JSON.stringify(results, null, 2));
+        console.log(`💾 Results written to ${options.out}`);
+    }
+    process.exit(0);
+}
+
+run().catch((error) => {
+    console.error('❌ Replay failed:', error);
+    process.exit(1);
+});
@@ -0,0 +1,147 @@
+const WebSocket = require('ws');
+const registry = require('./registry');
+const log = require('./logger').create('admin');
+
+// Presence stream for admin dashboards.
+// Connects and disconnects only mark a device as changed. Once per
+// ADMIN_BATCH_WINDOW the changed devices are collapsed into one versioned delta,
+// encoded once and sent to every dashboard, so a reconnect storm costs a few
+// frames per second instead of one per event per dashboard.
+//
+//   { type: 'presenceSnapshot', version, devices: [...] }          on connect / resync
+//   { type: 'presenceDelta', version, upserts: [...], removed: [...],
+//     connected, disconnected }                                     once per window
+//
+// A dashboard that sees a version gap sends { type: 'resync' }. A dashboard whose
+// socket is backed up is skipped and gets a fresh snapshot once it drains.
+const ADMIN_BATCH_WINDOW = parseInt(process.env.ADMIN_BATCH_WINDOW) || 250;
+const ADMIN_HIGH_WATERMARK = parseInt(process.env.ADMIN_HIGH_WATERMARK) || 256 * 1024;
+
+const admins = new Set();
+const changed = new Set();    // deviceIds changed since the last delta
+const published = new Set();  // deviceIds the dashboards currently know about
+let version = 0;
+let connectedEvents = 0;
+let disconnectedEvents = 0;
+let flushTimer = null;
+
+const counters = {
+    deltas: 0,
+    snapshots: 0,
+    skipped: 0
+};
+
+function deviceRow(deviceId) {
+    const entry = registry.get(deviceId);
+    if (!entry) return null;
+    const info = registry.describe(entry);
+    return {
+        deviceId,
+        type: info.type,
+        protocols: info.protocols,
+        connections: info.activeConnections || info.connections
+    };
+}
+
+function sendSnapshot(ws) {
+    const devices = registry.deviceIds().map(deviceRow).filter(Boolean);
+    ws.needsSnapshot = false;
+    ws.send(JSON.stringify({ type: 'presenceSnapshot', version, devices }));
+    counters.snapshots++;
+}
+
+function flush() {
+    flushTimer = null;
+    if (changed.size === 0) return;
+
+    const upserts = [];
+    const removed = [];
+    changed.forEach((deviceId) => {
+        const row = deviceRow(deviceId);
+        if (row) {
+            upserts.push(row);
+            published.add(deviceId);
+        } else if (published.delete(deviceId)) {
+            removed.push(deviceId);
+        }
+        // Connected and gone within one window: the dashboards never need to hear of it
+    });
+    changed.clear();
+
+    const events = { connected: connectedEvents, disconnected: disconnectedEvents };
+    connectedEvents = 0;
+    disconnectedEvents = 0;
+    if (upserts.length === 0 && removed.length === 0) return;
+
+    version++;
+    counters.deltas++;
+    const encoded = JSON.stringify({ type: 'presenceDelta', version, upserts, removed, ...events });
+
+    admins.forEach((ws) => {
+        if (ws.readyState !== WebSocket.OPEN) return;
+        if (ws.bufferedAmount > ADMIN_HIGH_WATERMARK) {
+            // Deltas would only pile up; catch up with one snapshot later
+            ws.needsSnapshot = true;
+            counters.skipped++;
+            return;
+        }
+        if (ws.needsSnapshot) {
+            sendSnapshot(ws);
+        } else {
+            ws.send(encoded);
+        }
+    });
+}
+
+// Called on every connect/disconnect; cheap, the work happens in flush()
+function markChanged(deviceId, event) {
+    if (!deviceId) return;
+    changed.add(deviceId);
+    if (event === 'connected') connectedEvents++;
+    if (event === 'disconnected') disconnectedEvents++;
+
+    if (!flushTimer && admins.size > 0) {
+        flushTimer = setTimeout(flush, ADMIN_BATCH_WINDOW);
+    } else if (admins.size === 0) {
+        // Nobody is watching: keep the published set in step without building deltas
+        if (!registry.has(deviceId)) published.delete(deviceId);
+        changed.clear();
+        connectedEvents = 0;
+        disconnectedEvents = 0;
+    }
+}
+
+function addAdmin(ws) {
+    admins.add(ws);
+    registry.deviceIds().forEach(deviceId => published.add(deviceId));
+    sendSnapshot(ws);
+
+    ws.on('message', (message) => {
+        try {
+            const request = JSON.parse(message.toString());
+            if (request.type === 'resync') sendSnapshot(ws);
+        } catch (e) {
+            log.debug(() => `⚠️ Ignoring invalid admin message: ${e.message}`);
+        }
+    });
+}
+
+function removeAdmin(ws) {
+    admins.delete(ws);
+}
+
+function stats() {
+    return {
+        dashboards: admins.size,
+        version,
+        pendingChanges: changed.size,
+        ...counters
+    };
+}
+
+module.exports = {
+    addAdmin,
+    removeAdmin,
+    markChanged,
+    stats
+};
@@ -0,0 +1,124 @@
+const metrics = require('./metrics');
+const log = require('./logger').create('admission');
+
+// Admission control for new device connections.
+// After a relay restart the whole fleet reconnects at once, and every accept costs a
+// TLS handshake, an upgrade and registration. Accepts are paced by a token bucket:
+// ADMISSION_RATE connections per second, with bursts of up to ADMISSION_BURST.
+// A connection that finds the bucket empty waits in line for its token. If the line
+// is already more than ADMISSION_MAX_WAIT ms long it is turned away instead
+// (WebSocket: HTTP 503 with Retry-After before the upgrade, MQTT: closed before
+// CONNACK) and the device retries after its reconnect backoff. ADMISSION_RATE=0 admits everything.
+const RATE = process.env.ADMISSION_RATE !== undefined ? (parseInt(process.env.ADMISSION_RATE) || 0) : 200;
+const BURST = parseInt(process.env.ADMISSION_BURST) || RATE;
+const MAX_WAIT = parseInt(process.env.ADMISSION_MAX_WAIT) || 2000;
+
+let tokens = BURST;
+let refilledAt = Date.now();
+const waiting = []; // callbacks in arrival order
+let head = 0;
+let drainTimer = null;
+
+const counters = {
+    admitted: 0,
+    delayed: 0,
+    rejected: 0
+};
+
+function refill() {
+    const now = Date.now();
+    tokens = Math.min(BURST, tokens + (now - refilledAt) * RATE / 1000);
+    refilledAt = now;
+}
+
+function queueLength() {
+    return waiting.length - head;
+}
+
+function drain() {
+    drainTimer = null;
+    refill();
+    while (tokens >= 1 && head < waiting.length) {
+        tokens--;
+        const admit = waiting[head];
+        waiting[head++] = null;
+        counters.admitted++;
+        admit(true);
+    }
+    if (head === waiting.length) {
+        waiting.length = 0;
+        head = 0;
+        return;
+    }
+    scheduleDrain();
+}
+
+function scheduleDrain() {
+    if (drainTimer) return;
+    drainTimer = setTimeout(drain, Math.max(1, Math.ceil((1 - tokens) * 1000 / RATE)));
+}
+
+// Calls callback(true) once the connection may proceed, or callback(false, retryAfter)
+// with a suggested retry delay in seconds
+function admit(callback) {
+    if (RATE === 0) {
+        counters.admitted++;
+        callback(true);
+        return;
+    }
+
+    refill();
+    if (queueLength() === 0 && tokens >= 1) {
+        tokens--;
+        counters.admitted++;
+        callback(true);
+        return;
+    }
+
+    const wait = (queueLength() + 1 - tokens) * 1000 / RATE;
+    if (wait > MAX_WAIT) {
+        counters.rejected++;
+        // Spread the retries over the time the current line takes to clear
+        const retryAfter = 1 + Math.floor(Math.random() * Math.ceil(wait / 1000));
+        log.debug(() => `🚦 Connection turned away, ${queueLength()} waiting, retry after ${retryAfter}s`);
+        callback(false, retryAfter);
+        return;
+    }
+    counters.delayed++;
+    waiting.push(callback);
+    scheduleDrain();
+}
+
+// ws verifyClient hook; dashboards (/admin) are not paced
+function verifyClient(info, done) {
+    if (info.req.url.startsWith('/admin')) {
+        done(true);
+        return;
+    }
+    admit((accepted, retryAfter) => {
+        if (accepted) done(true);
+        else done(false, 503, 'Server busy', { 'Retry-After': String(retryAfter) });
+    });
+}
+
+function stats() {
+    if (RATE > 0) refill();
+    return {
+        rate: RATE,
+        burst: BURST,
+        maxWait: MAX_WAIT,
+        tokens: RATE === 0 ? null : Math.floor(tokens),
+        waiting: queueLength(),
+        ...counters
+    };
+}
+
+metrics.collect('relay_admission_waiting', 'gauge', 'Connections waiting for admission', queueLength);
+metrics.collect('relay_admission_total', 'counter', 'Connection admission decisions by outcome', () =>
+    Object.keys(counters).map(outcome => ({ labels: { outcome }, value: counters[outcome] })));
+
+module.exports = {
+    admit,
+    verifyClient,
+    stats
+};
@@ -0,0 +1,300 @@
+const fs = require('fs');
+const path = require('path');
+const { performance } = require('perf_hooks');
+const log = require('./logger').create('capture');
+
+// Traffic capture: inbound WebSocket frames, MQTT publishes and REST requests
+// recorded to a compact binary log that tools/replay.js plays back against a
+// local server, so real traffic shapes can be used as repeatable benchmarks.
+//
+// File layout (integers are unsigned LEB128 varints unless noted):
+//   header   "RLYC", version (u8), 3 reserved bytes, start time (float64 BE, epoch ms)
+//   record   kind (u8), protocol (u8), time since previous record (µs), connection id, body
+//     open     label: the WebSocket request URL or the MQTT client id
+//     message  label: the MQTT topic or "METHOD /path" for REST (empty for WebSocket), data
+//     close    (no body)
+//   strings and data are a length followed by the bytes
+// REST requests use connection 0. Connections already open when a capture starts
+// are recorded as opening at their first message.
+//
+// Start with CAPTURE_FILE=<path>, or at runtime through POST /api/capture/start.
+// Records are buffered and written in batches; if the disk falls behind by more than
+// CAPTURE_MAX_BUFFER bytes, records are dropped and counted rather than held in
+// memory. A capture stops by itself at CAPTURE_MAX_BYTES.
+const MAGIC = 'RLYC';
+const VERSION = 1;
+const HEADER_SIZE = 16;
+const MAX_BUFFER = parseInt(process.env.CAPTURE_MAX_BUFFER) || 64 * 1024 * 1024;
+const MAX_BYTES = parseInt(process.env.CAPTURE_MAX_BYTES) || 1024 * 1024 * 1024;
+
+const KIND = { open: 1, message: 2, close: 3 };
+const PROTOCOL = { websocket: 1, mqtt: 2, http: 3 };
+const KIND_NAMES = ['', 'open', 'message', 'close'];
+const PROTOCOL_NAMES = ['', 'websocket', 'mqtt', 'http'];
+
+let session = null; // { id, file, fd, position, writing, backlog, pending, startedAt, last, bytes, records, dropped }
+let sessionCount = 0;
+let nextConnection = 1;
+
+// --- Encoding ---
+
+function varintSize(value) {
+    let size = 1;
+    while (value >= 0x80) {
+        value = Math.floor(value / 0x80);
+        size++;
+    }
+    return size;
+}
+
+function writeVarint(buf, offset, value) {
+    while (value >= 0x80) {
+        buf[offset++] = (value % 0x80) | 0x80;
+        value = Math.floor(value / 0x80);
+    }
+    buf[offset++] = value;
+    return offset;
+}
+
+function encode(kind, protocol, delta, connection, label, data) {
+    let size = 2 + varintSize(delta) + varintSize(connection);
+    if (label) size += varintSize(label.length) + label.length;
+    if (data) size += varintSize(data.length) + data.length;
+
+    const buf = Buffer.allocUnsafe(size);
+    buf[0] = kind;
+    buf[1] = protocol;
+    let offset = writeVarint(buf, 2, delta);
+    offset = writeVarint(buf, offset, connection);
+    if (label) {
+        offset = writeVarint(buf, offset, label.length);
+        offset += label.copy(buf, offset);
+    }
+    if (data) {
+        offset = writeVarint(buf, offset, data.length);
+        data.copy(buf, offset);
+    }
+    return buf;
+}
+
+function header(startedAt) {
+    const buf = Buffer.alloc(HEADER_SIZE);
+    buf.write(MAGIC, 0, 'ascii');
+    buf[4] = VERSION;
+    buf.writeDoubleBE(startedAt, 8);
+    return buf;
+}
+
+// Yields { kind, protocol, time (µs since start), connection, label, data } for a
+// whole capture file; throws on a file that is not a capture
+function* decode(buf) {
+    if (buf.length < HEADER_SIZE || buf.toString('ascii', 0, 4) !== MAGIC || buf[4] !== VERSION) {
+        throw new Error('Not a relay capture file');
+    }
+    let offset = HEADER_SIZE;
+    let time = 0;
+
+    function readVarint() {
+        let value = 0;
+        let scale = 1;
+        for (;;) {
+            const byte = buf[offset++];
+            value += (byte & 0x7f) * scale;
+            if (byte < 0x80) return value;
+            scale *= 0x80;
+        }
+    }
+    function readBytes() {
+        const length = readVarint();
+        const bytes = buf.subarray(offset, offset + length);
+        offset += length;
+        return bytes;
+    }
+
+    while (offset < buf.length) {
+        const start = offset;
+        const kind = buf[offset];
+        const protocol = buf[offset + 1];
+        offset += 2;
+        time += readVarint();
+        const record = { kind: KIND_NAMES[kind], protocol: PROTOCOL_NAMES[protocol], time, connection: readVarint(), label: '', data: null };
+        if (kind === KIND.open || kind === KIND.message) record.label = readBytes().toString();
+        if (kind === KIND.message) record.data = readBytes();
+        // A capture cut off mid-record (crash, size limit) ends at the last whole record
+        if (offset > buf.length || !record.kind) return;
+        record.offset = start;
+        yield record;
+    }
+}
+
+// --- Recording ---
+
+// Writes are positional, so the exit handler can append whatever is still pending
+// even while an asynchronous write is in flight
+function flush(current) {
+    if (current.writing) return;
+    if (current.pending.length === 0) {
+        if (current.closing && !current.closed) {
+            current.closed = true;
+            fs.close(current.fd, () => {});
+        }
+        return;
+    }
+    const chunk = current.pending.length === 1 ? current.pending[0] : Buffer.concat(current.pending);
+    current.pending = [];
+    current.writing = true;
+    fs.write(current.fd, chunk, 0, chunk.length, current.position, (err) => {
+        current.writing = false;
+        current.backlog -= chunk.length;
+        if (err) {
+            log.error(() => `❌ Capture write to ${current.file} failed: ${err.message}`);
+            if (session === current) stop();
+            current.pending = [];
+        }
+        flush(current);
+    });
+    current.position += chunk.length;
+}
+
+function record(kind, protocol, connection, label, data) {
+    const now = performance.now();
+    const delta = Math.max(0, Math.round((now - session.last) * 1000));
+    session.last = now;
+
+    if (session.backlog > MAX_BUFFER) {
+        session.dropped++;
+        return;
+    }
+    const buf = encode(kind, protocol, delta, connection, kind === KIND.close ? null : Buffer.from(label || ''), data);
+    session.pending.push(buf);
+    session.backlog += buf.length;
+    session.records++;
+    session.bytes += buf.length;
+    if (session.pending.length === 1) setImmediate(flush, session);
+    if (session.bytes >= MAX_BYTES) {
+        log.warn(`⚠️ Capture ${session.file} reached ${MAX_BYTES} bytes, stopping`);
+        stop();
+    }
+}
+
+// Connections are numbered per capture; a connection from before the capture
+// started gets its open record on first use
+function connectionId(protocol, conn) {
+    if (conn.captureSession !== session.id) {
+        conn.captureSession = session.id;
+        conn.captureId = nextConnection++;
+        record(KIND.open, PROTOCOL[protocol], conn.captureId, conn.captureLabel || '', null);
+    }
+    return conn.captureId;
+}
+
+// label: the WebSocket request URL or MQTT client id, kept for later captures too
+function open(protocol, conn, label) {
+    conn.captureLabel = label;
+    if (session) connectionId(protocol, conn);
+}
+
+function message(protocol, conn, data, label = '') {
+    if (!session) return;
+    const id = connectionId(protocol, conn);
+    record(KIND.message, PROTOCOL[protocol], id, label, Buffer.isBuffer(data) ? data : Buffer.from(data));
+}
+
+function close(protocol, conn) {
+    if (!session || conn.captureSession !== session.id) return;
+    record(KIND.close, PROTOCOL[protocol], conn.captureId, null, null);
+}
+
+function request(method, url, body) {
+    if (!session) return;
+    const data = body && Object.keys(body).length > 0 ? Buffer.from(JSON.stringify(body)) : Buffer.alloc(0);
+    record(KIND.message, PROTOCOL.http, 0, `${method} ${url}`, data);
+}
+
+function isActive() {
+    return session !== null;
+}
+
+// --- Control ---
+
+function defaultFile() {
+    const index = process.env.CLUSTER_WORKER_INDEX;
+    const stamp = new Date().toISOString().replace(/[:.]/g, '-');
+    return path.join('data', `capture-${stamp}${index !== undefined ? `-${index}` : ''}.rlyc`);
+}
+
+// Returns the status of the new capture, or null if one is already running
+function start(file = defaultFile()) {
+    if (session) return null;
+    fs.mkdirSync(path.dirname(file), { recursive: true });
+
+    const startedAt = Date.now();
+    const fd = fs.openSync(file, 'w');
+    fs.writeSync(fd, header(startedAt));
+
+    session = {
+        id: ++sessionCount,
+        file,
+        fd,
+        position: HEADER_SIZE,
+        writing: false,
+        closing: false,
+        closed: false,
+        backlog: 0,
+        pending: [],
+        startedAt,
+        last: performance.now(),
+        bytes: HEADER_SIZE,
+        records: 0,
+        dropped: 0
+    };
+    log.info(`🎥 Capturing inbound traffic to ${file}`);
+    return status();
+}
+
+// Returns the status of the finished capture, or null if none was running
+function stop() {
+    if (!session) return null;
+    const result = status();
+    session.closing = true;
+    flush(session);
+    log.info(`🎥 Capture ${session.file} stopped: ${session.records} records, ${session.bytes} bytes${session.dropped ? `, ${session.dropped} dropped` : ''}`);
+    session = null;
+    return { ...result, active: false };
+}
+
+function status() {
+    if (!session) return { active: false };
+    return {
+        active: true,
+        file: session.file,
+        startedAt: new Date(session.startedAt).toISOString(),
+        records: session.records,
+        bytes: session.bytes,
+        dropped: session.dropped
+    };
+}
+
+process.on('exit', () => {
+    // Whatever was not written yet, at its place in the file
+    if (session && session.pending.length > 0) {
+        try {
+            const chunk = Buffer.concat(session.pending);
+            fs.writeSync(session.fd, chunk, 0, chunk.length, session.position);
+        } catch (e) {
+            // Nothing left to report to
+        }
+    }
+});
+
+module.exports = {
+    open,
+    message,
+    close,
+    request,
+    isActive,
+    start,
+    stop,
+    status,
+    decode
+};
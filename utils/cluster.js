@@ -0,0 +1,338 @@
+const net = require('net');
+const os = require('os');
+const registry = require('./registry');
+const log = require('./logger').create('cluster');
+
+// Node side of cluster mode.
+// Each node (a worker process, or a server on another host) owns its own
+// connections. Presence changes are announced to the hub, which keeps the
+// deviceId -> owner directory and replicates it to every node, so routing can
+// check for a remote owner synchronously. Messages for a remote device are sent
+// over the bus and delivered by the owning node as if they arrived locally.
+//
+// Bus messages (JSON):
+//   claim/release { deviceId }             node -> hub
+//   presenceBatch { changes }              node -> hub, [deviceId, online] pairs
+//   deliver { to, targetId, message }      node -> hub -> owner
+//   broadcast { message }                  node -> hub -> all other nodes
+//   group { change }                       node -> hub -> all other nodes, group membership
+//   groupcast { name, message }            node -> hub -> all other nodes, send to a group
+//   schedule { change }                    node -> hub -> all other nodes, scheduled commands
+//   snapshot { nodes, devices, groups, schedules }  hub -> node, on attach
+//   presence { deviceId, nodeId, online }  hub -> nodes
+//   presenceBatch { nodeId, changes }      hub -> nodes
+//   nodes { nodes }                        hub -> nodes, on membership change, oldest first
+//   rejected { reason }                    hub -> node, bad secret or duplicate node id
+const HUB_RECONNECT_DELAY = 2000;
+// Device presence is announced in batches: a reconnect storm becomes a few messages
+// per window to the hub and from it to every node, instead of one per device each
+const PRESENCE_BATCH_WINDOW = parseInt(process.env.CLUSTER_PRESENCE_WINDOW) || 50;
+
+let link = null;   // { send(msg) }
+let nodeId = null;
+let connected = false;
+
+const remoteDevices = new Map(); // deviceId -> Set<nodeId>, other nodes only
+let knownNodes = [];
+const pendingPresence = new Map(); // deviceId -> online, not yet announced
+let presenceTimer = null;
+
+let deliverHandler = null;   // (targetId, message) -> bool
+let broadcastHandler = null; // (message) -> void
+let groupcastHandler = null; // (name, message) -> void
+let remoteOnlineListener = null; // (deviceId) when a device comes online on another node
+let groupChangeListener = null; // (change) for group changes made on other nodes
+let scheduleChangeListener = null; // (change) for schedule changes made on other nodes
+
+const counters = {
+    forwarded: 0,
+    received: 0,
+    undeliverable: 0
+};
+
+// Called by the module that owns local delivery (mqtt.js)
+function setHandlers({ deliver, broadcast, groupcast }) {
+    deliverHandler = deliver;
+    broadcastHandler = broadcast;
+    groupcastHandler = groupcast;
+}
+
+function onRemoteOnline(fn) {
+    remoteOnlineListener = fn;
+}
+
+// Called by utils/groups.js; the snapshot arrives as { type: 'snapshot', groups }
+function onGroupChange(fn) {
+    groupChangeListener = fn;
+}
+
+// Called by utils/scheduler.js; the snapshot arrives as { type: 'snapshot', schedules }
+function onScheduleChange(fn) {
+    scheduleChangeListener = fn;
+}
+
+function isEnabled() {
+    return link !== null;
+}
+
+function send(msg) {
+    if (connected) link.send(msg);
+}
+
+// Re-announce every local device; the hub forgets a node when its link drops
+function claimLocalDevices() {
+    pendingPresence.clear();
+    const changes = registry.deviceIds().map(deviceId => [deviceId, true]);
+    if (changes.length > 0) send({ op: 'presenceBatch', changes });
+}
+
+function flushPresence() {
+    presenceTimer = null;
+    if (pendingPresence.size === 0) return;
+    send({ op: 'presenceBatch', changes: Array.from(pendingPresence) });
+    pendingPresence.clear();
+}
+
+function applyPresence(deviceId, owner, online) {
+    let owners = remoteDevices.get(deviceId);
+    if (online) {
+        if (!owners) {
+            owners = new Set();
+            remoteDevices.set(deviceId, owners);
+        }
+        owners.add(owner);
+        if (remoteOnlineListener) remoteOnlineListener(deviceId);
+    } else if (owners) {
+        owners.delete(owner);
+        if (owners.size === 0) remoteDevices.delete(deviceId);
+    }
+}
+
+function handleBusMessage(msg) {
+    switch (msg.op) {
+        case 'snapshot':
+            remoteDevices.clear();
+            msg.devices.forEach(([deviceId, owners]) => {
+                const others = owners.filter(owner => owner !== nodeId);
+                if (others.length > 0) remoteDevices.set(deviceId, new Set(others));
+            });
+            knownNodes = msg.nodes;
+            if (remoteOnlineListener) remoteDevices.forEach((owners, deviceId) => remoteOnlineListener(deviceId));
+            if (groupChangeListener) groupChangeListener({ type: 'snapshot', groups: msg.groups || [] });
+            if (scheduleChangeListener) scheduleChangeListener({ type: 'snapshot', schedules: msg.schedules || [] });
+            break;
+
+        case 'presence':
+            if (msg.nodeId !== nodeId) applyPresence(msg.deviceId, msg.nodeId, msg.online);
+            break;
+
+        case 'presenceBatch':
+            if (msg.nodeId !== nodeId) msg.changes.forEach(([deviceId, online]) => applyPresence(deviceId, msg.nodeId, online));
+            break;
+
+        case 'nodes':
+            knownNodes = msg.nodes;
+            break;
+
+        case 'rejected':
+            log.error(`❌ Cluster hub refused this node: ${msg.reason}`);
+            break;
+
+        case 'deliver':
+            counters.received++;
+            if (!deliverHandler || !deliverHandler(msg.targetId, msg.message)) {
+                counters.undeliverable++;
+                log.warn(() => `⚠️ Cluster delivery for ${msg.targetId} failed, device is no longer on ${nodeId}`);
+            }
+            break;
+
+        case 'broadcast':
+            counters.received++;
+            if (broadcastHandler) broadcastHandler(msg.message);
+            break;
+
+        case 'group':
+            if (groupChangeListener) groupChangeListener(msg.change);
+            break;
+
+        case 'groupcast':
+            counters.received++;
+            if (groupcastHandler) groupcastHandler(msg.name, msg.message);
+            break;
+
+        case 'schedule':
+            if (scheduleChangeListener) scheduleChangeListener(msg.change);
+            break;
+    }
+}
+
+function attach(busLink, id) {
+    link = busLink;
+    nodeId = id;
+
+    // Only the latest state of a device within the window is announced
+    registry.onPresenceChange((deviceId, online) => {
+        pendingPresence.set(deviceId, online);
+        if (!presenceTimer) presenceTimer = setTimeout(flushPresence, PRESENCE_BATCH_WINDOW);
+    });
+}
+
+function onLinkUp() {
+    connected = true;
+    claimLocalDevices();
+}
+
+function onLinkDown() {
+    connected = false;
+    remoteDevices.clear();
+    knownNodes = [];
+}
+
+// Worker process forked by the cluster primary; the bus is the IPC channel
+function startWorker() {
+    const id = process.env.CLUSTER_NODE_ID || `${os.hostname()}:${process.pid}`;
+    attach({ send: msg => process.send({ clusterBus: msg }) }, id);
+
+    process.on('message', (envelope) => {
+        if (envelope && envelope.clusterBus) handleBusMessage(envelope.clusterBus);
+    });
+    process.send({ clusterBus: { op: 'hello', nodeId: id } });
+    onLinkUp();
+
+    log.info(`🧩 Cluster worker ${id} attached to primary`);
+}
+
+// Standalone node on another host; the bus is a TCP connection to the hub
+function connectToHub(address) {
+    const [host, port] = address.includes(':') ? address.split(':') : ['127.0.0.1', address];
+    const id = process.env.CLUSTER_NODE_ID || `${os.hostname()}:${process.pid}`;
+    let socket = null;
+
+    attach({ send: msg => socket.write(JSON.stringify(msg) + '\n') }, id);
+
+    function connect() {
+        socket = net.connect(parseInt(port), host);
+        let buffered = '';
+
+        socket.on('connect', () => {
+            socket.setNoDelay(true);
+            socket.write(JSON.stringify({ op: 'hello', nodeId: id, secret: process.env.CLUSTER_SECRET || '' }) + '\n');
+            onLinkUp();
+            log.info(`🧩 Cluster node ${id} connected to hub ${host}:${port}`);
+        });
+
+        socket.on('data', (chunk) => {
+            buffered += chunk.toString();
+            let newline;
+            while ((newline = buffered.indexOf('\n')) >= 0) {
+                const line = buffered.slice(0, newline);
+                buffered = buffered.slice(newline + 1);
+                try {
+                    handleBusMessage(JSON.parse(line));
+                } catch (e) {
+                    log.error(() => `❌ Invalid cluster bus message: ${e.message}`);
+                }
+            }
+        });
+
+        socket.on('error', (err) => {
+            log.error(() => `❌ Cluster hub connection error: ${err.message}`);
+        });
+
+        socket.on('close', () => {
+            if (connected) log.warn(`⚠️ Cluster hub connection lost, retrying`);
+            onLinkDown();
+            setTimeout(connect, HUB_RECONNECT_DELAY);
+        });
+    }
+
+    connect();
+}
+
+// Claim or release an address that is not a device (a pending reply) in the directory
+function announce(address, online) {
+    send({ op: online ? 'claim' : 'release', deviceId: address });
+}
+
+// Owner node of a device connected elsewhere, or null
+function ownerOf(deviceId) {
+    const owners = remoteDevices.get(deviceId);
+    return owners ? owners.values().next().value : null;
+}
+
+// Sends a message to every node the target is connected to; false if it is not known remotely
+function forward(targetId, message) {
+    if (!connected) return false;
+    const owners = remoteDevices.get(targetId);
+    if (!owners) return false;
+
+    owners.forEach((owner) => {
+        send({ op: 'deliver', to: owner, targetId, message });
+    });
+    counters.forwarded++;
+    return true;
+}
+
+// Number of other nodes the broadcast was handed to
+function broadcast(message) {
+    if (!connected) return 0;
+    send({ op: 'broadcast', message });
+    return Math.max(knownNodes.length - 1, 0);
+}
+
+function publishGroupChange(change) {
+    send({ op: 'group', change });
+}
+
+function publishScheduleChange(change) {
+    send({ op: 'schedule', change });
+}
+
+// The oldest node attached to the hub runs cluster-wide work (scheduled commands).
+// A node cut off from the hub is not the leader, so it never duplicates that work.
+function isLeader() {
+    return connected && knownNodes[0] === nodeId;
+}
+
+// Hands a group send to every other node, which delivers it to its own members
+function groupcast(name, message) {
+    if (!connected) return 0;
+    send({ op: 'groupcast', name, message });
+    counters.forwarded++;
+    return Math.max(knownNodes.length - 1, 0);
+}
+
+function remoteDeviceIds() {
+    return Array.from(remoteDevices.keys());
+}
+
+function stats() {
+    return {
+        enabled: isEnabled(),
+        connected,
+        nodeId,
+        nodes: knownNodes,
+        remoteDevices: remoteDevices.size,
+        ...counters
+    };
+}
+
+module.exports = {
+    setHandlers,
+    onRemoteOnline,
+    onGroupChange,
+    onScheduleChange,
+    isEnabled,
+    isLeader,
+    startWorker,
+    connectToHub,
+    announce,
+    ownerOf,
+    forward,
+    broadcast,
+    publishGroupChange,
+    publishScheduleChange,
+    groupcast,
+    remoteDeviceIds,
+    stats
+};
@@ -0,0 +1,298 @@
+const cluster = require('cluster');
+const crypto = require('crypto');
+const net = require('net');
+const log = require('./logger').create('cluster');
+
+// Cluster hub: the shared device directory and message bus.
+// Runs in the cluster primary. Local workers attach over IPC, nodes on other
+// hosts over TCP (newline-delimited JSON, see utils/cluster.js for the messages).
+// The directory maps deviceId -> owner nodes and is replicated to every node as
+// presence events, so nodes only come back to the hub to move messages.
+const WORKER_RESTART_DELAY = 1000;
+// Remote nodes must present CLUSTER_SECRET in their hello. The hub port listens on
+// CLUSTER_HUB_HOST, loopback unless set, so exposing it is a deliberate choice.
+const CLUSTER_SECRET = process.env.CLUSTER_SECRET || '';
+const CLUSTER_HUB_HOST = process.env.CLUSTER_HUB_HOST || '127.0.0.1';
+const MAX_UNAUTHENTICATED_BYTES = 64 * 1024;
+
+const nodes = new Map();     // nodeId -> { send(msg) }
+const directory = new Map(); // deviceId -> Set<nodeId>
+const groups = new Map();    // group name -> Set<deviceId>, handed to nodes that (re)join
+const schedules = new Map(); // schedule id -> saved schedule, handed to nodes that (re)join
+
+const counters = {
+    delivered: 0,
+    broadcasts: 0,
+    undeliverable: 0
+};
+
+function sendToOthers(fromNodeId, msg) {
+    nodes.forEach((node, id) => {
+        if (id !== fromNodeId) node.send(msg);
+    });
+}
+
+function publishNodes() {
+    const msg = { op: 'nodes', nodes: Array.from(nodes.keys()) };
+    nodes.forEach(node => node.send(msg));
+}
+
+// claim/release return true if the directory changed; with `batched` the caller
+// sends the presence event as part of a presenceBatch
+function claim(nodeId, deviceId, batched) {
+    let owners = directory.get(deviceId);
+    if (!owners) {
+        owners = new Set();
+        directory.set(deviceId, owners);
+    }
+    if (owners.has(nodeId)) return false;
+    owners.add(nodeId);
+    if (!batched) sendToOthers(nodeId, { op: 'presence', deviceId, nodeId, online: true });
+    return true;
+}
+
+function release(nodeId, deviceId, batched) {
+    const owners = directory.get(deviceId);
+    if (!owners || !owners.delete(nodeId)) return false;
+    if (owners.size === 0) directory.delete(deviceId);
+    if (!batched) sendToOthers(nodeId, { op: 'presence', deviceId, nodeId, online: false });
+    return true;
+}
+
+// Applies [deviceId, online] pairs from one node and passes the effective ones on in one message
+function applyPresenceBatch(nodeId, changes) {
+    const effective = changes.filter(([deviceId, online]) =>
+        (online ? claim(nodeId, deviceId, true) : release(nodeId, deviceId, true)));
+    if (effective.length > 0) sendToOthers(nodeId, { op: 'presenceBatch', nodeId, changes: effective });
+}
+
+// Keep the hub's copy of the groups current (see utils/groups.js for the changes)
+function applyGroupChange(change) {
+    if (change.type === 'delete') {
+        groups.delete(change.name);
+        return;
+    }
+    let members = groups.get(change.name);
+    if (!members && change.type === 'remove') return;
+    if (!members || change.type === 'set') {
+        members = new Set();
+        groups.set(change.name, members);
+    }
+    if (change.type === 'remove') {
+        change.deviceIds.forEach(id => members.delete(id));
+    } else {
+        change.deviceIds.forEach(id => members.add(id));
+    }
+}
+
+// Keep the hub's copy of the schedules current (see utils/scheduler.js for the changes)
+function applyScheduleChange(change) {
+    if (change.type === 'create') {
+        schedules.set(change.schedule.id, change.schedule);
+    } else if (change.type === 'delete') {
+        schedules.delete(change.id);
+    } else if (change.type === 'run') {
+        const schedule = schedules.get(change.id);
+        if (schedule) {
+            schedule.runs = change.runs;
+            schedule.lastRunAt = change.lastRunAt;
+            schedule.lastResult = change.lastResult;
+            schedule.nextRunAt = change.nextRunAt;
+        }
+    }
+}
+
+function attachNode(nodeId, node) {
+    nodes.set(nodeId, node);
+    node.send({
+        op: 'snapshot',
+        nodes: Array.from(nodes.keys()),
+        devices: Array.from(directory, ([deviceId, owners]) => [deviceId, Array.from(owners)]),
+        groups: Array.from(groups, ([name, members]) => ({ name, deviceIds: Array.from(members) })),
+        schedules: Array.from(schedules.values())
+    });
+    publishNodes();
+    log.info(`🧩 Cluster node ${nodeId} attached (${nodes.size} nodes)`);
+}
+
+function detachNode(nodeId) {
+    if (!nodes.delete(nodeId)) return;
+    const released = [];
+    directory.forEach((owners, deviceId) => {
+        if (owners.has(nodeId)) released.push([deviceId, false]);
+    });
+    applyPresenceBatch(nodeId, released);
+    publishNodes();
+    log.info(`🧩 Cluster node ${nodeId} detached (${nodes.size} nodes)`);
+}
+
+function handleNodeMessage(nodeId, msg) {
+    switch (msg.op) {
+        case 'claim':
+            claim(nodeId, msg.deviceId);
+            break;
+        case 'release':
+            release(nodeId, msg.deviceId);
+            break;
+        case 'presenceBatch':
+            applyPresenceBatch(nodeId, msg.changes);
+            break;
+        case 'deliver': {
+            const target = nodes.get(msg.to);
+            if (target) {
+                target.send(msg);
+                counters.delivered++;
+            } else {
+                counters.undeliverable++;
+            }
+            break;
+        }
+        case 'broadcast':
+        case 'groupcast':
+            sendToOthers(nodeId, msg);
+            counters.broadcasts++;
+            break;
+        case 'group':
+            applyGroupChange(msg.change);
+            sendToOthers(nodeId, msg);
+            break;
+        case 'schedule':
+            applyScheduleChange(msg.change);
+            sendToOthers(nodeId, msg);
+            break;
+    }
+}
+
+// Fork workers and relay their bus traffic; replaces crashed workers
+function startPrimary(workerCount) {
+    const workerNodes = new Map(); // worker.id -> nodeId
+    const workerIndexes = new Map(); // worker.id -> slot index, kept by its replacement
+
+    // The index lets a replacement worker pick up per-worker state (offline queue log)
+    function forkWorker(index) {
+        const worker = cluster.fork({ CLUSTER_WORKER_INDEX: index });
+        workerIndexes.set(worker.id, index);
+    }
+
+    cluster.on('message', (worker, envelope) => {
+        const msg = envelope && envelope.clusterBus;
+        if (!msg) return;
+
+        if (msg.op === 'hello') {
+            workerNodes.set(worker.id, msg.nodeId);
+            attachNode(msg.nodeId, { send: m => worker.isConnected() && worker.send({ clusterBus: m }) });
+            return;
+        }
+        const nodeId = workerNodes.get(worker.id);
+        if (nodeId) handleNodeMessage(nodeId, msg);
+    });
+
+    cluster.on('exit', (worker, code, signal) => {
+        const nodeId = workerNodes.get(worker.id);
+        const index = workerIndexes.get(worker.id);
+        workerNodes.delete(worker.id);
+        workerIndexes.delete(worker.id);
+        if (nodeId) detachNode(nodeId);
+
+        log.error(`❌ Worker ${worker.process.pid} exited (${signal || code}), restarting`);
+        setTimeout(() => forkWorker(index), WORKER_RESTART_DELAY);
+    });
+
+    for (let i = 0; i < workerCount; i++) {
+        forkWorker(i);
+    }
+    log.info(`🧩 Cluster primary ${process.pid} started ${workerCount} workers`);
+}
+
+function secretMatches(secret) {
+    if (typeof secret !== 'string') return false;
+    const digest = value => crypto.createHash('sha256').update(value).digest();
+    return crypto.timingSafeEqual(digest(secret), digest(CLUSTER_SECRET));
+}
+
+// Accept nodes running on other hosts (CLUSTER_HUB=host:port on their side)
+function listenForNodes(port) {
+    if (!CLUSTER_SECRET) {
+        log.error('❌ CLUSTER_HUB_PORT needs CLUSTER_SECRET; not accepting remote nodes');
+        return null;
+    }
+
+    const server = net.createServer((socket) => {
+        socket.setNoDelay(true);
+        socket.setKeepAlive(true, 10000);
+        let nodeId = null;
+        let refused = false;
+        let buffered = '';
+        const node = { send: msg => socket.write(JSON.stringify(msg) + '\n') };
+
+        socket.on('data', (chunk) => {
+            if (refused) return;
+            buffered += chunk.toString();
+            if (!nodeId && buffered.length > MAX_UNAUTHENTICATED_BYTES) {
+                socket.destroy();
+                return;
+            }
+            let newline;
+            while ((newline = buffered.indexOf('\n')) >= 0) {
+                const line = buffered.slice(0, newline);
+                buffered = buffered.slice(newline + 1);
+
+                let msg;
+                try {
+                    msg = JSON.parse(line);
+                } catch (e) {
+                    log.error(() => `❌ Invalid message from cluster node ${nodeId || 'unknown'}: ${e.message}`);
+                    continue;
+                }
+
+                if (msg.op === 'hello' && !nodeId) {
+                    // A node that lost its link is detached once the old socket closes;
+                    // until then its reconnects are refused rather than replacing it
+                    const reason = !secretMatches(msg.secret) ? 'invalid secret' :
+                        typeof msg.nodeId !== 'string' || !msg.nodeId ? 'missing node id' :
+                        nodes.has(msg.nodeId) ? `node ${msg.nodeId} is already attached` : null;
+                    if (reason) {
+                        log.warn(`⚠️ Refused cluster node from ${socket.remoteAddress}: ${reason}`);
+                        refused = true;
+                        socket.end(JSON.stringify({ op: 'rejected', reason }) + '\n', () => socket.destroy());
+                        return;
+                    }
+                    nodeId = msg.nodeId;
+                    attachNode(nodeId, node);
+                } else if (nodeId) {
+                    handleNodeMessage(nodeId, msg);
+                }
+            }
+        });
+
+        socket.on('error', (err) => {
+            log.error(() => `❌ Cluster node ${nodeId || 'unknown'} connection error: ${err.message}`);
+        });
+
+        socket.on('close', () => {
+            // A reconnect may already have replaced this link
+            if (nodeId && nodes.get(nodeId) === node) detachNode(nodeId);
+        });
+    });
+
+    server.listen(port, CLUSTER_HUB_HOST, () => {
+        log.info(`🧩 Cluster hub accepting nodes on ${CLUSTER_HUB_HOST}:${port}`);
+    });
+    return server;
+}
+
+function stats() {
+    return {
+        nodes: Array.from(nodes.keys()),
+        devices: directory.size,
+        groups: groups.size,
+        schedules: schedules.size,
+        ...counters
+    };
+}
+
+module.exports = {
+    startPrimary,
+    listenForNodes,
+    stats
+};
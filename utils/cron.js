@@ -0,0 +1,125 @@
+// Five-field cron expressions for the scheduler, evaluated in server local time (TZ):
+//
+//   minute hour day-of-month month day-of-week
+//
+// Fields take *, values, ranges (1-5), steps (*/15, 0-30/10), lists (1,15,30) and
+// names for months and weekdays (JAN, MON). Day-of-week 0 and 7 are Sunday. As in
+// standard cron, when both day fields are restricted a day matching either one runs.
+// @hourly, @daily, @weekly, @monthly and @yearly are accepted as shorthands.
+const MONTH_NAMES = ['JAN', 'FEB', 'MAR', 'APR', 'MAY', 'JUN', 'JUL', 'AUG', 'SEP', 'OCT', 'NOV', 'DEC'];
+const WEEKDAY_NAMES = ['SUN', 'MON', 'TUE', 'WED', 'THU', 'FRI', 'SAT'];
+
+const FIELDS = [
+    { name: 'minute', min: 0, max: 59 },
+    { name: 'hour', min: 0, max: 23 },
+    { name: 'day of month', min: 1, max: 31 },
+    { name: 'month', min: 1, max: 12, names: MONTH_NAMES },
+    { name: 'day of week', min: 0, max: 7, names: WEEKDAY_NAMES }
+];
+
+const SHORTHANDS = {
+    '@hourly': '0 * * * *',
+    '@daily': '0 0 * * *',
+    '@weekly': '0 0 * * 0',
+    '@monthly': '0 0 1 * *',
+    '@yearly': '0 0 1 1 *'
+};
+
+// Expressions like "0 0 30 2 *" never match; give up after this far ahead
+const MAX_SEARCH = 5 * 366 * 24 * 60 * 60 * 1000;
+
+function fieldValue(token, field, part) {
+    if (field.names) {
+        const index = field.names.indexOf(token.toUpperCase());
+        if (index >= 0) return index + (field.name === 'month' ? 1 : 0);
+    }
+    if (!/^\d+$/.test(token)) throw new Error(`Invalid ${field.name} "${part}"`);
+    return Number(token);
+}
+
+// Returns an array indexed by value: true where the field matches
+function parseField(text, field) {
+    const allowed = new Array(field.max + 1).fill(false);
+    text.split(',').forEach((part) => {
+        const [range, stepText] = part.split('/');
+        const step = stepText === undefined ? 1 : Number(stepText);
+        if (!Number.isInteger(step) || step < 1) throw new Error(`Invalid step in ${field.name} "${part}"`);
+
+        let low;
+        let high;
+        if (range === '*') {
+            low = field.min;
+            high = field.max;
+        } else {
+            const [first, last] = range.split('-');
+            low = fieldValue(first, field, part);
+            high = last !== undefined ? fieldValue(last, field, part) : (stepText !== undefined ? field.max : low);
+        }
+        if (low < field.min || high > field.max || low > high) {
+            throw new Error(`${field.name} "${part}" is outside ${field.min}-${field.max}`);
+        }
+        for (let value = low; value <= high; value += step) allowed[value] = true;
+    });
+    return allowed;
+}
+
+// Parsed form used by next(); throws an Error describing the first invalid field
+function parse(expression) {
+    if (typeof expression !== 'string') throw new Error('Cron expression must be a string');
+    const text = SHORTHANDS[expression.trim().toLowerCase()] || expression.trim();
+    const parts = text.split(/\s+/);
+    if (parts.length !== 5) throw new Error('Cron expression needs 5 fields: minute hour day-of-month month day-of-week');
+
+    const [minutes, hours, days, months, weekdays] = parts.map((part, i) => parseField(part, FIELDS[i]));
+    weekdays[0] = weekdays[0] || weekdays[7];
+    return {
+        minutes,
+        hours,
+        days,
+        months,
+        weekdays,
+        // As in Vixie cron, any field starting with '*' (including '*/2') counts as unrestricted
+        anyDay: parts[2].startsWith('*'),
+        anyWeekday: parts[4].startsWith('*')
+    };
+}
+
+function dayMatches(cron, date) {
+    const dayOfMonth = cron.days[date.getDate()];
+    const dayOfWeek = cron.weekdays[date.getDay()];
+    // Both fields restricted: either may match. Otherwise both must, so a
+    // stepped star like '*/2' still limits the days it covers
+    if (cron.anyDay || cron.anyWeekday) return dayOfMonth && dayOfWeek;
+    return dayOfMonth || dayOfWeek;
+}
+
+// First matching minute strictly after `after` (ms), or null if there is none
+function next(cron, after) {
+    const date = new Date(after);
+    date.setSeconds(0, 0);
+    date.setMinutes(date.getMinutes() + 1);
+    const limit = after + MAX_SEARCH;
+
+    // Skip whole months, days and hours that cannot match before checking minutes
+    while (date.getTime() <= limit) {
+        if (!cron.months[date.getMonth() + 1]) {
+            date.setMonth(date.getMonth() + 1, 1);
+            date.setHours(0, 0, 0, 0);
+        } else if (!dayMatches(cron, date)) {
+            date.setDate(date.getDate() + 1);
+            date.setHours(0, 0, 0, 0);
+        } else if (!cron.hours[date.getHours()]) {
+            date.setHours(date.getHours() + 1, 0, 0, 0);
+        } else if (!cron.minutes[date.getMinutes()]) {
+            date.setMinutes(date.getMinutes() + 1, 0, 0);
+        } else {
+            return date.getTime();
+        }
+    }
+    return null;
+}
+
+module.exports = {
+    parse,
+    next
+};
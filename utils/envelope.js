@@ -0,0 +1,205 @@
+// Envelope scanner for inbound device messages.
+// Routing only needs the top-level type, targetId, targetIds, targetGroup and controlData of
+// a message; the payload is passed on untouched. scanEnvelope() walks the raw
+// bytes once, decodes just those fields, and returns the payload as a slice of
+// the original buffer so it can be spliced into outgoing frames without being
+// parsed and re-encoded (see createRawFrame in fanout.js).
+//
+// Structural characters are ASCII, so scanning UTF-8 bytes directly is safe:
+// bytes of multi-byte characters never match them. Every value is checked against
+// the JSON grammar, and the payload must also be valid UTF-8, since its bytes are
+// forwarded to other devices as they are. Anything invalid or not understood (a
+// top-level array, trailing data, a non-object payload) returns null and the
+// caller falls back to JSON.parse, which rejects the message as before.
+const { isUtf8 } = require('buffer');
+
+const QUOTE = 0x22;
+const BACKSLASH = 0x5c;
+const OPEN_BRACE = 0x7b;
+const CLOSE_BRACE = 0x7d;
+const OPEN_BRACKET = 0x5b;
+const CLOSE_BRACKET = 0x5d;
+const COLON = 0x3a;
+const COMMA = 0x2c;
+const MINUS = 0x2d;
+const PLUS = 0x2b;
+const DOT = 0x2e;
+const ZERO = 0x30;
+
+const ESCAPES = new Set(Array.from('"\\/bfnrt', ch => ch.charCodeAt(0)));
+const LITERALS = ['true', 'false', 'null'].map(word => Buffer.from(word));
+
+const ROUTING_FIELDS = new Set(['type', 'targetId', 'targetIds', 'targetGroup', 'controlData']);
+
+function isSpace(c) {
+    return c === 0x20 || c === 0x0a || c === 0x0d || c === 0x09;
+}
+
+function isDigit(c) {
+    return c >= 0x30 && c <= 0x39;
+}
+
+function isHex(c) {
+    return isDigit(c) || (c >= 0x41 && c <= 0x46) || (c >= 0x61 && c <= 0x66);
+}
+
+function skipSpace(buf, i) {
+    while (i < buf.length && isSpace(buf[i])) i++;
+    return i;
+}
+
+// i at the opening quote; index after the closing quote, or -1 if the string is
+// unterminated or not valid JSON (bad escape, raw control character)
+function skipString(buf, i) {
+    for (i++; i < buf.length; i++) {
+        const c = buf[i];
+        if (c === QUOTE) return i + 1;
+        if (c < 0x20) return -1;
+        if (c === BACKSLASH) {
+            const e = buf[++i];
+            if (e === 0x75) { // \uXXXX
+                for (let k = 0; k < 4; k++) {
+                    if (!isHex(buf[++i])) return -1;
+                }
+            } else if (!ESCAPES.has(e)) {
+                return -1;
+            }
+        }
+    }
+    return -1;
+}
+
+// Index after the digits starting at i (at least one), or -1
+function skipDigits(buf, i) {
+    const start = i;
+    while (i < buf.length && isDigit(buf[i])) i++;
+    return i > start ? i : -1;
+}
+
+// -?(0|[1-9]\d*)(\.\d+)?([eE][+-]?\d+)?
+function skipNumber(buf, i) {
+    if (buf[i] === MINUS) i++;
+    if (buf[i] === ZERO) i++;
+    else if ((i = skipDigits(buf, i)) < 0) return -1;
+    if (buf[i] === DOT && (i = skipDigits(buf, i + 1)) < 0) return -1;
+    if (buf[i] === 0x65 || buf[i] === 0x45) {
+        i++;
+        if (buf[i] === PLUS || buf[i] === MINUS) i++;
+        if ((i = skipDigits(buf, i)) < 0) return -1;
+    }
+    return i;
+}
+
+function skipLiteral(buf, i) {
+    for (const literal of LITERALS) {
+        if (buf.length - i >= literal.length && literal.equals(buf.subarray(i, i + literal.length))) {
+            return i + literal.length;
+        }
+    }
+    return -1;
+}
+
+// Index after the JSON value starting at i, or -1 if it is not valid JSON.
+// Containers are checked with an explicit stack, so deep nesting cannot overflow.
+function skipValue(buf, i) {
+    const stack = [];
+    for (;;) {
+        // A value
+        const c = buf[i];
+        if (c === OPEN_BRACE || c === OPEN_BRACKET) {
+            const close = c === OPEN_BRACE ? CLOSE_BRACE : CLOSE_BRACKET;
+            i = skipSpace(buf, i + 1);
+            if (buf[i] === close) {
+                i++;
+            } else {
+                stack.push(close);
+                if (close === CLOSE_BRACE && (i = skipMember(buf, i)) < 0) return -1;
+                continue;
+            }
+        } else if (c === QUOTE) {
+            i = skipString(buf, i);
+        } else if (c === MINUS || isDigit(c)) {
+            i = skipNumber(buf, i);
+        } else {
+            i = skipLiteral(buf, i);
+        }
+        if (i < 0) return -1;
+
+        // What follows it: more members/elements, or the end of containers
+        for (;;) {
+            if (stack.length === 0) return i;
+            i = skipSpace(buf, i);
+            const close = stack[stack.length - 1];
+            if (buf[i] === COMMA) {
+                i = skipSpace(buf, i + 1);
+                if (close === CLOSE_BRACE && (i = skipMember(buf, i)) < 0) return -1;
+                break;
+            }
+            if (buf[i] !== close) return -1;
+            stack.pop();
+            i++;
+        }
+    }
+}
+
+// i at an object member; index of its value, or -1
+function skipMember(buf, i) {
+    if (buf[i] !== QUOTE || (i = skipString(buf, i)) < 0) return -1;
+    i = skipSpace(buf, i);
+    if (buf[i] !== COLON) return -1;
+    return skipSpace(buf, i + 1);
+}
+
+function decodeKey(buf, start, end) {
+    const key = buf.toString('utf8', start + 1, end - 1);
+    return key.includes('\\') ? JSON.parse(buf.toString('utf8', start, end)) : key;
+}
+
+// Returns { type, targetId, targetIds, targetGroup, controlData, payload } where payload is a
+// Buffer slice (undefined if absent), or null if the message needs a full parse
+function scanEnvelope(buf) {
+    const envelope = { type: undefined, targetId: undefined, targetIds: undefined, targetGroup: undefined, controlData: undefined, payload: undefined };
+
+    let i = skipSpace(buf, 0);
+    if (buf[i] !== OPEN_BRACE) return null;
+    i = skipSpace(buf, i + 1);
+    if (buf[i] === CLOSE_BRACE) return skipSpace(buf, i + 1) === buf.length ? envelope : null;
+
+    try {
+        while (i < buf.length) {
+            if (buf[i] !== QUOTE) return null;
+            const keyEnd = skipString(buf, i);
+            if (keyEnd < 0) return null;
+            const key = decodeKey(buf, i, keyEnd);
+
+            i = skipSpace(buf, keyEnd);
+            if (buf[i] !== COLON) return null;
+            const valueStart = skipSpace(buf, i + 1);
+            const valueEnd = skipValue(buf, valueStart);
+            if (valueEnd < 0) return null;
+
+            if (key === 'payload') {
+                if (buf[valueStart] !== OPEN_BRACE || !isUtf8(buf.subarray(valueStart, valueEnd))) return null;
+                envelope.payload = buf.subarray(valueStart, valueEnd);
+            } else if (ROUTING_FIELDS.has(key)) {
+                envelope[key] = JSON.parse(buf.toString('utf8', valueStart, valueEnd));
+            }
+
+            i = skipSpace(buf, valueEnd);
+            if (buf[i] === COMMA) {
+                i = skipSpace(buf, i + 1);
+            } else if (buf[i] === CLOSE_BRACE) {
+                return skipSpace(buf, i + 1) === buf.length ? envelope : null;
+            } else {
+                return null;
+            }
+        }
+    } catch (e) {
+        return null; // A routing field JSON.parse rejects
+    }
+    return null;
+}
+
+module.exports = {
+    scanEnvelope
+};
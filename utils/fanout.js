@@ -0,0 +1,340 @@
+const WebSocket = require('ws');
+const metrics = require('./metrics');
+const log = require('./logger').create('fanout');
+
+// Serialize-once fan-out with per-connection backpressure.
+// A frame wraps one outgoing message. It is JSON-encoded at most once and
+// WebSocket-framed at most once, however many sockets (and MQTT publishes) it
+// goes to. Encoding is lazy, so building a frame for a target that turns out
+// to be offline costs nothing.
+function createFrame(message) {
+    return { message, data: null, wsFrame: null };
+}
+
+const FRAME_END = Buffer.from('}');
+
+// Frame around an already-encoded payload (a slice of the inbound message), so a
+// relayed payload is copied once and never decoded. Same bytes as
+// createFrame({ from, payload[, via] }); `message` is only parsed if someone asks
+// for it (cluster hand-off, offline queue, queue coalescing). The payload must have
+// been validated (scanEnvelope does); if it still fails to parse, the message is
+// handed on without it rather than throwing into the caller.
+function createRawFrame(from, payload, via) {
+    const parts = [Buffer.from(`{"from":${JSON.stringify(from)},"payload":`), payload];
+    if (via) parts.push(Buffer.from(`,"via":${JSON.stringify(via)}`));
+    parts.push(FRAME_END);
+    return {
+        data: Buffer.concat(parts),
+        wsFrame: null,
+        decoded: null,
+        get message() {
+            if (!this.decoded) {
+                try {
+                    this.decoded = JSON.parse(this.data);
+                } catch (e) {
+                    log.error(() => `❌ Relayed payload from ${from} is not valid JSON: ${e.message}`);
+                    this.decoded = via ? { from, via } : { from };
+                }
+            }
+            return this.decoded;
+        }
+    };
+}
+
+// Outbound backpressure. Once a socket has more than HIGH_WATERMARK bytes buffered,
+// further frames wait in a per-connection queue until it drains below LOW_WATERMARK.
+// A full queue is handled according to SEND_QUEUE_POLICY:
+//   drop-oldest - discard the oldest queued frame
+//   coalesce    - frames with the same payload.controlid replace each other (latest state wins),
+//                 otherwise drop-oldest
+//   disconnect  - terminate the connection
+const SEND_QUEUE_POLICY = process.env.SEND_QUEUE_POLICY || 'drop-oldest';
+const HIGH_WATERMARK = parseInt(process.env.SEND_QUEUE_HIGH_WATERMARK) || 1024 * 1024; // 1 MB
+const LOW_WATERMARK = parseInt(process.env.SEND_QUEUE_LOW_WATERMARK) || 256 * 1024;    // 256 KB
+const MAX_QUEUE_LENGTH = parseInt(process.env.SEND_QUEUE_MAX_LENGTH) || 500;
+const DRAIN_POLL_INTERVAL = 100; // Fallback when the raw socket is not reachable
+
+// Send micro-batching for connections that opt in (devices connecting with batch=1).
+// Frames for such a connection are collected until the end of the current tick, or
+// for SEND_BATCH_WINDOW ms, and written as one JSON array frame:
+//   [{"from":"a","payload":{...}},{"from":"b","payload":{...}}]
+// A batch is sent early once it holds SEND_BATCH_MAX_FRAMES frames or
+// SEND_BATCH_MAX_BYTES bytes; a batch of one goes out as a plain frame.
+const SEND_BATCH_WINDOW = parseInt(process.env.SEND_BATCH_WINDOW) || 0;
+const SEND_BATCH_MAX_FRAMES = parseInt(process.env.SEND_BATCH_MAX_FRAMES) || 16;
+const SEND_BATCH_MAX_BYTES = parseInt(process.env.SEND_BATCH_MAX_BYTES) || 4096;
+
+const backloggedSockets = new Set();
+const queueCounters = {
+    queued: 0,
+    dropped: 0,
+    coalesced: 0,
+    disconnected: 0
+};
+
+const pendingBatches = new Set(); // sockets with frames waiting in ws.sendBatch
+let batchTimer = null;
+const batchCounters = {
+    batches: 0,
+    batchedFrames: 0
+};
+
+const framesOut = metrics.counter('relay_frames_out_total', 'Outbound frames written', { protocol: 'websocket' });
+const bytesOut = metrics.counter('relay_bytes_out_total', 'Outbound payload bytes written', { protocol: 'websocket' });
+
+// Encoded JSON as a Buffer; shared by WebSocket sends and aedes publishes
+function frameData(frame) {
+    if (!frame.data) {
+        frame.data = Buffer.from(JSON.stringify(frame.message));
+    }
+    return frame.data;
+}
+
+// Pre-framed sends write the same header+payload buffers to every socket. That is
+// only valid without permessage-deflate, which the relay does not negotiate.
+function canSendPrepared(ws) {
+    return typeof WebSocket.Sender?.frame === 'function' &&
+        typeof ws._sender?.sendFrame === 'function' &&
+        !ws._extensions?.['permessage-deflate'];
+}
+
+function writeFrame(ws, frame) {
+    framesOut.inc();
+    bytesOut.inc(frameData(frame).length);
+    if (canSendPrepared(ws)) {
+        if (!frame.wsFrame) {
+            frame.wsFrame = WebSocket.Sender.frame(frameData(frame), {
+                fin: true,
+                rsv1: false,
+                opcode: 0x01, // text, devices expect WStype_TEXT
+                mask: false,
+                readOnly: true
+            });
+        }
+        ws._sender.sendFrame(frame.wsFrame);
+    } else {
+        ws.send(frameData(frame), { binary: false });
+    }
+}
+
+function coalesceKey(frame) {
+    const controlid = frame.message?.payload?.controlid;
+    return controlid === undefined ? null : String(controlid);
+}
+
+function releaseQueue(ws) {
+    if (!ws.sendQueue) return;
+    clearTimeout(ws.sendQueueTimer);
+    ws.sendQueue = null;
+    ws.sendQueueKeys = null;
+    backloggedSockets.delete(ws);
+}
+
+function waitForDrain(ws) {
+    if (ws._socket && typeof ws._socket.once === 'function') {
+        ws._socket.once('drain', () => flushQueue(ws));
+    } else {
+        ws.sendQueueTimer = setTimeout(() => flushQueue(ws), DRAIN_POLL_INTERVAL);
+    }
+}
+
+function flushQueue(ws) {
+    const queue = ws.sendQueue;
+    if (!queue) return;
+    if (ws.readyState !== WebSocket.OPEN) {
+        releaseQueue(ws);
+        return;
+    }
+    if (ws.bufferedAmount > LOW_WATERMARK) {
+        waitForDrain(ws);
+        return;
+    }
+
+    while (queue.length > 0 && ws.bufferedAmount <= HIGH_WATERMARK) {
+        const entry = queue.shift();
+        if (entry.key !== null) ws.sendQueueKeys.delete(entry.key);
+        writeFrame(ws, entry.frame);
+    }
+
+    if (queue.length > 0) {
+        waitForDrain(ws);
+    } else {
+        releaseQueue(ws);
+    }
+}
+
+// Returns false if the connection was dropped instead
+function queueFrame(ws, frame) {
+    if (!ws.sendQueue) {
+        ws.sendQueue = [];
+        ws.sendQueueKeys = new Map(); // coalesce key -> queued entry
+        backloggedSockets.add(ws);
+        if (!ws.sendQueueCloseHooked) {
+            ws.sendQueueCloseHooked = true;
+            ws.once('close', () => releaseQueue(ws));
+        }
+        waitForDrain(ws);
+    }
+    const queue = ws.sendQueue;
+
+    const key = SEND_QUEUE_POLICY === 'coalesce' ? coalesceKey(frame) : null;
+    if (key !== null && ws.sendQueueKeys.has(key)) {
+        // Latest state wins, keeping the original position in the queue
+        ws.sendQueueKeys.get(key).frame = frame;
+        queueCounters.coalesced++;
+        return true;
+    }
+
+    if (queue.length >= MAX_QUEUE_LENGTH) {
+        if (SEND_QUEUE_POLICY === 'disconnect') {
+            log.warn(() => `⚠️ Send queue full for ${ws.deviceId || 'unknown'}, disconnecting`);
+            queueCounters.disconnected++;
+            releaseQueue(ws);
+            ws.terminate();
+            return false;
+        }
+        const dropped = queue.shift();
+        if (dropped.key !== null) ws.sendQueueKeys.delete(dropped.key);
+        queueCounters.dropped++;
+    }
+
+    const entry = { frame, key };
+    queue.push(entry);
+    if (key !== null) ws.sendQueueKeys.set(key, entry);
+    queueCounters.queued++;
+    return true;
+}
+
+const BATCH_START = Buffer.from('[');
+const BATCH_SEPARATOR = Buffer.from(',');
+const BATCH_END = Buffer.from(']');
+
+function flushBatch(ws) {
+    const frames = ws.sendBatch;
+    ws.sendBatch = null;
+    ws.sendBatchBytes = 0;
+    pendingBatches.delete(ws);
+    if (!frames || ws.readyState !== WebSocket.OPEN) return;
+
+    // Backed up meanwhile: hand the frames to the send queue one by one, in order
+    if (ws.sendQueue || ws.bufferedAmount > HIGH_WATERMARK) {
+        for (const frame of frames) {
+            if (!queueFrame(ws, frame)) return;
+        }
+        return;
+    }
+
+    if (frames.length === 1) {
+        writeFrame(ws, frames[0]);
+        return;
+    }
+    const parts = [BATCH_START];
+    frames.forEach((frame, i) => {
+        if (i > 0) parts.push(BATCH_SEPARATOR);
+        parts.push(frameData(frame));
+    });
+    parts.push(BATCH_END);
+    writeFrame(ws, { message: null, data: Buffer.concat(parts), wsFrame: null });
+    batchCounters.batches++;
+    batchCounters.batchedFrames += frames.length;
+}
+
+function flushBatches() {
+    batchTimer = null;
+    pendingBatches.forEach(flushBatch);
+}
+
+function batchFrame(ws, frame) {
+    if (!ws.sendBatch) {
+        ws.sendBatch = [];
+        ws.sendBatchBytes = 0;
+        pendingBatches.add(ws);
+        if (!batchTimer) {
+            batchTimer = SEND_BATCH_WINDOW > 0 ? setTimeout(flushBatches, SEND_BATCH_WINDOW) : setImmediate(flushBatches);
+        }
+    }
+    ws.sendBatch.push(frame);
+    ws.sendBatchBytes += frameData(frame).length + 1;
+    if (ws.sendBatch.length >= SEND_BATCH_MAX_FRAMES || ws.sendBatchBytes >= SEND_BATCH_MAX_BYTES) {
+        flushBatch(ws);
+    }
+}
+
+// Returns true if the frame was sent or queued for an open socket
+function sendFrame(ws, frame) {
+    if (ws.readyState !== WebSocket.OPEN) return false;
+
+    // Keep ordering: frames already waiting in a batch go out first
+    if (ws.sendBatch) {
+        batchFrame(ws, frame);
+        return true;
+    }
+    // Once a queue exists everything goes through it until it drains
+    if (ws.sendQueue || ws.bufferedAmount > HIGH_WATERMARK) {
+        return queueFrame(ws, frame);
+    }
+    if (ws.batchFrames) {
+        batchFrame(ws, frame);
+        return true;
+    }
+    writeFrame(ws, frame);
+    return true;
+}
+
+// Sends to every open socket in the collection; returns how many got the frame
+function sendFrameToAll(sockets, frame) {
+    let sent = 0;
+    sockets.forEach((ws) => {
+        if (sendFrame(ws, frame)) sent++;
+    });
+    return sent;
+}
+
+function getQueueStats() {
+    let queuedFrames = 0;
+    let maxDepth = 0;
+    backloggedSockets.forEach((ws) => {
+        const depth = ws.sendQueue ? ws.sendQueue.length : 0;
+        queuedFrames += depth;
+        if (depth > maxDepth) maxDepth = depth;
+    });
+
+    return {
+        policy: SEND_QUEUE_POLICY,
+        highWatermark: HIGH_WATERMARK,
+        lowWatermark: LOW_WATERMARK,
+        maxQueueLength: MAX_QUEUE_LENGTH,
+        backloggedConnections: backloggedSockets.size,
+        queuedFrames,
+        maxDepth,
+        ...queueCounters,
+        batching: {
+            window: SEND_BATCH_WINDOW,
+            maxFrames: SEND_BATCH_MAX_FRAMES,
+            maxBytes: SEND_BATCH_MAX_BYTES,
+            ...batchCounters
+        }
+    };
+}
+
+metrics.collect('relay_send_queue_frames', 'gauge', 'Frames waiting in per-connection send queues', () => {
+    let queued = 0;
+    backloggedSockets.forEach((ws) => {
+        queued += ws.sendQueue ? ws.sendQueue.length : 0;
+    });
+    return queued;
+});
+metrics.collect('relay_send_queue_connections', 'gauge', 'Connections with a send queue', () => backloggedSockets.size);
+metrics.collect('relay_send_queue_events_total', 'counter', 'Send queue events by outcome', () =>
+    ['queued', 'dropped', 'coalesced', 'disconnected'].map(outcome => ({ labels: { outcome }, value: queueCounters[outcome] })));
+metrics.collect('relay_send_batches_total', 'counter', 'Array frames written to connections with batching', () => batchCounters.batches);
+metrics.collect('relay_send_batched_frames_total', 'counter', 'Frames combined into array frames', () => batchCounters.batchedFrames);
+
+module.exports = {
+    createFrame,
+    createRawFrame,
+    frameData,
+    sendFrame,
+    sendFrameToAll,
+    getQueueStats
+};
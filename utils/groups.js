@@ -0,0 +1,294 @@
+const fs = require('fs');
+const path = require('path');
+const registry = require('./registry');
+const cluster = require('./cluster');
+const log = require('./logger').create('groups');
+
+// Named device groups for server-side multicast ("line-3/relays").
+// Membership is kept here and changed incrementally. Each group also tracks
+// where its members are connected on this node, updated as they connect and
+// disconnect, so a send resolves to ready-made sets instead of looking up
+// every member:
+//   sockets - WebSocket connections of members on this node (one frame, written to each)
+//   mqtt    - members with an MQTT client on this node
+//   away    - members not connected to this node (on another cluster node, or offline)
+//
+// Changes are { type: 'set' | 'add' | 'remove' | 'delete', name, deviceIds }.
+// In cluster mode they are replicated through the hub, which also hands the
+// current groups to nodes that (re)join. Groups are saved to GROUPS_FILE
+// (default data/groups.json, "none" keeps them in memory only).
+const NAME_PATTERN = /^[\w.:-]+(\/[\w.:-]+)*$/;
+const MAX_NAME_LENGTH = 128;
+const SAVE_DELAY = 1000;
+const GROUPS_FILE = process.env.GROUPS_FILE === 'none' ? null :
+    (process.env.GROUPS_FILE || path.join('data', 'groups.json'));
+
+const groups = new Map();     // name -> { name, members, sockets, mqtt, away, createdAt, updatedAt }
+const membership = new Map(); // deviceId -> Set<group name>
+const EMPTY_SET = new Set();
+let saveTimer = null;
+
+function isValidName(name) {
+    return typeof name === 'string' && name.length <= MAX_NAME_LENGTH && NAME_PATTERN.test(name);
+}
+
+// --- Connection tracking ---
+
+function refreshMember(group, deviceId) {
+    const entry = registry.get(deviceId);
+    if (entry) group.away.delete(deviceId);
+    else group.away.add(deviceId);
+    if (entry && entry.mqttClient) group.mqtt.add(deviceId);
+    else group.mqtt.delete(deviceId);
+}
+
+function addMember(group, deviceId) {
+    if (group.members.has(deviceId)) return false;
+    group.members.add(deviceId);
+    let names = membership.get(deviceId);
+    if (!names) {
+        names = new Set();
+        membership.set(deviceId, names);
+    }
+    names.add(group.name);
+    registry.getSockets(deviceId).forEach(ws => group.sockets.add(ws));
+    refreshMember(group, deviceId);
+    return true;
+}
+
+function removeMember(group, deviceId) {
+    if (!group.members.delete(deviceId)) return false;
+    const names = membership.get(deviceId);
+    names.delete(group.name);
+    if (names.size === 0) membership.delete(deviceId);
+    registry.getSockets(deviceId).forEach(ws => group.sockets.delete(ws));
+    group.mqtt.delete(deviceId);
+    group.away.delete(deviceId);
+    return true;
+}
+
+// Only devices that belong to a group cost anything here
+registry.onConnectionChange((deviceId, ws) => {
+    const names = membership.get(deviceId);
+    if (!names) return;
+    const connected = ws && registry.getSockets(deviceId).has(ws);
+    names.forEach((name) => {
+        const group = groups.get(name);
+        if (ws) {
+            if (connected) group.sockets.add(ws);
+            else group.sockets.delete(ws);
+        }
+        refreshMember(group, deviceId);
+    });
+});
+
+// --- Changes ---
+
+function groupFor(name) {
+    let group = groups.get(name);
+    if (!group) {
+        const now = Date.now();
+        group = { name, members: new Set(), sockets: new Set(), mqtt: new Set(), away: new Set(), createdAt: now, updatedAt: now };
+        groups.set(name, group);
+    }
+    return group;
+}
+
+function deleteGroup(name) {
+    const group = groups.get(name);
+    if (!group) return false;
+    Array.from(group.members).forEach(deviceId => removeMember(group, deviceId));
+    groups.delete(name);
+    return true;
+}
+
+// Returns { added, removed } for the change
+function apply(change) {
+    const result = { added: 0, removed: 0 };
+    if (change.type === 'delete') {
+        if (deleteGroup(change.name)) result.removed = 1;
+        return result;
+    }
+    // Removing members never creates a group
+    if (change.type === 'remove' && !groups.has(change.name)) return result;
+
+    const group = groupFor(change.name);
+    if (change.type === 'set') {
+        const wanted = new Set(change.deviceIds);
+        Array.from(group.members).forEach((deviceId) => {
+            if (!wanted.has(deviceId) && removeMember(group, deviceId)) result.removed++;
+        });
+    }
+    change.deviceIds.forEach((deviceId) => {
+        if (change.type === 'remove') {
+            if (removeMember(group, deviceId)) result.removed++;
+        } else if (addMember(group, deviceId)) {
+            result.added++;
+        }
+    });
+    group.updatedAt = Date.now();
+    return result;
+}
+
+// A change made on this node: applied, replicated and saved
+function change(type, name, deviceIds = []) {
+    const item = { type, name, deviceIds: Array.from(new Set(deviceIds.map(String))) };
+    const result = apply(item);
+    cluster.publishGroupChange(item);
+    scheduleSave();
+    log.debug(() => `👥 Group ${name} ${type}: +${result.added} -${result.removed}`);
+    return result;
+}
+
+function set(name, deviceIds) {
+    return change('set', name, deviceIds);
+}
+
+// null if the group does not exist and there is nothing to add
+function update(name, { add = [], remove = [] }) {
+    if (add.length === 0 && !groups.has(name)) return null;
+    const result = { added: 0, removed: 0 };
+    if (add.length > 0) result.added = change('add', name, add).added;
+    if (remove.length > 0) result.removed = change('remove', name, remove).removed;
+    return result;
+}
+
+function remove(name) {
+    if (!groups.has(name)) return false;
+    change('delete', name);
+    return true;
+}
+
+// Changes made on other nodes, and the hub's groups when this node (re)joins
+cluster.onGroupChange((item) => {
+    if (item.type !== 'snapshot') {
+        apply(item);
+        scheduleSave();
+        return;
+    }
+    const known = new Set();
+    item.groups.forEach(({ name, deviceIds }) => {
+        known.add(name);
+        apply({ type: 'set', name, deviceIds });
+    });
+    // Groups the hub does not have (it restarted) are handed back to it
+    groups.forEach((group, name) => {
+        if (!known.has(name)) cluster.publishGroupChange({ type: 'set', name, deviceIds: Array.from(group.members) });
+    });
+    scheduleSave();
+});
+
+// --- Persistence ---
+
+function save() {
+    saveTimer = null;
+    if (!GROUPS_FILE) return;
+    const data = Array.from(groups.values(), group => ({
+        name: group.name,
+        deviceIds: Array.from(group.members),
+        createdAt: group.createdAt,
+        updatedAt: group.updatedAt
+    }));
+    // Cluster workers on one host share the file; each writes the same groups
+    const temp = `${GROUPS_FILE}.${process.pid}.tmp`;
+    try {
+        fs.writeFileSync(temp, JSON.stringify({ groups: data }));
+        fs.renameSync(temp, GROUPS_FILE);
+    } catch (e) {
+        log.error(() => `❌ Could not save groups to ${GROUPS_FILE}: ${e.message}`);
+    }
+}
+
+function scheduleSave() {
+    if (GROUPS_FILE && !saveTimer) saveTimer = setTimeout(save, SAVE_DELAY);
+}
+
+function load() {
+    if (!GROUPS_FILE) return;
+    fs.mkdirSync(path.dirname(GROUPS_FILE), { recursive: true });
+    if (!fs.existsSync(GROUPS_FILE)) return;
+
+    const data = JSON.parse(fs.readFileSync(GROUPS_FILE, 'utf8'));
+    data.groups.forEach(({ name, deviceIds, createdAt, updatedAt }) => {
+        apply({ type: 'set', name, deviceIds });
+        const group = groups.get(name);
+        group.createdAt = createdAt || group.createdAt;
+        group.updatedAt = updatedAt || group.updatedAt;
+    });
+    if (groups.size > 0) log.info(`👥 Restored ${groups.size} device groups`);
+}
+
+process.on('exit', () => {
+    if (saveTimer) {
+        clearTimeout(saveTimer);
+        save();
+    }
+});
+
+try {
+    load();
+} catch (e) {
+    log.error(() => `❌ Could not restore groups from ${GROUPS_FILE}: ${e.message}`);
+}
+
+// --- Reads ---
+
+// Internal view used for delivery (utils/mqtt.js); null if the group does not exist
+function resolve(name) {
+    return groups.get(name) || null;
+}
+
+function memberIds(name) {
+    const group = groups.get(name);
+    return group ? group.members : EMPTY_SET;
+}
+
+function describe(group) {
+    return {
+        name: group.name,
+        members: group.members.size,
+        connectedHere: group.members.size - group.away.size,
+        connections: group.sockets.size + group.mqtt.size,
+        createdAt: new Date(group.createdAt).toISOString(),
+        updatedAt: new Date(group.updatedAt).toISOString()
+    };
+}
+
+function list() {
+    return Array.from(groups.values(), describe);
+}
+
+function get(name) {
+    const group = groups.get(name);
+    if (!group) return null;
+    return {
+        ...describe(group),
+        deviceIds: Array.from(group.members),
+        away: Array.from(group.away)
+    };
+}
+
+function groupsOf(deviceId) {
+    return Array.from(membership.get(deviceId) || EMPTY_SET);
+}
+
+function stats() {
+    return {
+        groups: groups.size,
+        devicesInGroups: membership.size,
+        file: GROUPS_FILE
+    };
+}
+
+module.exports = {
+    isValidName,
+    set,
+    update,
+    remove,
+    resolve,
+    memberIds,
+    list,
+    get,
+    groupsOf,
+    stats
+};
@@ -0,0 +1,157 @@
+const log = require('./logger').create('heartbeat');
+const metrics = require('./metrics');
+
+// Staggered liveness checks on a timer wheel.
+// Connections are spread round-robin over HEARTBEAT_SLOTS slots and the wheel
+// visits one slot per tick, so each connection is checked once per
+// HEARTBEAT_INTERVAL without pinging everything in the same instant.
+// A visit does one of three things, based on how long the connection has been quiet:
+//   quiet < interval / 2  - recently active, no ping needed
+//   quiet < timeout       - ping (protocols that support it)
+//   quiet >= timeout      - zombie, terminate
+// Inbound traffic of any kind (messages, pongs) counts as activity.
+const HEARTBEAT_INTERVAL = parseInt(process.env.HEARTBEAT_INTERVAL) || 30000;
+const HEARTBEAT_SLOTS = parseInt(process.env.HEARTBEAT_SLOTS) || 30;
+const TICK = Math.max(Math.floor(HEARTBEAT_INTERVAL / HEARTBEAT_SLOTS), 10);
+const RECENT_ACTIVITY = HEARTBEAT_INTERVAL / 2;
+
+// Per-protocol behaviour for connections on the wheel
+const PROTOCOLS = {
+    websocket: {
+        timeout: parseInt(process.env.HEARTBEAT_WEBSOCKET_TIMEOUT) || 45000,
+        ping: ws => ws.ping(),
+        terminate: ws => ws.terminate()
+    },
+    admin: {
+        timeout: parseInt(process.env.HEARTBEAT_ADMIN_TIMEOUT) || 45000,
+        ping: ws => ws.ping(),
+        terminate: ws => ws.terminate()
+    }
+};
+
+// MQTT clients stay off the wheel: the broker cannot ping them (PINGREQ is
+// client-initiated) and aedes already closes a client that is silent for one and
+// a half of its keepalive periods. Those closes are only counted here.
+const BROKER_TIMEOUTS = {
+    mqtt: 'keepalive x 1.5 (aedes)'
+};
+
+const wheel = Array.from({ length: HEARTBEAT_SLOTS }, () => new Set());
+let cursor = 0;
+let nextSlot = 0;
+let timer = null;
+
+// Coarse clock updated once per tick; activity stamps do not need better resolution
+let clock = Date.now();
+
+const counters = {};
+Object.keys(PROTOCOLS).forEach((protocol) => {
+    counters[protocol] = { connections: 0, pingsSent: 0, pingsSkipped: 0, zombies: 0 };
+});
+Object.keys(BROKER_TIMEOUTS).forEach((protocol) => {
+    counters[protocol] = { zombies: 0 };
+});
+
+function track(conn, protocol, label) {
+    if (conn.heartbeat) return;
+    const slot = nextSlot;
+    nextSlot = (nextSlot + 1) % HEARTBEAT_SLOTS;
+
+    conn.heartbeat = { slot, protocol, label, lastSeen: clock };
+    wheel[slot].add(conn);
+    counters[protocol].connections++;
+}
+
+function untrack(conn) {
+    const state = conn.heartbeat;
+    if (!state || !wheel[state.slot].delete(conn)) return;
+    counters[state.protocol].connections--;
+}
+
+// Record inbound activity; called on the hot path, so it only stores a number
+function touch(conn) {
+    if (conn.heartbeat) conn.heartbeat.lastSeen = clock;
+}
+
+function visit(conn) {
+    const state = conn.heartbeat;
+    const protocol = PROTOCOLS[state.protocol];
+    const stats = counters[state.protocol];
+    const quiet = clock - state.lastSeen;
+
+    if (quiet >= protocol.timeout) {
+        stats.zombies++;
+        log.info(() => `💀 Terminating zombie ${state.protocol} connection: ${state.label || 'unknown'} (quiet ${Math.round(quiet / 1000)}s)`);
+        untrack(conn);
+        protocol.terminate(conn);
+    } else if (quiet < RECENT_ACTIVITY || !protocol.ping) {
+        stats.pingsSkipped++;
+    } else {
+        stats.pingsSent++;
+        try {
+            protocol.ping(conn);
+        } catch (e) {
+            // Socket closing underneath us; the close handler untracks it
+        }
+    }
+}
+
+// A connection the broker timed out on its own (see BROKER_TIMEOUTS)
+function expired(protocol, label) {
+    counters[protocol].zombies++;
+    log.info(() => `💀 ${protocol} connection timed out by the broker: ${label || 'unknown'}`);
+}
+
+function tick() {
+    clock = Date.now();
+    const slot = wheel[cursor];
+    cursor = (cursor + 1) % HEARTBEAT_SLOTS;
+    slot.forEach(visit);
+}
+
+function start() {
+    if (timer) return;
+    timer = setInterval(tick, TICK);
+    log.info(`💓 Heartbeat started (interval: ${HEARTBEAT_INTERVAL}ms over ${HEARTBEAT_SLOTS} slots)`);
+}
+
+function stop() {
+    clearInterval(timer);
+    timer = null;
+}
+
+function stats() {
+    const protocols = {};
+    Object.keys(PROTOCOLS).forEach((protocol) => {
+        protocols[protocol] = { timeout: PROTOCOLS[protocol].timeout, ...counters[protocol] };
+    });
+    Object.keys(BROKER_TIMEOUTS).forEach((protocol) => {
+        protocols[protocol] = { timeout: BROKER_TIMEOUTS[protocol], ...counters[protocol] };
+    });
+    return {
+        interval: HEARTBEAT_INTERVAL,
+        slots: HEARTBEAT_SLOTS,
+        protocols
+    };
+}
+
+metrics.collect('relay_heartbeat_terminations_total', 'counter', 'Connections terminated as unresponsive', () =>
+    Object.keys(counters).map(protocol => ({ labels: { protocol }, value: counters[protocol].zombies })));
+metrics.collect('relay_heartbeat_pings_total', 'counter', 'Heartbeat visits by outcome', () => {
+    const series = [];
+    Object.keys(PROTOCOLS).forEach((protocol) => {
+        series.push({ labels: { protocol, outcome: 'sent' }, value: counters[protocol].pingsSent });
+        series.push({ labels: { protocol, outcome: 'skipped' }, value: counters[protocol].pingsSkipped });
+    });
+    return series;
+});
+
+module.exports = {
+    track,
+    untrack,
+    touch,
+    expired,
+    start,
+    stop,
+    stats
+};
@@ -1 +1,170 @@
+const fs = require('fs');
+const util = require('util');
 
+// Leveled, sampled, rate-limited logger with a buffered asynchronous sink.
+//
+//   const log = require('./logger').create('routing');
+//   log.debug(() => `📨 Message forwarded from ${from} to ${to}`);
+//
+// Messages may be passed as a function; it only runs once the line is known to
+// be written, so disabled or sampled-out lines cost a level check and nothing more.
+//
+// Configuration (environment):
+//   LOG_LEVEL       error | warn | info | debug | trace (default info)
+//   LOG_LEVELS      per-category overrides, e.g. "routing=debug,mqtt.publish=warn"
+//   LOG_SAMPLE      per-category sample rates for info and below, e.g. "routing=0.01"
+//   LOG_RATE_LIMIT  max lines per second per category (default 200, 0 = unlimited)
+const LEVELS = { error: 0, warn: 1, info: 2, debug: 3, trace: 4 };
+
+const FLUSH_INTERVAL = 50;          // ms between sink flushes
+const MAX_BUFFERED_BYTES = 64 * 1024; // flush early once this much is pending
+
+function parseLevel(name, fallback) {
+    return Object.prototype.hasOwnProperty.call(LEVELS, name) ? LEVELS[name] : fallback;
+}
+
+// "a=1,b=2" -> Map { a => '1', b => '2' }
+function parseCategoryList(value) {
+    const map = new Map();
+    (value || '').split(',').forEach((item) => {
+        const [category, setting] = item.split('=').map(s => s && s.trim());
+        if (category && setting) map.set(category, setting);
+    });
+    return map;
+}
+
+const defaultLevel = parseLevel(process.env.LOG_LEVEL, LEVELS.info);
+const categoryLevels = parseCategoryList(process.env.LOG_LEVELS);
+const categorySamples = parseCategoryList(process.env.LOG_SAMPLE);
+const rateLimit = process.env.LOG_RATE_LIMIT !== undefined ?
+    (parseInt(process.env.LOG_RATE_LIMIT) || 0) : 200;
+
+// Buffered sink: lines are joined and written once per flush
+const pending = { out: [], err: [], bytes: 0 };
+let flushTimer = null;
+
+const sinkStats = {
+    written: 0,
+    sampledOut: 0,
+    rateLimited: 0
+};
+
+function flush() {
+    if (flushTimer) {
+        clearTimeout(flushTimer);
+        flushTimer = null;
+    }
+    if (pending.out.length > 0) {
+        process.stdout.write(pending.out.join(''));
+        pending.out = [];
+    }
+    if (pending.err.length > 0) {
+        process.stderr.write(pending.err.join(''));
+        pending.err = [];
+    }
+    pending.bytes = 0;
+}
+
+// Synchronous flush for process exit, when async writes would be lost
+function flushSync() {
+    if (flushTimer) {
+        clearTimeout(flushTimer);
+        flushTimer = null;
+    }
+    try {
+        if (pending.out.length > 0) fs.writeSync(1, pending.out.join(''));
+        if (pending.err.length > 0) fs.writeSync(2, pending.err.join(''));
+    } catch (e) {
+        // Nothing sensible left to do with a failed write at exit
+    }
+    pending.out = [];
+    pending.err = [];
+    pending.bytes = 0;
+}
+
+process.on('exit', flushSync);
+
+function write(level, line) {
+    const target = level <= LEVELS.warn ? pending.err : pending.out;
+    target.push(line + '\n');
+    pending.bytes += line.length + 1;
+    sinkStats.written++;
+
+    if (pending.bytes >= MAX_BUFFERED_BYTES) {
+        flush();
+    } else if (!flushTimer) {
+        flushTimer = setTimeout(flush, FLUSH_INTERVAL);
+        flushTimer.unref();
+    }
+}
+
+function formatArgs(args) {
+    if (typeof args[0] === 'function') {
+        const result = args[0]();
+        return Array.isArray(result) ? util.format(...result) : String(result);
+    }
+    return util.format(...args);
+}
+
+function create(category) {
+    const threshold = parseLevel(categoryLevels.get(category), defaultLevel);
+    const sampleRate = categorySamples.has(category) ?
+        Math.min(Math.max(parseFloat(categorySamples.get(category)) || 0, 0), 1) : 1;
+
+    // Token bucket refilled once per second
+    let tokens = rateLimit;
+    let windowStart = Date.now();
+    let suppressed = 0;
+
+    function allowed(level) {
+        if (rateLimit > 0) {
+            const now = Date.now();
+            if (now - windowStart >= 1000) {
+                windowStart = now;
+                tokens = rateLimit;
+                if (suppressed > 0) {
+                    write(LEVELS.warn, `⏸️ [${category}] ${suppressed} log lines suppressed by rate limit`);
+                    suppressed = 0;
+                }
+            }
+        }
+        if (level > LEVELS.warn && sampleRate < 1 && Math.random() >= sampleRate) {
+            sinkStats.sampledOut++;
+            return false;
+        }
+        if (rateLimit === 0) return true;
+
+        if (tokens <= 0) {
+            suppressed++;
+            sinkStats.rateLimited++;
+            return false;
+        }
+        tokens--;
+        return true;
+    }
+
+    function log(level, args) {
+        if (level > threshold || !allowed(level)) return;
+        write(level, formatArgs(args));
+    }
+
+    return {
+        category,
+        enabled: (levelName) => LEVELS[levelName] <= threshold,
+        error: (...args) => log(LEVELS.error, args),
+        warn: (...args) => log(LEVELS.warn, args),
+        info: (...args) => log(LEVELS.info, args),
+        debug: (...args) => log(LEVELS.debug, args),
+        trace: (...args) => log(LEVELS.trace, args)
+    };
+}
+
+function getStats() {
+    return { ...sinkStats, pendingBytes: pending.bytes };
+}
+
+module.exports = {
+    create,
+    flush,
+    getStats
+};
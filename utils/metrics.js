@@ -0,0 +1,159 @@
+const { performance } = require('perf_hooks');
+
+// Metrics in Prometheus text format (served at /api/metrics).
+//
+//   const metrics = require('./metrics');
+//   const routeTime = metrics.histogram('relay_route_seconds', 'Receive-to-send time', { protocol: 'websocket' });
+//   const start = metrics.now();
+//   ...
+//   routeTime.observeSince(start);
+//
+// Recording is a few arithmetic operations on preallocated arrays, cheap enough
+// for per-message use. Histograms use fixed log-scale buckets (two per power of
+// two, 1µs to ~16s), so any percentile is within ~41% without configuration.
+// Values that other modules already keep (queue depths, heartbeat counters)
+// are read at scrape time through collect() instead of being recorded twice.
+const MIN_MS = 0.001;          // 1µs, lower bound of the first bucket
+const BUCKETS_PER_DOUBLING = 2;
+const BUCKET_COUNT = 48;       // up to MIN_MS * 2^24 ≈ 16.8s
+const EVENT_LOOP_SAMPLE_INTERVAL = 500;
+
+const BOUNDS_SECONDS = Array.from({ length: BUCKET_COUNT }, (v, i) =>
+    MIN_MS * Math.pow(2, (i + 1) / BUCKETS_PER_DOUBLING) / 1000);
+
+const families = new Map(); // name -> { name, type, help, series: [] }
+
+function family(name, type, help) {
+    let entry = families.get(name);
+    if (!entry) {
+        entry = { name, type, help, series: [] };
+        families.set(name, entry);
+    }
+    return entry;
+}
+
+function escapeLabel(value) {
+    return String(value).replace(/\\/g, '\\\\').replace(/"/g, '\\"').replace(/\n/g, '\\n');
+}
+
+function formatLabels(labels, extra) {
+    const pairs = Object.keys(labels || {}).map(key => `${key}="${escapeLabel(labels[key])}"`);
+    if (extra) pairs.push(extra);
+    return pairs.length ? `{${pairs.join(',')}}` : '';
+}
+
+function formatValue(value) {
+    if (value === Infinity) return '+Inf';
+    return Number.isFinite(value) ? String(value) : 'NaN';
+}
+
+// Milliseconds from a monotonic clock; pair with observeSince()
+function now() {
+    return performance.now();
+}
+
+function counter(name, help, labels) {
+    const series = {
+        labels,
+        value: 0,
+        inc(n = 1) {
+            this.value += n;
+        }
+    };
+    family(name, 'counter', help).series.push(series);
+    return series;
+}
+
+function histogram(name, help, labels) {
+    const series = {
+        labels,
+        counts: new Float64Array(BUCKET_COUNT + 1), // last slot is +Inf
+        sum: 0,
+        count: 0,
+        // Duration in milliseconds; exported in seconds
+        observe(ms) {
+            let index = 0;
+            if (ms > MIN_MS) {
+                index = Math.ceil(Math.log2(ms / MIN_MS) * BUCKETS_PER_DOUBLING) - 1;
+                if (index > BUCKET_COUNT) index = BUCKET_COUNT;
+            }
+            this.counts[index]++;
+            this.sum += ms;
+            this.count++;
+        },
+        observeSince(start) {
+            this.observe(performance.now() - start);
+        }
+    };
+    family(name, 'histogram', help).series.push(series);
+    return series;
+}
+
+// Scrape-time values. fn returns a number, or [{ labels, value }] for several series.
+function collect(name, type, help, fn) {
+    family(name, type, help).series.push({ collect: fn });
+}
+
+function renderHistogram(lines, name, series) {
+    let cumulative = 0;
+    for (let i = 0; i < BUCKET_COUNT; i++) {
+        cumulative += series.counts[i];
+        lines.push(`${name}_bucket${formatLabels(series.labels, `le="${+BOUNDS_SECONDS[i].toPrecision(4)}"`)} ${cumulative}`);
+    }
+    lines.push(`${name}_bucket${formatLabels(series.labels, 'le="+Inf"')} ${series.count}`);
+    lines.push(`${name}_sum${formatLabels(series.labels)} ${series.sum / 1000}`);
+    lines.push(`${name}_count${formatLabels(series.labels)} ${series.count}`);
+}
+
+function render() {
+    const lines = [];
+    families.forEach(({ name, type, help, series }) => {
+        lines.push(`# HELP ${name} ${help}`);
+        lines.push(`# TYPE ${name} ${type}`);
+        series.forEach((item) => {
+            if (item.collect) {
+                let values;
+                try {
+                    values = item.collect();
+                } catch (e) {
+                    return;
+                }
+                if (!Array.isArray(values)) values = [{ value: values }];
+                values.forEach(({ labels, value }) => {
+                    lines.push(`${name}${formatLabels(labels)} ${formatValue(value)}`);
+                });
+            } else if (type === 'histogram') {
+                renderHistogram(lines, name, item);
+            } else {
+                lines.push(`${name}${formatLabels(item.labels)} ${formatValue(item.value)}`);
+            }
+        });
+    });
+    return lines.join('\n') + '\n';
+}
+
+// Event loop lag: how late a fixed-interval timer fires
+const eventLoopLag = histogram('relay_event_loop_lag_seconds', 'Delay of a fixed-interval timer beyond its schedule');
+let expected = performance.now() + EVENT_LOOP_SAMPLE_INTERVAL;
+setInterval(() => {
+    const current = performance.now();
+    eventLoopLag.observe(Math.max(0, current - expected));
+    expected = current + EVENT_LOOP_SAMPLE_INTERVAL;
+}, EVENT_LOOP_SAMPLE_INTERVAL).unref();
+
+collect('relay_process_resident_memory_bytes', 'gauge', 'Resident set size', () => process.memoryUsage().rss);
+collect('relay_process_cpu_seconds_total', 'counter', 'CPU time consumed by the process', () => {
+    const cpu = process.cpuUsage();
+    return [
+        { labels: { mode: 'user' }, value: cpu.user / 1e6 },
+        { labels: { mode: 'system' }, value: cpu.system / 1e6 }
+    ];
+});
+
+module.exports = {
+    now,
+    counter,
+    histogram,
+    collect,
+    render
+};
@@ -1,106 +1,170 @@
 const aedes = require('aedes')();
-const WebSocket = require('ws');
 
-// Import the devices map from websocket handler
-const { devices: wsDevices } = require('./websocket');
+// Routing registry shared with the WebSocket handler
+const registry = require('./registry');
+const { createFrame, frameData, sendFrameToAll } = require('./fanout');
+const cluster = require('./cluster');
+const heartbeat = require('./heartbeat');
+const adminStream = require('./adminStream');
+const topicStats = require('./topicStats');
+const offlineQueue = require('./offlineQueue');
+const shadow = require('./shadow');
+const replies = require('./replies');
+const groups = require('./groups');
+const scheduler = require('./scheduler');
+const capture = require('./capture');
+const admission = require('./admission');
+const logger = require('./logger');
+const metrics = require('./metrics');
 
-// MQTT devices storage (similar to WebSocket devices)
-const mqttDevices = new Map();
+const log = logger.create('mqtt');
+const routeLog = logger.create('routing'); // per-message lines, debug level
+const publishLog = logger.create('mqtt.publish'); // raw publish payloads, trace level
 
-// MQTT topics storage
-const mqttTopics = new Map(); // topic -> { subscribers: Set(), lastMessage: timestamp, messageCount: number }
+// MQTT topic statistics live in utils/topicStats.js (indexed by topic, client and prefix)
+const DEFAULT_TOPIC_LIMIT = 100;
 
-// Combined devices function to get all devices (WebSocket + MQTT)
-function getAllDevices() {
-    const allDevices = new Map();
-    
-    // Add WebSocket devices
-    wsDevices.forEach((connections, deviceId) => {
-        allDevices.set(deviceId, {
-            type: 'websocket',
-            connections: connections.length,
-            activeConnections: connections.filter(ws => ws.readyState === WebSocket.OPEN).length
-        });
-    });
-    
-    // Add MQTT devices
-    mqttDevices.forEach((client, deviceId) => {
-        if (allDevices.has(deviceId)) {
-            // Device has both WebSocket and MQTT connections
-            allDevices.get(deviceId).mqttClient = client;
-            allDevices.get(deviceId).type = 'hybrid';
-        } else {
-            allDevices.set(deviceId, {
-                type: 'mqtt',
-                mqttClient: client,
-                connections: 1,
-                activeConnections: 1
-            });
-        }
-    });
-    
-    return allDevices;
+// QoS used when relaying to a device's command topic, per route:
+//   device    - device-to-device traffic (WebSocket->MQTT bridge, MQTT send/batch, cluster)
+//   api       - HTTP API sends
+//   broadcast - broadcasts
+// Override with MQTT_ROUTE_QOS, e.g. "device=0,broadcast=0"
+const ROUTE_QOS = { device: 1, api: 1, broadcast: 1 };
+(process.env.MQTT_ROUTE_QOS || '').split(',').forEach((item) => {
+    const [route, qos] = item.split('=').map(s => s && s.trim());
+    if (route in ROUTE_QOS && ['0', '1', '2'].includes(qos)) ROUTE_QOS[route] = parseInt(qos);
+});
+
+const bridgeStats = {
+    direct: 0,
+    brokered: 0
+};
+
+const framesIn = metrics.counter('relay_frames_in_total', 'Inbound device messages', { protocol: 'mqtt' });
+const bytesIn = metrics.counter('relay_bytes_in_total', 'Inbound device message bytes', { protocol: 'mqtt' });
+const framesOut = metrics.counter('relay_frames_out_total', 'Outbound frames written', { protocol: 'mqtt' });
+const bytesOut = metrics.counter('relay_bytes_out_total', 'Outbound payload bytes written', { protocol: 'mqtt' });
+const parseTime = metrics.histogram('relay_parse_seconds', 'Time to parse an inbound message', { protocol: 'mqtt' });
+const routeTime = metrics.histogram('relay_route_seconds', 'Time from receiving a message to handing it to every target', { protocol: 'mqtt' });
+// From handing a command to the bridge until it is written to the subscriber(s)
+const bridgeTime = {
+    direct: metrics.histogram('relay_mqtt_bridge_seconds', 'Time to deliver a relayed command to MQTT subscribers', { path: 'direct' }),
+    brokered: metrics.histogram('relay_mqtt_bridge_seconds', 'Time to deliver a relayed command to MQTT subscribers', { path: 'brokered' })
+};
+
+function parsePayload(payload) {
+    const start = metrics.now();
+    const parsed = JSON.parse(payload);
+    parseTime.observeSince(start);
+    return parsed;
 }
 
-// Send message to device (WebSocket or MQTT)
-function sendToDevice(deviceId, payload, source = 'api') {
+// Publish a command to one device. When the device's client is the only subscriber
+// that can receive the topic and the delivery is QoS 0, the packet goes straight to
+// that client and skips the broker's topic matching. QoS 1/2 always take the normal
+// aedes.publish path: it stores the outgoing packet that the client's PUBACK/PUBREC
+// is matched against (and that a persistent session resumes from), and a direct
+// write would have none. No authorizeForward hook is configured, so QoS 0 loses nothing.
+function publishCommand(deviceId, client, data, route) {
+    const topic = `device/${deviceId}/commands`;
+    const qos = ROUTE_QOS[route];
+    const start = metrics.now();
+    framesOut.inc();
+    bytesOut.inc(data.length);
+
+    const grantedQos = topicStats.exclusiveSubscriberQos(topic, deviceId);
+    // Same downgrade the broker applies: never above the subscription's QoS
+    const deliveredQos = grantedQos === null ? null : Math.min(qos, grantedQos);
+    if (deliveredQos === 0 && client && !client.closed && typeof client.deliverQoS === 'function') {
+        client.deliverQoS({
+            cmd: 'publish',
+            topic,
+            payload: data,
+            qos: 0,
+            retain: false,
+            dup: false
+        }, () => bridgeTime.direct.observeSince(start));
+        bridgeStats.direct++;
+        return;
+    }
+
+    aedes.publish({ topic, payload: data, qos, retain: false }, () => bridgeTime.brokered.observeSince(start));
+    bridgeStats.brokered++;
+}
+
+// Send a pre-built frame to a device connected to this node (WebSocket or MQTT)
+function sendFrameToLocalDevice(deviceId, frame, route = 'api') {
     const results = { sent: false, connections: 0, protocols: [] };
     
+    const entry = registry.get(deviceId);
+    if (!entry) return results;
+    
     // Try WebSocket first
-    if (wsDevices.has(deviceId)) {
-        const wsConnections = wsDevices.get(deviceId);
-        wsConnections.forEach((socket) => {
-            if (socket.readyState === WebSocket.OPEN) {
-                socket.send(JSON.stringify({ from: source, payload }));
-                results.connections++;
-                results.sent = true;
-                if (!results.protocols.includes('websocket')) {
-                    results.protocols.push('websocket');
-                }
-            }
-        });
+    if (entry.sockets.size > 0) {
+        const sent = sendFrameToAll(entry.sockets, frame);
+        if (sent > 0) {
+            results.connections += sent;
+            results.sent = true;
+            results.protocols.push('websocket');
+        }
     }
     
     // Try MQTT
-    if (mqttDevices.has(deviceId)) {
-        const mqttClient = mqttDevices.get(deviceId);
-        const topic = `device/${deviceId}/commands`;
-        const message = JSON.stringify({ from: source, payload });
-        
-        // Publish to device's command topic
-        aedes.publish({
-            topic,
-            payload: Buffer.from(message),
-            qos: 1,
-            retain: false
-        });
+    if (entry.mqttClient) {
+        // Publish to device's command topic, reusing the same encoded bytes
+        publishCommand(deviceId, entry.mqttClient, frameData(frame), route);
         
         results.connections++;
         results.sent = true;
-        if (!results.protocols.includes('mqtt')) {
-            results.protocols.push('mqtt');
-        }
+        results.protocols.push('mqtt');
     }
     
     return results;
 }
 
-// Broadcast to all devices (WebSocket + MQTT)
-function broadcastToAll(payload, source = 'api_broadcast') {
+// Send a pre-built frame to a device, on this node or another cluster node.
+// If the device is not connected anywhere the message is kept in its offline
+// queue (results.queued) and delivered when it reconnects.
+function sendFrameToDevice(deviceId, frame, route = 'api') {
+    const results = sendFrameToLocalDevice(deviceId, frame, route);
+    if (!results.sent && cluster.forward(deviceId, frame.message)) {
+        results.sent = true;
+        results.connections = 1;
+        results.protocols.push('cluster');
+        results.node = cluster.ownerOf(deviceId);
+    }
+    if (!results.sent) {
+        const queued = offlineQueue.enqueue(deviceId, frame.message);
+        if (queued) {
+            results.queued = true;
+            results.expiresAt = queued.expiresAt;
+        }
+    }
+    return results;
+}
+
+// Send message to device (WebSocket or MQTT)
+// replyTo replaces `from` so the device's feedback comes back to a pending API request
+function sendToDevice(deviceId, payload, source = 'api', replyTo = null) {
+    const route = source.startsWith('api') ? 'api' : 'device';
+    shadow.observeCommand(deviceId, payload);
+    return sendFrameToDevice(deviceId, createFrame({ from: replyTo || source, payload }), route);
+}
+
+// Broadcast a frame to every device connected to this node
+function broadcastFrameLocally(frame) {
     let totalSent = 0;
     const deviceResults = [];
     
-    const allDevices = getAllDevices();
-    
-    allDevices.forEach((deviceInfo, deviceId) => {
-        const result = sendToDevice(deviceId, payload, source);
+    registry.forEachDevice((entry, deviceId) => {
+        const result = sendFrameToLocalDevice(deviceId, frame, 'broadcast');
         if (result.sent) {
             totalSent += result.connections;
             deviceResults.push({
                 deviceId,
                 connections: result.connections,
                 protocols: result.protocols,
-                type: deviceInfo.type
+                type: result.protocols.length > 1 ? 'hybrid' : result.protocols[0]
             });
         }
     });
@@ -108,157 +172,188 @@ function broadcastToAll(payload, source = 'api_broadcast') {
     return { totalSent, deviceResults };
 }
 
+// Broadcast to all devices (WebSocket + MQTT), including other cluster nodes
+function broadcastToAll(payload, source = 'api_broadcast') {
+    // Encoded once, shared by every device and protocol
+    const frame = createFrame({ from: source, payload });
+    
+    const results = broadcastFrameLocally(frame);
+    results.clusterNodes = cluster.broadcast(frame.message);
+    return results;
+}
+
+// Deliver a frame to the members of a group connected to this node: the same
+// encoded bytes go to every WebSocket connection in the group's connection set
+// and to every MQTT member. Returns the number of connections written to.
+function sendFrameToGroupLocally(group, frame, route) {
+    let connections = sendFrameToAll(group.sockets, frame);
+    group.mqtt.forEach((deviceId) => {
+        publishCommand(deviceId, registry.getMqttClient(deviceId), frameData(frame), route);
+        connections++;
+    });
+    return connections;
+}
+
+// Send a frame to every member of a group: members on this node directly, members
+// on other cluster nodes with a single groupcast, offline members through their
+// offline queues. Returns null if the group does not exist.
+function sendFrameToGroup(name, frame, route = 'api') {
+    const group = groups.resolve(name);
+    if (!group) return null;
+
+    const results = {
+        members: group.members.size,
+        connections: sendFrameToGroupLocally(group, frame, route),
+        local: group.members.size - group.away.size,
+        remote: 0,
+        queued: 0,
+        notFound: 0,
+        clusterNodes: 0
+    };
+    group.away.forEach((deviceId) => {
+        if (cluster.ownerOf(deviceId)) {
+            results.remote++;
+        } else if (offlineQueue.enqueue(deviceId, frame.message)) {
+            results.queued++;
+        } else {
+            results.notFound++;
+        }
+    });
+    if (results.remote > 0) results.clusterNodes = cluster.groupcast(name, frame.message);
+    return results;
+}
+
+function sendToGroup(name, payload, source = 'api') {
+    if (payload && payload.commands === 'control_gpio') {
+        groups.memberIds(name).forEach(deviceId => shadow.observeCommand(deviceId, payload));
+    }
+    return sendFrameToGroup(name, createFrame({ from: source, payload }), source.startsWith('api') ? 'api' : 'device');
+}
+
+// Delivery of queued commands once their device is back on this node
+offlineQueue.setDeliverHandler((deviceId, message) =>
+    sendFrameToLocalDevice(deviceId, createFrame(message), 'device').sent);
+
+// Scheduled commands (utils/scheduler.js) arrive from "scheduler"
+scheduler.setDeliverHandler(schedule => schedule.group ?
+    sendToGroup(schedule.group, schedule.payload, 'scheduler') :
+    sendToDevice(schedule.deviceId, schedule.payload, 'scheduler'));
+
+// Delivery for messages routed here by other cluster nodes
+cluster.setHandlers({
+    deliver: (targetId, message) => replies.handleReply(targetId, message.from, message.payload) ||
+        sendFrameToLocalDevice(targetId, createFrame(message), 'device').sent,
+    broadcast: (message) => broadcastFrameLocally(createFrame(message)),
+    groupcast: (name, message) => {
+        const group = groups.resolve(name);
+        if (group) sendFrameToGroupLocally(group, createFrame(message), 'device');
+    }
+});
+
 // Forward MQTT message to WebSocket devices
 function forwardMqttToWebSocket(fromDeviceId, targetId, payload) {
-    console.log(`🔄 Forwarding MQTT message from ${fromDeviceId} to WebSocket device ${targetId}`);
+    routeLog.trace(() => `🔄 Forwarding MQTT message from ${fromDeviceId} to WebSocket device ${targetId}`);
     
-    if (wsDevices.has(targetId)) {
-        const wsConnections = wsDevices.get(targetId);
-        wsConnections.forEach((socket) => {
-            if (socket.readyState === WebSocket.OPEN) {
-                socket.send(JSON.stringify({ 
-                    from: fromDeviceId, 
-                    payload,
-                    via: 'mqtt-to-websocket'
-                }));
-                console.log(`📨 MQTT->WebSocket: Message forwarded from ${fromDeviceId} to ${targetId}`);
-            }
+    if (registry.hasSockets(targetId)) {
+        const frame = createFrame({ 
+            from: fromDeviceId, 
+            payload,
+            via: 'mqtt-to-websocket'
         });
+        if (sendFrameToAll(registry.getSockets(targetId), frame) > 0) {
+            routeLog.debug(() => `📨 MQTT->WebSocket: Message forwarded from ${fromDeviceId} to ${targetId}`);
+        }
         return true;
     }
     return false;
 }
 
 // Forward WebSocket message to MQTT devices
-function forwardWebSocketToMqtt(fromDeviceId, targetId, payload) {
-    console.log(`🔄 Forwarding WebSocket message from ${fromDeviceId} to MQTT device ${targetId}`);
+// Multi-target senders pass a shared frame so the payload is encoded only once
+function forwardWebSocketToMqtt(fromDeviceId, targetId, payload, frame = null) {
+    routeLog.trace(() => `🔄 Forwarding WebSocket message from ${fromDeviceId} to MQTT device ${targetId}`);
     
-    if (mqttDevices.has(targetId)) {
-        const topic = `device/${targetId}/commands`;
-        const message = JSON.stringify({ 
+    const client = registry.getMqttClient(targetId);
+    if (client) {
+        const message = frame || createFrame({ 
             from: fromDeviceId, 
             payload,
             via: 'websocket-to-mqtt'
         });
         
-        aedes.publish({
-            topic,
-            payload: Buffer.from(message),
-            qos: 1,
-            retain: false
-        });
+        publishCommand(targetId, client, frameData(message), 'device');
         
-        console.log(`📨 WebSocket->MQTT: Message forwarded from ${fromDeviceId} to ${targetId}`);
+        routeLog.debug(() => `📨 WebSocket->MQTT: Message forwarded from ${fromDeviceId} to ${targetId}`);
         return true;
     }
     return false;
 }
 
-// Get MQTT topic information
-function getMqttTopics() {
-    const topics = [];
-    
-    mqttTopics.forEach((info, topic) => {
-        topics.push({
-            topic: topic,
-            subscriberCount: info.subscribers.size,
-            lastMessage: info.lastMessage || null,
-            messageCount: info.messageCount || 0
-        });
-    });
-    
-    // Sort by subscriber count (descending) then by topic name
-    topics.sort((a, b) => {
-        if (b.subscriberCount !== a.subscriberCount) {
-            return b.subscriberCount - a.subscriberCount;
-        }
-        return a.topic.localeCompare(b.topic);
-    });
-    
-    return topics;
+// Get MQTT topic information: the busiest `limit` topics by subscriber count
+function getMqttTopics(limit = DEFAULT_TOPIC_LIMIT) {
+    return topicStats.topTopics(limit);
 }
 
 // Function to manually track published topics (for API-initiated publishes)
 function trackPublishedTopic(topic, message) {
-    if (!mqttTopics.has(topic)) {
-        mqttTopics.set(topic, {
-            subscribers: new Set(),
-            messageCount: 0
-        });
-    }
-    
-    const topicInfo = mqttTopics.get(topic);
-    topicInfo.lastMessage = new Date().toISOString();
-    topicInfo.messageCount = (topicInfo.messageCount || 0) + 1;
+    const topicInfo = topicStats.recordMessage(topic);
     
-    console.log(`📊 Topic ${topic} tracked: ${topicInfo.messageCount} messages, ${topicInfo.subscribers.size} subscribers`);
+    publishLog.debug(() => `📊 Topic ${topic} tracked: ${topicInfo.messageCount} messages, ${topicInfo.subscribers.size} subscribers`);
 }
 
 // MQTT Event Handlers
 aedes.on('client', (client) => {
-    console.log(`🔗 MQTT Client ${client.id} connected`);
+    log.info(() => `🔗 MQTT Client ${client.id} connected`);
     
     // Register all connected clients as MQTT devices
     // This ensures that even clients that don't subscribe to command topics are tracked
-    mqttDevices.set(client.id, client);
-    console.log(`✅ MQTT Device ${client.id} registered (connected)`);
+    registry.setMqttClient(client.id, client);
+    capture.open('mqtt', client, client.id);
+    adminStream.markChanged(client.id, 'connected');
+    log.debug(() => `✅ MQTT Device ${client.id} registered (connected)`);
+});
+
+// aedes closes clients that outlive 1.5x their keepalive; the close itself
+// arrives as clientDisconnect, this only feeds the heartbeat counters
+aedes.on('keepaliveTimeout', (client) => {
+    heartbeat.expired('mqtt', client.id);
 });
 
 aedes.on('clientDisconnect', (client) => {
-    console.log(`❌ MQTT Client ${client.id} disconnected`);
+    capture.close('mqtt', client);
+    log.info(() => `❌ MQTT Client ${client.id} disconnected`);
     
-    // Remove from devices map
-    mqttDevices.delete(client.id);
+    // Remove from the routing registry
+    if (registry.removeMqttClient(client.id, client)) {
+        adminStream.markChanged(client.id, 'disconnected');
+    }
     
-    // Remove client from all topic subscriptions
-    mqttTopics.forEach((info, topic) => {
-        if (info.subscribers.has(client.id)) {
-            info.subscribers.delete(client.id);
-            // Clean up empty topics
-            if (info.subscribers.size === 0) {
-                mqttTopics.delete(topic);
-            }
-        }
-    });
+    // Remove client from its topic subscriptions (empty topics are dropped)
+    topicStats.removeClient(client.id);
 });
 
 aedes.on('subscribe', (subscriptions, client) => {
-    console.log(`📡 MQTT Client ${client.id} subscribed to:`, subscriptions.map(s => s.topic));
+    log.debug(() => [`📡 MQTT Client ${client.id} subscribed to:`, subscriptions.map(s => s.topic)]);
     
     // Register device when it subscribes to its command topic
     const commandSubscription = subscriptions.find(s => s.topic.startsWith(`device/${client.id}/commands`));
     if (commandSubscription) {
-        mqttDevices.set(client.id, client);
-        console.log(`✅ MQTT Device ${client.id} registered (subscribed to command topic)`);
+        registry.setMqttClient(client.id, client);
+        log.debug(() => `✅ MQTT Device ${client.id} registered (subscribed to command topic)`);
     }
     
     // Track topic subscriptions
-    subscriptions.forEach(sub => {
-        const topic = sub.topic;
-        if (!mqttTopics.has(topic)) {
-            mqttTopics.set(topic, {
-                subscribers: new Set(),
-                messageCount: 0
-            });
-        }
-        mqttTopics.get(topic).subscribers.add(client.id);
-    });
+    subscriptions.forEach(sub => topicStats.subscribe(client.id, sub.topic, sub.qos));
+    
+    // Commands queued while the device was offline can be published now
+    if (commandSubscription) offlineQueue.drain(client.id);
 });
 
 aedes.on('unsubscribe', (unsubscriptions, client) => {
-    console.log(`🔇 MQTT Client ${client.id} unsubscribed from:`, unsubscriptions);
+    log.debug(() => [`🔇 MQTT Client ${client.id} unsubscribed from:`, unsubscriptions]);
     
-    // Remove client from topic subscriptions
-    unsubscriptions.forEach(topic => {
-        if (mqttTopics.has(topic)) {
-            const info = mqttTopics.get(topic);
-            info.subscribers.delete(client.id);
-            // Clean up empty topics
-            if (info.subscribers.size === 0) {
-                mqttTopics.delete(topic);
-            }
-        }
-    });
+    // Remove client from topic subscriptions (empty topics are dropped)
+    unsubscriptions.forEach(topic => topicStats.unsubscribe(client.id, topic));
 });
 
 aedes.on('publish', (packet, client) => {
@@ -270,29 +365,40 @@ aedes.on('publish', (packet, client) => {
     // Skip logging for system topics
     if (topic.startsWith('$SYS/')) return;
     
-    console.log(`📩 MQTT Message from ${client.id} on topic ${topic}:`, payload);
+    const received = metrics.now();
+    capture.message('mqtt', client, packet.payload, topic);
+    framesIn.inc();
+    bytesIn.inc(packet.payload.length);
     
-    // Update topic information
-    if (!mqttTopics.has(topic)) {
-        mqttTopics.set(topic, {
-            subscribers: new Set(),
-            messageCount: 0
-        });
-    }
+    publishLog.trace(() => `📩 MQTT Message from ${client.id} on topic ${topic}: ${payload}`);
     
-    const topicInfo = mqttTopics.get(topic);
-    topicInfo.lastMessage = new Date().toISOString();
-    topicInfo.messageCount = (topicInfo.messageCount || 0) + 1;
+    // Update topic information
+    topicStats.recordMessage(topic);
     
     try {
         // Handle different topic patterns
         if (topic.startsWith('device/') && topic.endsWith('/status')) {
             // Device status updates
-            console.log(`📊 Device ${client.id} status:`, payload);
+            publishLog.debug(() => `📊 Device ${client.id} status: ${payload}`);
             
         } else if (topic.startsWith('device/') && topic.endsWith('/data')) {
             // Device data/sensor readings
-            console.log(`📈 Device ${client.id} data:`, payload);
+            publishLog.debug(() => `📈 Device ${client.id} data: ${payload}`);
+            
+        } else if (topic.startsWith('device/') && topic.split('/')[2] === 'group') {
+            // Multicast to a named group
+            // Topic format: device/{fromDeviceId}/group/{groupName}, the name may contain slashes
+            const pathParts = topic.split('/');
+            const groupName = pathParts.slice(3).join('/');
+            
+            if (groupName && pathParts[1] === client.id) {
+                const results = sendToGroup(groupName, parsePayload(payload), client.id);
+                if (!results) {
+                    routeLog.warn(() => `⚠️ Target group ${groupName} not found`);
+                } else {
+                    routeLog.debug(() => `👥 MQTT group message from ${client.id} to ${groupName} (${results.connections} connections)`);
+                }
+            }
             
         } else if (topic.startsWith('device/') && topic.includes('/send/')) {
             // Device-to-device communication via MQTT
@@ -302,16 +408,21 @@ aedes.on('publish', (packet, client) => {
             const targetDeviceId = pathParts[3];
             
             if (targetDeviceId && fromDeviceId === client.id) {
-                const messageData = JSON.parse(payload);
+                const messageData = parsePayload(payload);
+                shadow.observeReport(fromDeviceId, messageData);
                 
-                // Try to forward to WebSocket device first
-                const wsForwarded = forwardWebSocketToMqtt(fromDeviceId, targetDeviceId, messageData);
+                // Feedback to a synchronous API request is handed to it, not routed
+                if (!replies.handleReply(targetDeviceId, fromDeviceId, messageData)) {
+                    // Try to forward to WebSocket device first
+                    const wsForwarded = forwardWebSocketToMqtt(fromDeviceId, targetDeviceId, messageData);
+                    if (wsForwarded) shadow.observeCommand(targetDeviceId, messageData);
                 
-                // If not found in WebSocket, try MQTT
-                if (!wsForwarded) {
-                    const mqttForwarded = sendToDevice(targetDeviceId, messageData, fromDeviceId);
-                    if (!mqttForwarded.sent) {
-                        console.error(`⚠️ Target device ${targetDeviceId} not found in either WebSocket or MQTT`);
+                    // If not found in WebSocket, try MQTT
+                    if (!wsForwarded) {
+                        const mqttForwarded = sendToDevice(targetDeviceId, messageData, fromDeviceId);
+                        if (!mqttForwarded.sent && !mqttForwarded.queued) {
+                            routeLog.warn(() => `⚠️ Target device ${targetDeviceId} not found in either WebSocket or MQTT`);
+                        }
                     }
                 }
             }
@@ -319,18 +430,18 @@ aedes.on('publish', (packet, client) => {
         } else if (topic.startsWith('device/') && topic.includes('/broadcast')) {
             // Broadcast from MQTT device to all devices (WebSocket + MQTT)
             const fromDeviceId = client.id;
-            const messageData = JSON.parse(payload);
+            const messageData = parsePayload(payload);
             
-            console.log(`📢 MQTT Broadcast from ${fromDeviceId}`);
+            routeLog.debug(() => `📢 MQTT Broadcast from ${fromDeviceId}`);
             broadcastToAll(messageData, fromDeviceId);
             
         } else if (topic.startsWith('device/') && topic.includes('/batch')) {
             // Batch commands from MQTT device
             const fromDeviceId = client.id;
-            const batchData = JSON.parse(payload);
+            const batchData = parsePayload(payload);
             
             if (batchData.controlData && Array.isArray(batchData.controlData)) {
-                console.log(`🔄 MQTT Batch from ${fromDeviceId}: ${batchData.controlData.length} items`);
+                routeLog.debug(() => `🔄 MQTT Batch from ${fromDeviceId}: ${batchData.controlData.length} items`);
                 
                 batchData.controlData.forEach(({ targetId, payload: itemPayload }) => {
                     if (targetId) {
@@ -340,12 +451,18 @@ aedes.on('publish', (packet, client) => {
             }
         }
     } catch (e) {
-        console.error('❌ Error processing MQTT message:', e);
+        routeLog.error(() => ['❌ Error processing MQTT message on %s: %s', topic, e.message]);
     }
+    routeTime.observeSince(received);
 });
 
 // Setup function to be called from server.js
 function setupMQTT(httpServer) {
+    // New MQTT connections share the WebSocket accept budget (utils/admission.js)
+    aedes.preConnect = (client, packet, callback) => {
+        admission.admit(accepted => callback(null, accepted));
+    };
+
     const mqttServer = require('net').createServer(aedes.handle);
     
     // MQTT over TCP (port 1883)
@@ -370,15 +487,20 @@ function setupMQTT(httpServer) {
     return { aedes, mqttServer, wsServer };
 }
 
+metrics.collect('relay_mqtt_bridge_total', 'counter', 'Commands relayed to MQTT devices by path', () =>
+    [{ labels: { path: 'direct' }, value: bridgeStats.direct }, { labels: { path: 'brokered' }, value: bridgeStats.brokered }]);
+
 module.exports = {
     setupMQTT,
-    getAllDevices,
     sendToDevice,
+    sendFrameToDevice,
+    sendToGroup,
+    sendFrameToGroup,
     broadcastToAll,
     forwardMqttToWebSocket,
     forwardWebSocketToMqtt,
-    mqttDevices,
     aedes,
     getMqttTopics,
-    trackPublishedTopic
+    trackPublishedTopic,
+    getBridgeStats: () => ({ routeQos: ROUTE_QOS, ...bridgeStats })
 };
@@ -0,0 +1,368 @@
+const fs = require('fs');
+const path = require('path');
+const registry = require('./registry');
+const cluster = require('./cluster');
+const replies = require('./replies');
+const metrics = require('./metrics');
+const log = require('./logger').create('offline');
+
+// Store-and-forward for commands addressed to devices that are not connected.
+// Instead of being dropped, a command is kept per device for OFFLINE_QUEUE_TTL
+// and delivered in order, in batches, when the device comes back: on WebSocket
+// connect, on MQTT subscription to its command topic, or when it shows up on
+// another cluster node.
+//
+// Only devices that have connected at least once (here or on another cluster
+// node) get a queue. Ids nothing ever connected under - typos, the relay's own
+// sender names that devices address their feedback to - are refused, so they
+// neither fill the queues nor turn a "not found" into "queued".
+//
+// Queues are backed by an append-only log (one JSON record per line):
+//   { op: 'q', id, d: deviceId, m: message, t: queuedAt, e: expiresAt }   queued
+//   { op: 'x', id }                                                       delivered, expired or dropped
+//   { op: 'k', d: deviceId }                                              device seen for the first time
+// Records are appended in batches, and the log is rewritten with only the live
+// entries once dead records outnumber them, so it stays proportional to the backlog.
+// On startup the log is replayed and expired entries are discarded.
+//
+// Configuration (environment):
+//   OFFLINE_QUEUE_TTL         ms a command is kept (default 300000, 0 disables queueing)
+//   OFFLINE_QUEUE_MAX_LENGTH  commands kept per device, oldest dropped first (default 100)
+//   OFFLINE_QUEUE_MAX_TOTAL   commands kept across all devices (default 10000)
+//   OFFLINE_QUEUE_FILE        log path (default data/offline-queue.log, "none" keeps queues in memory)
+const TTL = process.env.OFFLINE_QUEUE_TTL !== undefined ?
+    (parseInt(process.env.OFFLINE_QUEUE_TTL) || 0) : 5 * 60 * 1000;
+const MAX_LENGTH = parseInt(process.env.OFFLINE_QUEUE_MAX_LENGTH) || 100;
+const MAX_TOTAL = parseInt(process.env.OFFLINE_QUEUE_MAX_TOTAL) || 10000;
+const DRAIN_BATCH = 50;          // commands sent per turn of the event loop while draining
+const SWEEP_INTERVAL = 10000;    // expiry check for devices that never come back
+const COMPACT_MIN_DEAD = 1000;   // dead records tolerated before the log is rewritten
+const STATUS_HISTORY = 10000;    // devices whose delivery counters are kept after their queue empties
+// `from` of messages the relay originates; feedback sent back to them has nowhere to wait
+const SENDER_IDS = new Set(['api', 'api_batch', 'api_broadcast', 'api_group', 'scheduler', 'server']);
+
+// Cluster workers each keep their own log (the index survives worker restarts)
+function defaultLogFile() {
+    const index = process.env.CLUSTER_WORKER_INDEX;
+    return path.join('data', index !== undefined ? `offline-queue-${index}.log` : 'offline-queue.log');
+}
+const LOG_FILE = process.env.OFFLINE_QUEUE_FILE === 'none' ? null :
+    (process.env.OFFLINE_QUEUE_FILE || defaultLogFile());
+
+const devices = new Map(); // deviceId -> { entries: [], delivered, expired, dropped, lastDeliveredAt, draining }
+const knownDevices = new Set(); // every device that has connected, kept in the log
+let totalQueued = 0;
+let nextId = 1;
+let deliverHandler = null; // (deviceId, message) -> bool, local delivery
+
+const counters = {
+    queued: 0,
+    delivered: 0,
+    expired: 0,
+    dropped: 0,
+    rejected: 0,
+    unknown: 0
+};
+
+// --- Append-only log ---
+
+let pendingRecords = [];
+let writing = false;
+let flushScheduled = false;
+let liveRecords = 0;
+let deadRecords = 0;
+
+function persist(record) {
+    if (!LOG_FILE) return;
+    pendingRecords.push(JSON.stringify(record));
+    if (!flushScheduled && !writing) {
+        flushScheduled = true;
+        setImmediate(flushLog);
+    }
+}
+
+function compact() {
+    const lines = [];
+    knownDevices.forEach(deviceId => lines.push(JSON.stringify({ op: 'k', d: deviceId })));
+    devices.forEach((state, deviceId) => {
+        state.entries.forEach((entry) => {
+            lines.push(JSON.stringify({ op: 'q', id: entry.id, d: deviceId, m: entry.message, t: entry.queuedAt, e: entry.expiresAt }));
+        });
+    });
+    const temp = `${LOG_FILE}.tmp`;
+    fs.writeFileSync(temp, lines.length ? lines.join('\n') + '\n' : '');
+    fs.renameSync(temp, LOG_FILE);
+    // The rewrite reflects current state, which already includes anything pending
+    pendingRecords = [];
+    liveRecords = lines.length;
+    deadRecords = 0;
+}
+
+function flushLog() {
+    flushScheduled = false;
+    if (writing) return;
+
+    if (deadRecords > COMPACT_MIN_DEAD && deadRecords > liveRecords) {
+        try {
+            compact();
+        } catch (e) {
+            log.error(() => `❌ Offline queue log compaction failed: ${e.message}`);
+        }
+        return;
+    }
+    if (pendingRecords.length === 0) return;
+
+    const data = pendingRecords.join('\n') + '\n';
+    pendingRecords = [];
+    writing = true;
+    fs.appendFile(LOG_FILE, data, (err) => {
+        writing = false;
+        if (err) log.error(() => `❌ Offline queue log write failed: ${err.message}`);
+        if (pendingRecords.length > 0) flushLog();
+    });
+}
+
+function load() {
+    if (!LOG_FILE) return;
+    fs.mkdirSync(path.dirname(LOG_FILE), { recursive: true });
+    if (!fs.existsSync(LOG_FILE)) return;
+
+    const records = new Map(); // id -> queued record, in log order
+    fs.readFileSync(LOG_FILE, 'utf8').split('\n').forEach((line) => {
+        if (!line) return;
+        try {
+            const record = JSON.parse(line);
+            if (record.op === 'q') records.set(record.id, record);
+            else if (record.op === 'x') records.delete(record.id);
+            else if (record.op === 'k') knownDevices.add(record.d);
+            if (record.id >= nextId) nextId = record.id + 1;
+        } catch (e) {
+            // A torn last line after a crash; everything before it is intact
+        }
+    });
+
+    const now = Date.now();
+    records.forEach((record) => {
+        // Logs written before devices were recorded: a queue means the device was known
+        knownDevices.add(record.d);
+        if (record.e <= now) return;
+        const state = stateFor(record.d);
+        state.entries.push({ id: record.id, message: record.m, queuedAt: record.t, expiresAt: record.e });
+        totalQueued++;
+    });
+
+    // Start from a log holding only what survived
+    compact();
+    if (totalQueued > 0) {
+        log.info(`📦 Restored ${totalQueued} offline commands for ${devices.size} devices`);
+    }
+}
+
+process.on('exit', () => {
+    if (LOG_FILE && pendingRecords.length > 0) {
+        try {
+            fs.appendFileSync(LOG_FILE, pendingRecords.join('\n') + '\n');
+        } catch (e) {
+            // Nothing left to report to
+        }
+    }
+});
+
+// --- Queues ---
+
+function stateFor(deviceId) {
+    let state = devices.get(deviceId);
+    if (!state) {
+        state = { entries: [], delivered: 0, expired: 0, dropped: 0, lastDeliveredAt: null, draining: false };
+        devices.set(deviceId, state);
+    }
+    return state;
+}
+
+// Keep delivery counters for recently drained devices, but not forever
+function trimHistory(deviceId, state) {
+    if (state.entries.length > 0) return;
+    devices.delete(deviceId);
+    devices.set(deviceId, state); // most recent last
+    if (devices.size <= STATUS_HISTORY) return;
+    for (const [id, other] of devices) {
+        if (other.entries.length === 0) {
+            devices.delete(id);
+            break;
+        }
+    }
+}
+
+function retire(entry, outcome, state) {
+    state[outcome]++;
+    counters[outcome]++;
+    totalQueued--;
+    liveRecords--;
+    deadRecords += 2;
+    persist({ op: 'x', id: entry.id });
+}
+
+function remember(deviceId) {
+    if (knownDevices.has(deviceId) || SENDER_IDS.has(deviceId) || replies.isReplyAddress(deviceId)) return;
+    knownDevices.add(deviceId);
+    liveRecords++;
+    persist({ op: 'k', d: deviceId });
+}
+
+// Queue a command for a device that is not connected anywhere.
+// Returns { id, expiresAt }, or null when queueing is disabled, the queues are full,
+// or the id never connected (reply addresses of utils/replies.js included: one that
+// is not pending has timed out).
+function enqueue(deviceId, message) {
+    if (TTL <= 0 || !deviceId) return null;
+    if (!knownDevices.has(deviceId)) {
+        counters.unknown++;
+        return null;
+    }
+    if (totalQueued >= MAX_TOTAL) {
+        counters.rejected++;
+        return null;
+    }
+
+    const state = stateFor(deviceId);
+    if (state.entries.length >= MAX_LENGTH) {
+        retire(state.entries.shift(), 'dropped', state);
+    }
+
+    const now = Date.now();
+    const entry = { id: nextId++, message, queuedAt: now, expiresAt: now + TTL };
+    state.entries.push(entry);
+    totalQueued++;
+    liveRecords++;
+    counters.queued++;
+    persist({ op: 'q', id: entry.id, d: deviceId, m: message, t: entry.queuedAt, e: entry.expiresAt });
+
+    log.debug(() => `📦 Queued command for offline device ${deviceId} (${state.entries.length} waiting)`);
+    return { id: entry.id, expiresAt: new Date(entry.expiresAt).toISOString() };
+}
+
+function dropExpired(deviceId, state, now) {
+    while (state.entries.length > 0 && state.entries[0].expiresAt <= now) {
+        retire(state.entries.shift(), 'expired', state);
+    }
+    trimHistory(deviceId, state);
+}
+
+// Local devices are sent to directly; devices on another node via the cluster bus
+function deliver(deviceId, message) {
+    if (registry.has(deviceId)) {
+        return deliverHandler ? deliverHandler(deviceId, message) : false;
+    }
+    return cluster.forward(deviceId, message);
+}
+
+function drainBatch(deviceId) {
+    const state = devices.get(deviceId);
+    if (!state) return;
+
+    dropExpired(deviceId, state, Date.now());
+    let sent = 0;
+    while (state.entries.length > 0 && sent < DRAIN_BATCH) {
+        if (!deliver(deviceId, state.entries[0].message)) break; // gone again; keep the rest
+        retire(state.entries.shift(), 'delivered', state);
+        sent++;
+    }
+    if (sent > 0) state.lastDeliveredAt = Date.now();
+
+    if (sent === DRAIN_BATCH && state.entries.length > 0) {
+        setImmediate(() => drainBatch(deviceId));
+        return;
+    }
+    state.draining = false;
+    if (sent > 0) log.info(() => `📬 Delivered queued commands to ${deviceId} (${state.delivered} total, ${state.entries.length} left)`);
+    trimHistory(deviceId, state);
+}
+
+// Start delivering a device's backlog; no-op if there is none or a drain is running
+function drain(deviceId) {
+    const state = devices.get(deviceId);
+    if (!state || state.entries.length === 0 || state.draining) return;
+    state.draining = true;
+    setImmediate(() => drainBatch(deviceId));
+}
+
+function sweep() {
+    const now = Date.now();
+    // dropExpired reorders the map, so walk a snapshot
+    Array.from(devices).forEach(([deviceId, state]) => {
+        if (state.entries.length > 0 && state.entries[0].expiresAt <= now) {
+            dropExpired(deviceId, state, now);
+        }
+    });
+}
+
+// Called by the module that owns local delivery (mqtt.js)
+function setDeliverHandler(fn) {
+    deliverHandler = fn;
+}
+
+function status(deviceId) {
+    const state = devices.get(deviceId);
+    if (!state) return null;
+    const oldest = state.entries[0];
+    return {
+        queued: state.entries.length,
+        oldestQueuedAt: oldest ? new Date(oldest.queuedAt).toISOString() : null,
+        nextExpiry: oldest ? new Date(oldest.expiresAt).toISOString() : null,
+        delivered: state.delivered,
+        expired: state.expired,
+        dropped: state.dropped,
+        lastDeliveredAt: state.lastDeliveredAt ? new Date(state.lastDeliveredAt).toISOString() : null
+    };
+}
+
+function stats() {
+    let devicesWaiting = 0;
+    devices.forEach((state) => {
+        if (state.entries.length > 0) devicesWaiting++;
+    });
+    return {
+        enabled: TTL > 0,
+        ttl: TTL,
+        maxLength: MAX_LENGTH,
+        maxTotal: MAX_TOTAL,
+        file: LOG_FILE,
+        queuedNow: totalQueued,
+        devicesWaiting,
+        knownDevices: knownDevices.size,
+        ...counters
+    };
+}
+
+if (TTL > 0) {
+    try {
+        load();
+    } catch (e) {
+        log.error(() => `❌ Could not restore offline queues from ${LOG_FILE}: ${e.message}`);
+    }
+    setInterval(sweep, SWEEP_INTERVAL).unref();
+
+    // WebSocket devices can take commands as soon as they connect; MQTT devices once
+    // they subscribe to their command topic (mqtt.js calls drain() then)
+    registry.onPresenceChange((deviceId, online) => {
+        if (!online) return;
+        remember(deviceId);
+        if (registry.hasSockets(deviceId)) drain(deviceId);
+    });
+    cluster.onRemoteOnline((deviceId) => {
+        remember(deviceId);
+        drain(deviceId);
+    });
+}
+
+metrics.collect('relay_offline_queue_commands', 'gauge', 'Commands waiting for offline devices', () => totalQueued);
+metrics.collect('relay_offline_queue_events_total', 'counter', 'Offline queue events by outcome', () =>
+    Object.keys(counters).map(outcome => ({ labels: { outcome }, value: counters[outcome] })));
+
+module.exports = {
+    enqueue,
+    drain,
+    setDeliverHandler,
+    status,
+    stats
+};
@@ -0,0 +1,210 @@
+const WebSocket = require('ws');
+const metrics = require('./metrics');
+
+// Routing registry shared by the WebSocket and MQTT handlers.
+// Both transports update it incrementally on connect/disconnect, so lookups,
+// listings and per-protocol counts never rebuild intermediate maps.
+const entries = new Map(); // deviceId -> { deviceId, sockets: Set<ws>, mqttClient }
+
+// deviceId sets per connection type; a device is in exactly one of them while online
+const protocolIndex = {
+    websocket: new Set(),
+    mqtt: new Set(),
+    hybrid: new Set()
+};
+
+const EMPTY_SET = new Set();
+let socketCount = 0;
+const presenceListeners = []; // (deviceId, online) on first connect / last disconnect
+const connectionListeners = []; // (deviceId, ws) on every socket change, ws null for MQTT changes
+
+function protocolOf(entry) {
+    const hasSockets = entry.sockets.size > 0;
+    if (hasSockets && entry.mqttClient) return 'hybrid';
+    if (entry.mqttClient) return 'mqtt';
+    if (hasSockets) return 'websocket';
+    return null;
+}
+
+// Move the device to the set matching its current connections; drop it once offline
+function reindex(entry, previousType) {
+    const type = protocolOf(entry);
+    if (type === previousType) return;
+
+    if (previousType) protocolIndex[previousType].delete(entry.deviceId);
+    if (type) {
+        protocolIndex[type].add(entry.deviceId);
+    } else {
+        entries.delete(entry.deviceId);
+    }
+
+    if (!previousType || !type) {
+        presenceListeners.forEach(fn => fn(entry.deviceId, !!type));
+    }
+}
+
+function onPresenceChange(fn) {
+    presenceListeners.push(fn);
+}
+
+function onConnectionChange(fn) {
+    connectionListeners.push(fn);
+}
+
+function notifyConnection(deviceId, ws) {
+    connectionListeners.forEach(fn => fn(deviceId, ws));
+}
+
+function getOrCreate(deviceId) {
+    let entry = entries.get(deviceId);
+    if (!entry) {
+        entry = { deviceId, sockets: new Set(), mqttClient: null };
+        entries.set(deviceId, entry);
+    }
+    return entry;
+}
+
+function addSocket(deviceId, ws) {
+    const entry = getOrCreate(deviceId);
+    if (entry.sockets.has(ws)) return;
+
+    const previousType = protocolOf(entry);
+    entry.sockets.add(ws);
+    socketCount++;
+    reindex(entry, previousType);
+    notifyConnection(deviceId, ws);
+}
+
+// Returns false if the socket was already removed (close and error both fire for one socket)
+function removeSocket(deviceId, ws) {
+    const entry = entries.get(deviceId);
+    if (!entry || !entry.sockets.has(ws)) return false;
+
+    const previousType = protocolOf(entry);
+    entry.sockets.delete(ws);
+    socketCount--;
+    reindex(entry, previousType);
+    notifyConnection(deviceId, ws);
+    return true;
+}
+
+function setMqttClient(deviceId, client) {
+    const entry = getOrCreate(deviceId);
+    const previousType = protocolOf(entry);
+    entry.mqttClient = client;
+    reindex(entry, previousType);
+    notifyConnection(deviceId, null);
+}
+
+// Only removes the client that is registered, so a session takeover keeps the new one
+function removeMqttClient(deviceId, client) {
+    const entry = entries.get(deviceId);
+    if (!entry || !entry.mqttClient || (client && entry.mqttClient !== client)) return false;
+
+    const previousType = protocolOf(entry);
+    entry.mqttClient = null;
+    reindex(entry, previousType);
+    notifyConnection(deviceId, null);
+    return true;
+}
+
+function has(deviceId) {
+    return entries.has(deviceId);
+}
+
+function get(deviceId) {
+    return entries.get(deviceId);
+}
+
+function getSockets(deviceId) {
+    const entry = entries.get(deviceId);
+    return entry ? entry.sockets : EMPTY_SET;
+}
+
+function hasSockets(deviceId) {
+    const entry = entries.get(deviceId);
+    return !!entry && entry.sockets.size > 0;
+}
+
+function getMqttClient(deviceId) {
+    const entry = entries.get(deviceId);
+    return entry ? entry.mqttClient : null;
+}
+
+function hasMqttClient(deviceId) {
+    return !!getMqttClient(deviceId);
+}
+
+function forEachDevice(fn) {
+    entries.forEach(fn);
+}
+
+function deviceIds() {
+    return Array.from(entries.keys());
+}
+
+// Device IDs reachable over one protocol ('websocket' or 'mqtt'); hybrid devices count for both
+function idsByProtocol(protocol) {
+    return [...protocolIndex[protocol], ...protocolIndex.hybrid];
+}
+
+// Summary used by the REST API
+function describe(entry) {
+    const type = protocolOf(entry);
+    let activeConnections = entry.mqttClient ? 1 : 0;
+    let queuedFrames = 0;
+    entry.sockets.forEach((ws) => {
+        if (ws.readyState === WebSocket.OPEN) activeConnections++;
+        if (ws.sendQueue) queuedFrames += ws.sendQueue.length;
+    });
+
+    return {
+        deviceId: entry.deviceId,
+        type,
+        connections: entry.sockets.size + (entry.mqttClient ? 1 : 0),
+        activeConnections,
+        queuedFrames,
+        protocols: type === 'hybrid' ? ['websocket', 'mqtt'] : [type]
+    };
+}
+
+function stats() {
+    return {
+        totalDevices: entries.size,
+        websocketConnections: socketCount,
+        protocolBreakdown: {
+            websocket: protocolIndex.websocket.size,
+            mqtt: protocolIndex.mqtt.size,
+            hybrid: protocolIndex.hybrid.size
+        }
+    };
+}
+
+function mqttDeviceCount() {
+    return protocolIndex.mqtt.size + protocolIndex.hybrid.size;
+}
+
+metrics.collect('relay_devices', 'gauge', 'Connected devices by protocol', () =>
+    Object.keys(protocolIndex).map(protocol => ({ labels: { protocol }, value: protocolIndex[protocol].size })));
+metrics.collect('relay_websocket_connections', 'gauge', 'Open device WebSocket connections', () => socketCount);
+
+module.exports = {
+    addSocket,
+    removeSocket,
+    setMqttClient,
+    removeMqttClient,
+    has,
+    get,
+    getSockets,
+    hasSockets,
+    getMqttClient,
+    hasMqttClient,
+    forEachDevice,
+    deviceIds,
+    idsByProtocol,
+    describe,
+    stats,
+    mqttDeviceCount,
+    onPresenceChange,
+    onConnectionChange
+};
@@ -0,0 +1,124 @@
+const cluster = require('./cluster');
+const log = require('./logger').create('api');
+
+// Request/response correlation for synchronous API sends.
+// A command sent with a reply expected goes out with `from` set to a one-off
+// reply address ("$reply-..."). Devices answer to the `from` of the command they
+// handled, so their feedback frame comes back addressed to it and is handed to
+// the waiting request here instead of being routed to a device. No firmware
+// change is needed.
+//
+// Timeouts for every pending request share one timer wheel (REPLY_TICK ms per
+// slot) that only runs while something is pending, so a batch of thousands of
+// waits costs one interval rather than a timer each.
+// In cluster mode reply addresses are claimed in the directory like devices, so
+// a reply arriving on another node is forwarded to the one holding the request.
+const REPLY_PREFIX = '$reply-';
+const REPLY_TIMEOUT = parseInt(process.env.REPLY_TIMEOUT) || 5000;
+const REPLY_TICK = 50;
+const REPLY_SLOTS = 1024;
+const MAX_TIMEOUT = (REPLY_SLOTS - 1) * REPLY_TICK; // ~51s
+
+const pending = new Map(); // reply address -> { id, deviceId, slot, started, resolve }
+const wheel = Array.from({ length: REPLY_SLOTS }, () => new Set());
+const nodeTag = process.pid.toString(36);
+let sequence = 0;
+let cursor = 0;
+let timer = null;
+
+const counters = {
+    requests: 0,
+    replied: 0,
+    timedOut: 0,
+    late: 0
+};
+
+function finish(entry, reply) {
+    pending.delete(entry.id);
+    wheel[entry.slot].delete(entry);
+    cluster.announce(entry.id, false);
+    if (pending.size === 0) {
+        clearInterval(timer);
+        timer = null;
+    }
+    entry.resolve(reply);
+}
+
+function tick() {
+    cursor = (cursor + 1) % REPLY_SLOTS;
+    const expired = wheel[cursor];
+    if (expired.size === 0) return;
+    Array.from(expired).forEach((entry) => {
+        counters.timedOut++;
+        finish(entry, null);
+    });
+}
+
+function clampTimeout(timeout) {
+    const ms = parseInt(timeout) || REPLY_TIMEOUT;
+    return Math.min(Math.max(ms, REPLY_TICK), MAX_TIMEOUT);
+}
+
+// Register a pending reply for a command to deviceId.
+// Returns { id, reply } where id is the `from` to send the command with and reply
+// resolves to { from, payload, latencyMs } or null on timeout.
+function expect(deviceId, timeout) {
+    const id = `${REPLY_PREFIX}${nodeTag}-${(sequence++).toString(36)}`;
+    const ticks = Math.ceil(clampTimeout(timeout) / REPLY_TICK);
+    const entry = { id, deviceId, slot: (cursor + ticks) % REPLY_SLOTS, started: Date.now(), resolve: null };
+    const reply = new Promise((resolve) => {
+        entry.resolve = resolve;
+    });
+
+    pending.set(id, entry);
+    wheel[entry.slot].add(entry);
+    cluster.announce(id, true);
+    counters.requests++;
+    if (!timer) timer = setInterval(tick, REPLY_TICK);
+    return { id, reply };
+}
+
+// Give up on a reply, e.g. when the command could not be sent
+function cancel(id) {
+    const entry = pending.get(id);
+    if (entry) finish(entry, null);
+}
+
+function isReplyAddress(targetId) {
+    return typeof targetId === 'string' && targetId.startsWith(REPLY_PREFIX);
+}
+
+// Called by the routers for every addressed message; true if `targetId` is a reply
+// address, in which case the message has been consumed
+function handleReply(targetId, fromDeviceId, payload) {
+    if (!isReplyAddress(targetId)) return false;
+
+    const entry = pending.get(targetId);
+    if (entry) {
+        counters.replied++;
+        finish(entry, { from: fromDeviceId, payload, latencyMs: Date.now() - entry.started });
+    } else if (!cluster.forward(targetId, { from: fromDeviceId, payload })) {
+        // Timed out already, or a second connection of the same device answering
+        counters.late++;
+        log.debug(() => `⏱️ Dropped late reply from ${fromDeviceId} to ${targetId}`);
+    }
+    return true;
+}
+
+function stats() {
+    return {
+        pending: pending.size,
+        defaultTimeout: REPLY_TIMEOUT,
+        maxTimeout: MAX_TIMEOUT,
+        ...counters
+    };
+}
+
+module.exports = {
+    expect,
+    cancel,
+    isReplyAddress,
+    handleReply,
+    clampTimeout,
+    stats
+};
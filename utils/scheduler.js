@@ -0,0 +1,493 @@
+const crypto = require('crypto');
+const fs = require('fs');
+const path = require('path');
+const cron = require('./cron');
+const groups = require('./groups');
+const cluster = require('./cluster');
+const metrics = require('./metrics');
+const log = require('./logger').create('scheduler');
+
+// Scheduled and recurring commands, run by the relay itself.
+// A schedule sends one payload to a device or to a device group (utils/groups.js):
+//   at / delay - once, at a time or after a delay in ms
+//   every      - every N ms, counted from startAt (default: creation)
+//   cron       - on a five-field cron expression in server local time (utils/cron.js)
+// Recurring schedules can be bounded with endAt and maxRuns.
+//
+// Due times sit on a hierarchical timer wheel: four levels of slots, each slot of
+// a level spanning a whole turn of the level below. Entries move down a level as
+// their time approaches, so adding, cancelling and firing are O(1), and every
+// schedule shares one TICK interval that only runs while something is scheduled.
+//
+//   level 0: 256 slots x 100ms   (25.6s)
+//   level 1:  64 slots x 25.6s   (27min)
+//   level 2:  64 slots x 27min   (29h)
+//   level 3:  64 slots x 29h     (77 days; later entries are re-placed when reached)
+//
+// In cluster mode schedules are replicated through the hub like groups, so every
+// node lists, returns and cancels all of them. Every node keeps the same timeline,
+// but only the leader (utils/cluster.js) sends; it replicates each run so the
+// others show its result and can take over when it leaves.
+//
+// Schedules are saved to SCHEDULES_FILE (default data/schedules.json, "none" keeps
+// them in memory). After a restart recurring schedules continue from their next due
+// time; one-shot schedules that came due while the relay was down still run if they
+// are at most SCHEDULER_MISFIRE_GRACE ms late.
+const TICK = 100;
+const LEVEL_SLOTS = [256, 64, 64, 64];
+const LEVEL_SPANS = [1, 256, 256 * 64, 256 * 64 * 64]; // ticks per slot
+const MAX_DELTA = LEVEL_SPANS[3] * LEVEL_SLOTS[3] - 1;
+const MIN_EVERY = 1000;
+const SAVE_DELAY = 1000;
+const MAX_SCHEDULES = parseInt(process.env.SCHEDULER_MAX_SCHEDULES) || 100000;
+const MISFIRE_GRACE = parseInt(process.env.SCHEDULER_MISFIRE_GRACE) || 60000;
+
+const SCHEDULES_FILE = process.env.SCHEDULES_FILE === 'none' ? null :
+    (process.env.SCHEDULES_FILE || path.join('data', 'schedules.json'));
+
+const schedules = new Map(); // id -> schedule
+let deliverHandler = null;   // (schedule) -> { sent, queued, connections }
+let saveTimer = null;
+
+const counters = {
+    runs: 0,
+    undelivered: 0,
+    completed: 0,
+    missed: 0
+};
+
+// --- Timer wheel ---
+
+const wheel = LEVEL_SLOTS.map(count => Array.from({ length: count }, () => new Set()));
+const epoch = Date.now();
+let currentTick = 0; // last tick processed
+let timer = null;
+let armed = 0;
+
+function tickOf(time) {
+    return Math.ceil((time - epoch) / TICK);
+}
+
+// Slot for an entry given the current tick; beyond the top level it waits in the
+// furthest slot and is placed again when that slot comes round
+function place(entry) {
+    const delta = Math.min(entry.tick - currentTick, MAX_DELTA);
+    let level = 0;
+    while (level < 3 && delta >= LEVEL_SPANS[level] * LEVEL_SLOTS[level]) level++;
+    const tick = currentTick + delta;
+    entry.slot = wheel[level][Math.floor(tick / LEVEL_SPANS[level]) % LEVEL_SLOTS[level]];
+    entry.slot.add(entry);
+}
+
+function cascade(level) {
+    const slot = wheel[level][Math.floor(currentTick / LEVEL_SPANS[level]) % LEVEL_SLOTS[level]];
+    if (slot.size === 0) return;
+    const entries = Array.from(slot);
+    slot.clear();
+    entries.forEach(place);
+}
+
+function advance() {
+    const target = Math.floor((Date.now() - epoch) / TICK);
+    while (currentTick < target) {
+        currentTick++;
+        // Upper levels first, so their entries can land in the lower slots due now
+        for (let level = 3; level >= 1; level--) {
+            if (currentTick % LEVEL_SPANS[level] === 0) cascade(level);
+        }
+        const slot = wheel[0][currentTick % LEVEL_SLOTS[0]];
+        if (slot.size > 0) {
+            const due = Array.from(slot);
+            slot.clear();
+            due.forEach(fire);
+        }
+    }
+    if (armed === 0) {
+        clearInterval(timer);
+        timer = null;
+    }
+}
+
+function arm(schedule, time) {
+    schedule.nextRunAt = time;
+    if (!timer) {
+        // Nothing was scheduled, so nothing is missed by skipping the idle ticks
+        currentTick = Math.floor((Date.now() - epoch) / TICK);
+        timer = setInterval(advance, TICK);
+    }
+    // Never into the slot being processed (or already passed)
+    const entry = { schedule, tick: Math.max(tickOf(time), currentTick + 1), slot: null };
+    schedule.entry = entry;
+    place(entry);
+    armed++;
+}
+
+function disarm(schedule) {
+    if (!schedule.entry) return;
+    schedule.entry.slot.delete(schedule.entry);
+    schedule.entry = null;
+    armed--;
+}
+
+// --- Schedules ---
+
+function parseTime(value) {
+    if (value === undefined || value === null) return null;
+    const time = typeof value === 'number' ? value : Date.parse(value);
+    return Number.isFinite(time) ? time : NaN;
+}
+
+// Next due time after `after`, or null when the schedule is finished
+function nextRun(schedule, after) {
+    let time = null;
+    if (schedule.every) {
+        const start = schedule.startAt || schedule.createdAt;
+        time = after < start ? start : start + (Math.floor((after - start) / schedule.every) + 1) * schedule.every;
+    } else if (schedule.cronSpec) {
+        time = cron.next(schedule.cronSpec, Math.max(after, (schedule.startAt || 0) - 1));
+    }
+    if (time === null) return null;
+    if (schedule.endAt && time > schedule.endAt) return null;
+    if (schedule.maxRuns && schedule.runs >= schedule.maxRuns) return null;
+    return time;
+}
+
+// This node sends the scheduled commands: always on its own, the leader in a cluster
+function runsHere() {
+    return !cluster.isEnabled() || cluster.isLeader();
+}
+
+function discard(schedule) {
+    disarm(schedule);
+    schedules.delete(schedule.id);
+    scheduleSave();
+}
+
+function fire(entry) {
+    const schedule = entry.schedule;
+    schedule.entry = null;
+    armed--;
+
+    const now = Date.now();
+    const sending = runsHere();
+    schedule.runs++;
+    schedule.lastRunAt = now;
+    if (sending) {
+        let result = null;
+        try {
+            result = deliverHandler ? deliverHandler(schedule) : null;
+        } catch (e) {
+            log.error(() => `❌ Schedule ${schedule.id} failed: ${e.message}`);
+        }
+        schedule.lastResult = result;
+        counters.runs++;
+        if (!result || (!result.sent && !result.queued && !result.connections)) counters.undelivered++;
+        log.debug(() => `⏰ Schedule ${schedule.id} ran for ${schedule.group ? `group ${schedule.group}` : schedule.deviceId}`);
+    }
+
+    const next = schedule.kind === 'once' ? null : nextRun(schedule, Math.max(now, schedule.nextRunAt));
+    if (next === null) {
+        discard(schedule);
+        if (sending) {
+            counters.completed++;
+            cluster.publishScheduleChange({ type: 'delete', id: schedule.id });
+        }
+        return;
+    }
+    arm(schedule, next);
+    if (sending) {
+        cluster.publishScheduleChange({
+            type: 'run',
+            id: schedule.id,
+            runs: schedule.runs,
+            lastRunAt: schedule.lastRunAt,
+            lastResult: schedule.lastResult,
+            nextRunAt: next
+        });
+    }
+    // Run counts only matter across restarts when they end the schedule
+    if (schedule.maxRuns) scheduleSave();
+}
+
+// Error message for an invalid schedule request, or null
+function validate(spec) {
+    if (schedules.size >= MAX_SCHEDULES) return `Schedule limit of ${MAX_SCHEDULES} reached`;
+    if (!!spec.deviceId === !!spec.group) return 'Either deviceId or group is required';
+    if (spec.deviceId && typeof spec.deviceId !== 'string') return 'deviceId must be a string';
+    if (spec.group && !groups.isValidName(spec.group)) return 'Invalid group name';
+    if (!spec.payload || typeof spec.payload !== 'object') return 'Payload is required';
+
+    const timing = ['at', 'delay', 'every', 'cron'].filter(key => spec[key] !== undefined);
+    if (timing.length !== 1) return 'Exactly one of at, delay, every or cron is required';
+    if (spec.at !== undefined && !Number.isFinite(parseTime(spec.at))) return 'at must be an ISO date or epoch milliseconds';
+    if (spec.delay !== undefined && !(Number.isInteger(spec.delay) && spec.delay >= 0)) return 'delay must be a number of milliseconds';
+    if (spec.every !== undefined && !(Number.isInteger(spec.every) && spec.every >= MIN_EVERY)) return `every must be at least ${MIN_EVERY} milliseconds`;
+    if (spec.cron !== undefined) {
+        try {
+            cron.parse(spec.cron);
+        } catch (e) {
+            return e.message;
+        }
+    }
+    for (const key of ['startAt', 'endAt']) {
+        if (spec[key] !== undefined && !Number.isFinite(parseTime(spec[key]))) return `${key} must be an ISO date or epoch milliseconds`;
+    }
+    if (spec.maxRuns !== undefined && !(Number.isInteger(spec.maxRuns) && spec.maxRuns > 0)) return 'maxRuns must be a positive integer';
+    return null;
+}
+
+function build(spec, id, createdAt) {
+    const kind = spec.every ? 'every' : spec.cron ? 'cron' : 'once';
+    return {
+        id,
+        name: typeof spec.name === 'string' ? spec.name : null,
+        deviceId: spec.deviceId || null,
+        group: spec.group || null,
+        payload: spec.payload,
+        kind,
+        every: spec.every || null,
+        cron: spec.cron || null,
+        cronSpec: spec.cron ? cron.parse(spec.cron) : null,
+        startAt: parseTime(spec.startAt),
+        endAt: parseTime(spec.endAt),
+        maxRuns: spec.maxRuns || null,
+        createdAt,
+        runs: 0,
+        lastRunAt: null,
+        lastResult: null,
+        nextRunAt: null,
+        entry: null
+    };
+}
+
+// Saved form, also what is replicated to other nodes
+function serialize(schedule) {
+    return {
+        id: schedule.id,
+        name: schedule.name,
+        deviceId: schedule.deviceId,
+        group: schedule.group,
+        payload: schedule.payload,
+        kind: schedule.kind,
+        every: schedule.every,
+        cron: schedule.cron,
+        startAt: schedule.startAt,
+        endAt: schedule.endAt,
+        maxRuns: schedule.maxRuns,
+        createdAt: schedule.createdAt,
+        runs: schedule.runs,
+        lastRunAt: schedule.lastRunAt,
+        lastResult: schedule.lastResult,
+        nextRunAt: schedule.nextRunAt
+    };
+}
+
+// Re-creates a saved or replicated schedule; false if it has nothing left to run
+function restore(saved, now) {
+    const schedule = build(saved, saved.id, saved.createdAt);
+    schedule.runs = saved.runs;
+    schedule.lastRunAt = saved.lastRunAt;
+    schedule.lastResult = saved.lastResult || null;
+
+    let next = saved.nextRunAt;
+    if (next < now) {
+        if (schedule.kind === 'once') {
+            if (now - next > MISFIRE_GRACE) {
+                counters.missed++;
+                return false;
+            }
+        } else {
+            // Recurring runs missed while the relay was down are skipped
+            next = nextRun(schedule, now);
+            if (next === null) return false;
+        }
+    }
+    schedules.set(schedule.id, schedule);
+    arm(schedule, next);
+    return true;
+}
+
+// Creates a validated schedule; returns its description, or null if it would never run
+function create(spec) {
+    const now = Date.now();
+    // Random ids, so schedules created on different nodes never collide
+    const schedule = build(spec, crypto.randomBytes(8).toString('hex'), now);
+    const first = schedule.kind === 'once' ?
+        (spec.at !== undefined ? parseTime(spec.at) : now + spec.delay) :
+        nextRun(schedule, now);
+    if (first === null) return null;
+
+    schedules.set(schedule.id, schedule);
+    arm(schedule, first);
+    cluster.publishScheduleChange({ type: 'create', schedule: serialize(schedule) });
+    scheduleSave();
+    log.info(() => `⏰ Schedule ${schedule.id} created (${schedule.kind}), first run ${new Date(first).toISOString()}`);
+    return describe(schedule);
+}
+
+function remove(id) {
+    const schedule = schedules.get(id);
+    if (!schedule) return false;
+    discard(schedule);
+    cluster.publishScheduleChange({ type: 'delete', id });
+    return true;
+}
+
+// A run on the leader: take its result and keep to its timeline
+function applyRun(schedule, change) {
+    schedule.runs = change.runs;
+    schedule.lastRunAt = change.lastRunAt;
+    schedule.lastResult = change.lastResult;
+    if (schedule.nextRunAt !== change.nextRunAt) {
+        disarm(schedule);
+        arm(schedule, change.nextRunAt);
+    }
+}
+
+// Changes made on other nodes, and the hub's schedules when this node (re)joins
+cluster.onScheduleChange((change) => {
+    const now = Date.now();
+    if (change.type === 'create') {
+        if (!schedules.has(change.schedule.id)) restore(change.schedule, now);
+    } else if (change.type === 'delete') {
+        const schedule = schedules.get(change.id);
+        if (schedule) discard(schedule);
+        return;
+    } else if (change.type === 'run') {
+        const schedule = schedules.get(change.id);
+        if (!schedule) return;
+        applyRun(schedule, change);
+    } else if (change.type === 'snapshot') {
+        const known = new Set();
+        change.schedules.forEach((saved) => {
+            known.add(saved.id);
+            const schedule = schedules.get(saved.id);
+            if (!schedule) restore(saved, now);
+            else if (saved.nextRunAt >= now) applyRun(schedule, saved);
+        });
+        // Schedules the hub does not have (it restarted) are handed back to it
+        schedules.forEach((schedule, id) => {
+            if (!known.has(id)) cluster.publishScheduleChange({ type: 'create', schedule: serialize(schedule) });
+        });
+    }
+    scheduleSave();
+});
+
+// Called by the module that owns delivery (mqtt.js)
+function setDeliverHandler(fn) {
+    deliverHandler = fn;
+}
+
+// --- Persistence ---
+
+function save() {
+    saveTimer = null;
+    if (!SCHEDULES_FILE) return;
+    const data = Array.from(schedules.values(), serialize);
+    // Cluster workers on one host share the file; each writes the same schedules
+    const temp = `${SCHEDULES_FILE}.${process.pid}.tmp`;
+    try {
+        fs.writeFileSync(temp, JSON.stringify({ schedules: data }));
+        fs.renameSync(temp, SCHEDULES_FILE);
+    } catch (e) {
+        log.error(() => `❌ Could not save schedules to ${SCHEDULES_FILE}: ${e.message}`);
+    }
+}
+
+function scheduleSave() {
+    if (SCHEDULES_FILE && !saveTimer) saveTimer = setTimeout(save, SAVE_DELAY);
+}
+
+function load() {
+    if (!SCHEDULES_FILE) return;
+    fs.mkdirSync(path.dirname(SCHEDULES_FILE), { recursive: true });
+    if (!fs.existsSync(SCHEDULES_FILE)) return;
+
+    const data = JSON.parse(fs.readFileSync(SCHEDULES_FILE, 'utf8'));
+    const now = Date.now();
+    data.schedules.forEach(saved => restore(saved, now));
+
+    if (schedules.size > 0 || counters.missed > 0) {
+        log.info(`⏰ Restored ${schedules.size} schedules${counters.missed ? `, ${counters.missed} one-shot schedules missed` : ''}`);
+    }
+    if (schedules.size !== data.schedules.length) scheduleSave();
+}
+
+process.on('exit', () => {
+    if (saveTimer) {
+        clearTimeout(saveTimer);
+        save();
+    }
+});
+
+try {
+    load();
+} catch (e) {
+    log.error(() => `❌ Could not restore schedules from ${SCHEDULES_FILE}: ${e.message}`);
+}
+
+// --- Reads ---
+
+function iso(time) {
+    return time ? new Date(time).toISOString() : null;
+}
+
+function describe(schedule) {
+    return {
+        id: schedule.id,
+        name: schedule.name,
+        deviceId: schedule.deviceId,
+        group: schedule.group,
+        payload: schedule.payload,
+        kind: schedule.kind,
+        every: schedule.every,
+        cron: schedule.cron,
+        startAt: iso(schedule.startAt),
+        endAt: iso(schedule.endAt),
+        maxRuns: schedule.maxRuns,
+        runs: schedule.runs,
+        createdAt: iso(schedule.createdAt),
+        lastRunAt: iso(schedule.lastRunAt),
+        lastResult: schedule.lastResult,
+        nextRunAt: iso(schedule.nextRunAt)
+    };
+}
+
+function get(id) {
+    const schedule = schedules.get(id);
+    return schedule ? describe(schedule) : null;
+}
+
+// Optional filter: { deviceId, group }
+function list(filter = {}) {
+    const result = [];
+    schedules.forEach((schedule) => {
+        if (filter.deviceId && schedule.deviceId !== filter.deviceId) return;
+        if (filter.group && schedule.group !== filter.group) return;
+        result.push(describe(schedule));
+    });
+    return result;
+}
+
+function stats() {
+    return {
+        schedules: schedules.size,
+        maxSchedules: MAX_SCHEDULES,
+        sending: runsHere(),
+        file: SCHEDULES_FILE,
+        ...counters
+    };
+}
+
+metrics.collect('relay_scheduler_schedules', 'gauge', 'Active schedules', () => schedules.size);
+metrics.collect('relay_scheduler_runs_total', 'counter', 'Scheduled command runs', () => counters.runs);
+
+module.exports = {
+    validate,
+    create,
+    remove,
+    get,
+    list,
+    setDeliverHandler,
+    stats
+};
@@ -0,0 +1,146 @@
+const registry = require('./registry');
+const cluster = require('./cluster');
+
+// Device shadow: the last known state of each device, learned from traffic the
+// relay already routes, so dashboards can read it without a round trip.
+//
+//   reported - from feedback frames a device sends back:
+//                { pin, status: 'HIGH' | 'LOW', ... }   (control_gpio / get_gpio_status)
+//                { status: 'online', version }          (get_device_info)
+//   desired  - from control_gpio HIGH/LOW commands sent to a device; toggles
+//              and other actions clear the pin, since the outcome is only known
+//              from the device's reply
+//   delta    - desired pins the device has not reported yet
+//
+// Online status comes from the registry (and the cluster directory) at read time.
+// Shadows are kept per node; in cluster mode a node knows the devices it routes for.
+const SHADOW_MAX_DEVICES = parseInt(process.env.SHADOW_MAX_DEVICES) || 50000;
+
+const shadows = new Map(); // deviceId -> shadow, least recently updated first
+
+function shadowFor(deviceId) {
+    let shadow = shadows.get(deviceId);
+    if (shadow) {
+        // Keep recently updated devices at the end, for eviction order
+        shadows.delete(deviceId);
+    } else {
+        shadow = {
+            reported: { pins: {}, firmware: null, updatedAt: null },
+            desired: { pins: {}, updatedAt: null },
+            lastOnline: null
+        };
+        if (shadows.size >= SHADOW_MAX_DEVICES) {
+            shadows.delete(shadows.keys().next().value);
+        }
+    }
+    shadows.set(deviceId, shadow);
+    return shadow;
+}
+
+function isGpioLevel(value) {
+    return value === 'HIGH' || value === 'LOW';
+}
+
+// Whether an undecoded payload could update a shadow; lets the router skip
+// decoding payloads (such as large sensor readings) that cannot
+function mayObserve(raw) {
+    return raw.includes('"status"') || raw.includes('control_gpio');
+}
+
+// Payload sent by `deviceId` (feedback to a dashboard or app)
+function observeReport(deviceId, payload) {
+    if (!deviceId || !payload || typeof payload !== 'object') return;
+
+    const pinReport = payload.pin !== undefined && isGpioLevel(payload.status);
+    const infoReport = payload.status === 'online' && payload.version !== undefined;
+    if (!pinReport && !infoReport) return;
+
+    const shadow = shadowFor(deviceId);
+    const now = Date.now();
+    if (pinReport) {
+        shadow.reported.pins[payload.pin] = { status: payload.status, controlid: payload.controlid, updatedAt: now };
+    }
+    if (infoReport) {
+        shadow.reported.firmware = String(payload.version);
+    }
+    shadow.reported.updatedAt = now;
+}
+
+// Payload sent to `deviceId` as a command
+function observeCommand(deviceId, payload) {
+    if (!deviceId || !payload || payload.commands !== 'control_gpio' || payload.pin === undefined) return;
+    if (payload.action === 'get_gpio_status' || payload.action === 'ping') return;
+
+    const shadow = shadowFor(deviceId);
+    if (isGpioLevel(payload.action)) {
+        shadow.desired.pins[payload.pin] = payload.action;
+    } else {
+        delete shadow.desired.pins[payload.pin];
+    }
+    shadow.desired.updatedAt = Date.now();
+}
+
+function iso(time) {
+    return time ? new Date(time).toISOString() : null;
+}
+
+// Read model for the API and the WebSocket getShadow request; null if nothing is known
+function get(deviceId) {
+    const shadow = shadows.get(deviceId);
+    const local = registry.has(deviceId);
+    const node = local ? null : cluster.ownerOf(deviceId);
+    if (!shadow && !local && !node) return null;
+
+    const result = {
+        deviceId,
+        online: local || node !== null,
+        lastOnline: shadow ? iso(shadow.lastOnline) : null,
+        reported: { pins: {}, firmware: null, updatedAt: null },
+        desired: { pins: {}, updatedAt: null },
+        delta: { pins: {} }
+    };
+    if (node) result.node = node;
+    if (!shadow) return result;
+
+    Object.keys(shadow.reported.pins).forEach((pin) => {
+        const report = shadow.reported.pins[pin];
+        result.reported.pins[pin] = { status: report.status, controlid: report.controlid, updatedAt: iso(report.updatedAt) };
+    });
+    result.reported.firmware = shadow.reported.firmware;
+    result.reported.updatedAt = iso(shadow.reported.updatedAt);
+
+    Object.keys(shadow.desired.pins).forEach((pin) => {
+        const level = shadow.desired.pins[pin];
+        result.desired.pins[pin] = level;
+        const report = shadow.reported.pins[pin];
+        if (!report || report.status !== level) result.delta.pins[pin] = level;
+    });
+    result.desired.updatedAt = iso(shadow.desired.updatedAt);
+    return result;
+}
+
+function getMany(deviceIds) {
+    return deviceIds.map(get).filter(Boolean);
+}
+
+function stats() {
+    return {
+        devices: shadows.size,
+        maxDevices: SHADOW_MAX_DEVICES
+    };
+}
+
+// Remember when a device was last seen online; only for devices with a shadow
+registry.onPresenceChange((deviceId, online) => {
+    const shadow = shadows.get(deviceId);
+    if (shadow && !online) shadow.lastOnline = Date.now();
+});
+
+module.exports = {
+    observeReport,
+    observeCommand,
+    mayObserve,
+    get,
+    getMany,
+    stats
+};
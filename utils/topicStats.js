@@ -0,0 +1,212 @@
+// MQTT topic statistics with incremental indexes.
+// - clientTopics maps each client to the topics it subscribes to, so a
+//   disconnect only touches that client's topics.
+// - Topics are bucketed by subscriber count; the busiest topics are read by
+//   walking buckets down from the highest count, without sorting every topic.
+// - Per-prefix aggregates (first TOPIC_PREFIX_DEPTH levels) are updated in place.
+// - Wildcard filters are counted separately so the bridge can tell when a topic
+//   has exactly one subscriber and can skip the broker's matching.
+// Timestamps are kept as epoch milliseconds and only formatted for API output.
+const TOPIC_PREFIX_DEPTH = parseInt(process.env.TOPIC_PREFIX_DEPTH) || 1;
+const MAX_WILDCARD_CHECKS = 64; // Past this many distinct wildcard filters, stop matching by hand
+
+const topics = new Map();       // topic -> { topic, prefix, subscribers: Map<clientId, qos>, messageCount, lastMessage }
+const clientTopics = new Map(); // clientId -> Set<topic>
+const buckets = new Map();      // subscriber count -> Set<topic>
+const prefixes = new Map();     // prefix -> { prefix, topics, subscriptions, messageCount, lastMessage }
+const wildcards = new Map();    // wildcard or shared filter -> subscription count
+let maxCount = 0;
+
+function isWildcard(filter) {
+    return filter.includes('+') || filter.includes('#') || filter.startsWith('$share/');
+}
+
+// MQTT filter matching for '+' and '#'
+function filterMatches(filter, topic) {
+    if (filter.startsWith('$share/')) {
+        filter = filter.split('/').slice(2).join('/');
+    }
+    const filterLevels = filter.split('/');
+    const topicLevels = topic.split('/');
+    for (let i = 0; i < filterLevels.length; i++) {
+        if (filterLevels[i] === '#') return true;
+        if (i >= topicLevels.length) return false;
+        if (filterLevels[i] !== '+' && filterLevels[i] !== topicLevels[i]) return false;
+    }
+    return filterLevels.length === topicLevels.length;
+}
+
+function prefixOf(topic) {
+    return topic.split('/', TOPIC_PREFIX_DEPTH).join('/');
+}
+
+function bucketAdd(count, topic) {
+    let bucket = buckets.get(count);
+    if (!bucket) {
+        bucket = new Set();
+        buckets.set(count, bucket);
+    }
+    bucket.add(topic);
+    if (count > maxCount) maxCount = count;
+}
+
+function bucketRemove(count, topic) {
+    const bucket = buckets.get(count);
+    if (!bucket) return;
+    bucket.delete(topic);
+    if (bucket.size === 0) {
+        buckets.delete(count);
+        while (maxCount > 0 && !buckets.has(maxCount)) maxCount--;
+    }
+}
+
+function getOrCreate(topic) {
+    let info = topics.get(topic);
+    if (!info) {
+        info = { topic, prefix: prefixOf(topic), subscribers: new Map(), messageCount: 0, lastMessage: 0 };
+        topics.set(topic, info);
+        bucketAdd(0, topic);
+
+        let aggregate = prefixes.get(info.prefix);
+        if (!aggregate) {
+            aggregate = { prefix: info.prefix, topics: 0, subscriptions: 0, messageCount: 0, lastMessage: 0 };
+            prefixes.set(info.prefix, aggregate);
+        }
+        aggregate.topics++;
+    }
+    return info;
+}
+
+function subscribe(clientId, topic, qos = 0) {
+    const info = getOrCreate(topic);
+    if (info.subscribers.has(clientId)) {
+        info.subscribers.set(clientId, qos); // resubscribe may change the granted QoS
+        return;
+    }
+
+    bucketRemove(info.subscribers.size, topic);
+    info.subscribers.set(clientId, qos);
+    bucketAdd(info.subscribers.size, topic);
+    prefixes.get(info.prefix).subscriptions++;
+    if (isWildcard(topic)) wildcards.set(topic, (wildcards.get(topic) || 0) + 1);
+
+    let owned = clientTopics.get(clientId);
+    if (!owned) {
+        owned = new Set();
+        clientTopics.set(clientId, owned);
+    }
+    owned.add(topic);
+}
+
+// Topics left without subscribers are dropped, as before
+function unsubscribe(clientId, topic) {
+    const info = topics.get(topic);
+    if (!info || !info.subscribers.has(clientId)) return;
+
+    bucketRemove(info.subscribers.size, topic);
+    info.subscribers.delete(clientId);
+    prefixes.get(info.prefix).subscriptions--;
+    if (isWildcard(topic)) {
+        const remaining = wildcards.get(topic) - 1;
+        if (remaining > 0) wildcards.set(topic, remaining); else wildcards.delete(topic);
+    }
+
+    if (info.subscribers.size === 0) {
+        topics.delete(topic);
+        const aggregate = prefixes.get(info.prefix);
+        aggregate.topics--;
+        if (aggregate.topics === 0) prefixes.delete(info.prefix);
+    } else {
+        bucketAdd(info.subscribers.size, topic);
+    }
+
+    const owned = clientTopics.get(clientId);
+    if (owned) {
+        owned.delete(topic);
+        if (owned.size === 0) clientTopics.delete(clientId);
+    }
+}
+
+// Cost is proportional to the client's own subscriptions
+function removeClient(clientId) {
+    const owned = clientTopics.get(clientId);
+    if (!owned) return;
+    Array.from(owned).forEach(topic => unsubscribe(clientId, topic));
+    clientTopics.delete(clientId);
+}
+
+function recordMessage(topic, now = Date.now()) {
+    const info = getOrCreate(topic);
+    info.messageCount++;
+    info.lastMessage = now;
+
+    const aggregate = prefixes.get(info.prefix);
+    aggregate.messageCount++;
+    aggregate.lastMessage = now;
+    return info;
+}
+
+function toRow(info) {
+    return {
+        topic: info.topic,
+        subscriberCount: info.subscribers.size,
+        lastMessage: info.lastMessage ? new Date(info.lastMessage).toISOString() : null,
+        messageCount: info.messageCount
+    };
+}
+
+// Busiest topics first (by subscriber count; ties in first-seen order)
+function topTopics(limit) {
+    const rows = [];
+    for (let count = maxCount; count >= 0 && rows.length < limit; count--) {
+        const bucket = buckets.get(count);
+        if (!bucket) continue;
+        for (const topic of bucket) {
+            rows.push(toRow(topics.get(topic)));
+            if (rows.length >= limit) break;
+        }
+    }
+    return rows;
+}
+
+function prefixStats() {
+    return Array.from(prefixes.values(), aggregate => ({
+        ...aggregate,
+        lastMessage: aggregate.lastMessage ? new Date(aggregate.lastMessage).toISOString() : null
+    }));
+}
+
+// QoS granted to clientId if it is the only subscriber that can receive `topic`
+// (one exact subscription, no matching wildcard filter); otherwise null
+function exclusiveSubscriberQos(topic, clientId) {
+    const info = topics.get(topic);
+    if (!info || info.subscribers.size !== 1 || !info.subscribers.has(clientId)) return null;
+
+    if (wildcards.size > 0) {
+        if (wildcards.size > MAX_WILDCARD_CHECKS) return null;
+        for (const filter of wildcards.keys()) {
+            if (filterMatches(filter, topic)) return null;
+        }
+    }
+    return info.subscribers.get(clientId);
+}
+
+function topicCount() {
+    return topics.size;
+}
+
+function get(topic) {
+    return topics.get(topic);
+}
+
+module.exports = {
+    subscribe,
+    unsubscribe,
+    removeClient,
+    recordMessage,
+    topTopics,
+    prefixStats,
+    topicCount,
+    exclusiveSubscriberQos,
+    get
+};
@@ -1,109 +1,189 @@
-const WebSocket = require('ws');
+const registry = require('./registry');
+const { createFrame, createRawFrame, sendFrameToAll } = require('./fanout');
+const { scanEnvelope } = require('./envelope');
+const cluster = require('./cluster');
+const heartbeat = require('./heartbeat');
+const adminStream = require('./adminStream');
+const offlineQueue = require('./offlineQueue');
+const shadow = require('./shadow');
+const replies = require('./replies');
+const groups = require('./groups');
+const capture = require('./capture');
+const logger = require('./logger');
+const metrics = require('./metrics');
 
-const devices = new Map(); // Store connected devices
-const adminConnections = new Set(); // Store admin dashboard connections
+const log = logger.create('websocket');
+const routeLog = logger.create('routing'); // per-message lines, debug level
+
+const framesIn = metrics.counter('relay_frames_in_total', 'Inbound device messages', { protocol: 'websocket' });
+const bytesIn = metrics.counter('relay_bytes_in_total', 'Inbound device message bytes', { protocol: 'websocket' });
+const parseTime = metrics.histogram('relay_parse_seconds', 'Time to parse an inbound message', { protocol: 'websocket' });
+const routeTime = metrics.histogram('relay_route_seconds', 'Time from receiving a message to handing it to every target', { protocol: 'websocket' });
 
 // Import MQTT forwarding functions (will be available after mqtt.js is loaded)
 let forwardWebSocketToMqtt = null;
 let broadcastToAllProtocols = null;
-
-// Heartbeat configuration
-const HEARTBEAT_INTERVAL = 30000; // Ping every 30 seconds
-const CLIENT_TIMEOUT = 35000; // Consider dead if no pong in 35 seconds
+let sendFrameToGroup = null;
 
 // Set MQTT forwarding functions (called from server.js after mqtt is initialized)
-function setMqttForwarders(forwardFn, broadcastFn) {
+function setMqttForwarders(forwardFn, broadcastFn, groupFn) {
     forwardWebSocketToMqtt = forwardFn;
     broadcastToAllProtocols = broadcastFn;
+    sendFrameToGroup = groupFn;
 }
 
-// Handle admin dashboard connections
+// Handle admin dashboard connections; they receive the batched presence stream
 function handleAdminConnection(ws) {
-    adminConnections.add(ws);
-    ws.isAlive = true;
+    adminStream.addAdmin(ws);
+    heartbeat.track(ws, 'admin', 'admin dashboard');
     
-    ws.on('pong', () => {
-        ws.isAlive = true;
-    });
+    ws.on('pong', () => heartbeat.touch(ws));
+    ws.on('message', () => heartbeat.touch(ws));
     
     ws.on('close', () => {
-        adminConnections.delete(ws);
+        adminStream.removeAdmin(ws);
+        heartbeat.untrack(ws);
     });
     
     ws.on('error', () => {
-        adminConnections.delete(ws);
+        adminStream.removeAdmin(ws);
+        heartbeat.untrack(ws);
     });
 }
 
 // Function to broadcast device status updates to admin dashboards
+// Updates are coalesced by utils/adminStream.js and sent as one delta per batch window
 function broadcastDeviceUpdates(updateData) {
-    const updateMessage = JSON.stringify({
-        type: 'deviceUpdate',
-        data: updateData
-    });
-    
-    adminConnections.forEach((adminWs) => {
-        if (adminWs.readyState === WebSocket.OPEN) {
-            adminWs.send(updateMessage);
-        }
-    });
+    const event = updateData.event === 'deviceConnected' ? 'connected' :
+        updateData.event === 'deviceDisconnected' ? 'disconnected' : null;
+    adminStream.markChanged(updateData.deviceId, event);
 }
 
 // Cleanup helper function
 function cleanupConnection(ws, deviceId) {
     if (!deviceId) return;
     
-    const connections = devices.get(deviceId) || [];
-    const index = connections.indexOf(ws);
-    if (index !== -1) connections.splice(index, 1);
-    if (connections.length === 0) {
-        devices.delete(deviceId);
-    }
+    // close and error can both fire for one socket; only the first removal counts
+    if (!registry.removeSocket(deviceId, ws)) return;
     
-    broadcastDeviceUpdates({
-        event: 'deviceDisconnected',
-        deviceId: deviceId,
-        timestamp: new Date().toISOString()
+    adminStream.markChanged(deviceId, 'disconnected');
+}
+
+// Deliver one message to each target: WebSocket on this node, MQTT on this node,
+// the cluster node that owns the device, or the offline queue, in that order
+function routeToTargets(deviceId, targetIds, frame, mqttFrame) {
+    targetIds.forEach((id) => {
+        if (registry.hasSockets(id)) {
+            if (sendFrameToAll(registry.getSockets(id), frame) > 0) {
+                routeLog.debug(() => `📨 Message forwarded from ${deviceId} to ${id}`);
+            }
+        } else if (forwardWebSocketToMqtt) {
+            const forwarded = forwardWebSocketToMqtt(deviceId, id, null, mqttFrame) ||
+                cluster.forward(id, frame.message) ||
+                offlineQueue.enqueue(id, frame.message);
+            if (!forwarded) {
+                routeLog.warn(() => `⚠️ Target device ${id} is not found in WebSocket or MQTT.`);
+            }
+        } else if (cluster.forward(id, frame.message)) {
+            routeLog.debug(() => `🧩 Message forwarded from ${deviceId} to ${id} via cluster`);
+        } else if (offlineQueue.enqueue(id, frame.message)) {
+            routeLog.debug(() => `📦 Queued message from ${deviceId} for offline device ${id}`);
+        } else {
+            routeLog.warn(() => `⚠️ Target device ${id} is not found.`);
+        }
     });
 }
 
+// Multicast to a named group; one frame for every member (see utils/groups.js)
+function routeToGroup(deviceId, name, frame) {
+    let results = null;
+    if (sendFrameToGroup) {
+        results = sendFrameToGroup(name, frame, 'device');
+    } else if (groups.resolve(name)) {
+        // Without the MQTT bridge, WebSocket members on this node only
+        results = { connections: sendFrameToAll(groups.resolve(name).sockets, frame) };
+    }
+    if (results) {
+        routeLog.debug(() => `👥 Message from ${deviceId} sent to group ${name} (${results.connections} connections)`);
+    } else {
+        routeLog.warn(() => `⚠️ Target group ${name} is not found.`);
+    }
+}
+
+// Fast path for plain addressed messages: route on the scanned envelope and splice
+// the payload bytes into the outgoing frames. Returns false when the message needs
+// the decoded form (requests, batches, replies to API calls, shadow updates).
+function routeEnvelope(deviceId, envelope) {
+    const { type, targetId, targetIds, targetGroup, controlData, payload } = envelope;
+    if (type !== undefined || controlData !== undefined || !payload) return false;
+
+    if (targetGroup !== undefined) {
+        if (typeof targetGroup !== 'string' || shadow.mayObserve(payload)) return false;
+        routeToGroup(deviceId, targetGroup, createRawFrame(deviceId, payload));
+        return true;
+    }
+
+    let ids;
+    if (Array.isArray(targetIds)) {
+        ids = targetIds;
+    } else if (typeof targetId === 'string' && targetId && !replies.isReplyAddress(targetId)) {
+        ids = [targetId];
+    } else {
+        return false;
+    }
+    if (shadow.mayObserve(payload)) return false;
+
+    routeToTargets(deviceId, ids, createRawFrame(deviceId, payload), createRawFrame(deviceId, payload, 'websocket-to-mqtt'));
+    return true;
+}
+
 function handleConnection(ws, req) {
     const params = new URLSearchParams(req.url.split('?')[1]);
     const deviceId = params.get('id');
 
     if (!deviceId) {
-        console.error("❌ Missing device ID, closing connection.");
+        log.warn("❌ Missing device ID, closing connection.");
         ws.close();
         return;
     }
 
-    console.log(`✅ Device ${deviceId} connected`);
+    log.info(() => `✅ Device ${deviceId} connected`);
 
-    // Mark connection as alive and store deviceId for heartbeat cleanup
-    ws.isAlive = true;
     ws.deviceId = deviceId;
+    // batch=1: the device unpacks array frames, so bursts may be sent combined (see fanout.js)
+    ws.batchFrames = params.get('batch') === '1';
+    heartbeat.track(ws, 'websocket', deviceId);
+    capture.open('websocket', ws, req.url);
 
     // Handle pong responses from client
     ws.on('pong', () => {
-        ws.isAlive = true;
-        // Uncomment for debug: console.log(`📡 Pong received from ${deviceId}`);
+        heartbeat.touch(ws);
+        log.trace(() => `📡 Pong received from ${deviceId}`);
     });
 
-    if (!devices.has(deviceId)) {
-        devices.set(deviceId, []);
-    }
-    devices.get(deviceId).push(ws);
+    registry.addSocket(deviceId, ws);
     
-    // Notify admin dashboards of new connection
-    broadcastDeviceUpdates({
-        event: 'deviceConnected',
-        deviceId: deviceId,
-        timestamp: new Date().toISOString()
-    });
+    // Notify admin dashboards of new connection (batched)
+    adminStream.markChanged(deviceId, 'connected');
 
     ws.on('message', (message) => {
-        // Reset alive status on any message received
-        ws.isAlive = true;
+        // Any inbound message counts as activity, so no ping is needed this round
+        heartbeat.touch(ws);
+        
+        const received = metrics.now();
+        capture.message('websocket', ws, message);
+        framesIn.inc();
+        bytesIn.inc(message.length);
+        
+        if (Buffer.isBuffer(message)) {
+            const envelope = scanEnvelope(message);
+            parseTime.observeSince(received);
+            if (envelope && routeEnvelope(deviceId, envelope)) {
+                routeLog.trace(() => `📩 Message received from ${deviceId}: ${message.toString()}`);
+                routeTime.observeSince(received);
+                return;
+            }
+        }
         
         let decodedMessages;
     
@@ -113,33 +193,39 @@ function handleConnection(ws, req) {
             }
             decodedMessages = JSON.parse(message);
         } catch (e) {
-            console.error('❌ Error parsing message:', e);
+            routeLog.warn(() => ['❌ Error parsing message from %s: %s', deviceId, e.message]);
             return;
         }
     
-        console.log("📩 Message received:", JSON.stringify(decodedMessages, null, 2));
+        routeLog.trace(() => `📩 Message received from ${deviceId}: ${JSON.stringify(decodedMessages)}`);
 
         if (decodedMessages.controlData && Array.isArray(decodedMessages.controlData)) {
-            console.log(`🔄 Processing batch control messages: ${decodedMessages.controlData.length} items`);
+            routeLog.debug(() => `🔄 Processing batch control messages: ${decodedMessages.controlData.length} items`);
 
             decodedMessages.controlData.forEach(({ targetId, payload }) => {
-                if (targetId && devices.has(targetId)) {
-                    devices.get(targetId)?.forEach((targetSocket) => {
-                        if (targetSocket.readyState === WebSocket.OPEN) {
-                            targetSocket.send(JSON.stringify({ from: "server", payload }));
-                            console.log(`🚀 Sent command to ${targetId}:`, JSON.stringify(payload));
-                        }
-                    });
+                shadow.observeCommand(targetId, payload);
+                if (targetId && registry.hasSockets(targetId)) {
+                    const frame = createFrame({ from: "server", payload });
+                    if (sendFrameToAll(registry.getSockets(targetId), frame) > 0) {
+                        routeLog.debug(() => `🚀 Sent command to ${targetId}: ${JSON.stringify(payload)}`);
+                    }
                 } else if (targetId && forwardWebSocketToMqtt) {
-                    // Try to forward to MQTT device if not found in WebSocket
-                    const forwarded = forwardWebSocketToMqtt(deviceId, targetId, payload);
+                    // Try MQTT on this node, then the node that owns the device, then hold it until it reconnects
+                    const forwarded = forwardWebSocketToMqtt(deviceId, targetId, payload) ||
+                        cluster.forward(targetId, { from: "server", payload }) ||
+                        offlineQueue.enqueue(targetId, { from: "server", payload });
                     if (!forwarded) {
-                        console.error(`⚠️ Target device ${targetId} not found in WebSocket or MQTT.`);
+                        routeLog.warn(() => `⚠️ Target device ${targetId} not found in WebSocket or MQTT.`);
                     }
+                } else if (targetId && cluster.forward(targetId, { from: "server", payload })) {
+                    routeLog.debug(() => `🧩 Sent command to ${targetId} via cluster`);
+                } else if (targetId && offlineQueue.enqueue(targetId, { from: "server", payload })) {
+                    routeLog.debug(() => `📦 Queued command for offline device ${targetId}`);
                 } else {
-                    console.error(`⚠️ Target device ${targetId} not found.`);
+                    routeLog.warn(() => `⚠️ Target device ${targetId} not found.`);
                 }
             });
+            routeTime.observeSince(received);
             return;
         }
 
@@ -148,112 +234,102 @@ function handleConnection(ws, req) {
         }
     
         decodedMessages.forEach((decodedMessage) => {
-            const { type, targetIds, targetId, payload } = decodedMessage;
+            const { type, targetIds, targetId, targetGroup, payload } = decodedMessage;
+            
+            // Keep device shadows current from the traffic being routed
+            if (payload && type === undefined) {
+                shadow.observeReport(deviceId, payload);
+                if (typeof targetGroup === 'string') {
+                    if (payload.commands === 'control_gpio') {
+                        groups.memberIds(targetGroup).forEach(id => shadow.observeCommand(id, payload));
+                    }
+                } else if (Array.isArray(targetIds)) {
+                    targetIds.forEach(id => shadow.observeCommand(id, payload));
+                } else if (targetId) {
+                    shadow.observeCommand(targetId, payload);
+                }
+            }
     
             if (type === 'getConnectedDevices') {
-                const connectedDevices = Array.from(devices.keys());
+                const connectedDevices = cluster.isEnabled() ?
+                    [...new Set([...registry.idsByProtocol('websocket'), ...cluster.remoteDeviceIds()])] :
+                    registry.idsByProtocol('websocket');
                 ws.send(JSON.stringify({ type: 'connectedDevices', devices: connectedDevices }));
-                console.log("📡 Sent connected devices list");
+                routeLog.debug("📡 Sent connected devices list");
+            } else if (type === 'getShadow') {
+                // Last known state from the relay's shadow, without asking the devices
+                const ids = Array.isArray(decodedMessage.deviceIds) ? decodedMessage.deviceIds :
+                    [decodedMessage.deviceId || targetId].filter(Boolean);
+                ws.send(JSON.stringify({ type: 'shadow', devices: shadow.getMany(ids) }));
+                routeLog.debug(() => `📡 Sent shadow for ${ids.length} devices`);
             } else if (type === 'broadcast') {
                 if (broadcastToAllProtocols) {
                     // Use the unified broadcast function that handles both WebSocket and MQTT
                     broadcastToAllProtocols(payload, deviceId);
                 } else {
                     // Fallback to WebSocket only broadcast
-                    devices.get(deviceId)?.forEach((conn) => {
-                        if (conn.readyState === WebSocket.OPEN) {
-                            conn.send(JSON.stringify({ from: deviceId, payload }));
-                            console.log(`📢 Broadcast message from ${deviceId}`);
-                        }
-                    });
-                }
-            } else if (Array.isArray(targetIds)) {
-                targetIds.forEach((id) => {
-                    if (devices.has(id)) {
-                        devices.get(id)?.forEach((targetSocket) => {
-                            if (targetSocket.readyState === WebSocket.OPEN) {
-                                targetSocket.send(JSON.stringify({ from: deviceId, payload }));
-                                console.log(`📨 Message forwarded from ${deviceId} to ${id}`);
-                            }
-                        });
-                    } else if (forwardWebSocketToMqtt) {
-                        // Try to forward to MQTT device if not found in WebSocket
-                        const forwarded = forwardWebSocketToMqtt(deviceId, id, payload);
-                        if (!forwarded) {
-                            console.error(`⚠️ Target device ${id} is not found in WebSocket or MQTT.`);
-                        }
-                    } else {
-                        console.error(`⚠️ Target device ${id} is not found.`);
-                    }
-                });
-            } else if (targetId && devices.has(targetId)) {
-                devices.get(targetId)?.forEach((targetSocket) => {
-                    if (targetSocket.readyState === WebSocket.OPEN) {
-                        targetSocket.send(JSON.stringify({ from: deviceId, payload }));
-                        console.log(`📨 Message forwarded from ${deviceId} to ${targetId}`);
+                    if (sendFrameToAll(registry.getSockets(deviceId), createFrame({ from: deviceId, payload })) > 0) {
+                        routeLog.debug(() => `📢 Broadcast message from ${deviceId}`);
                     }
-                });
-            } else if (targetId && forwardWebSocketToMqtt) {
-                // Try to forward to MQTT device if not found in WebSocket
-                const forwarded = forwardWebSocketToMqtt(deviceId, targetId, payload);
-                if (!forwarded) {
-                    console.error(`⚠️ Target device ${targetId} is not found in WebSocket or MQTT.`);
                 }
+            } else if (typeof targetGroup === 'string') {
+                routeToGroup(deviceId, targetGroup, createFrame({ from: deviceId, payload }));
+            } else if (Array.isArray(targetIds)) {
+                // One encoded frame per protocol, shared by every target
+                routeToTargets(deviceId, targetIds, createFrame({ from: deviceId, payload }),
+                    createFrame({ from: deviceId, payload, via: 'websocket-to-mqtt' }));
+            } else if (targetId && replies.handleReply(targetId, deviceId, payload)) {
+                routeLog.debug(() => `↩️ Reply from ${deviceId} handed to API request ${targetId}`);
+            } else if (targetId) {
+                routeToTargets(deviceId, [targetId], createFrame({ from: deviceId, payload }),
+                    createFrame({ from: deviceId, payload, via: 'websocket-to-mqtt' }));
             } else {
                 // const response = JSON.stringify({ message: "✅ Message received but no action taken" });
                 // ws.send(response);
             }
         });
+        routeTime.observeSince(received);
     });
 
     ws.on('close', () => {
-        console.log(`❌ Device ${deviceId} disconnected`);
+        log.info(() => `❌ Device ${deviceId} disconnected`);
+        heartbeat.untrack(ws);
+        capture.close('websocket', ws);
         cleanupConnection(ws, deviceId);
     });
 
     ws.on('error', (err) => {
-        console.error(`❌ WebSocket error for ${deviceId}:`, err.message);
+        log.error(() => `❌ WebSocket error for ${deviceId}: ${err.message}`);
+        heartbeat.untrack(ws);
         cleanupConnection(ws, deviceId);
     });
 }
 
 // Heartbeat function - call this with your WebSocket server instance
 // Usage: startHeartbeat(wss) after creating WebSocket.Server
+// Checks are staggered on the heartbeat wheel (utils/heartbeat.js); zombies are
+// terminated there and cleaned up by the close handlers above.
 function startHeartbeat(wss) {
-    const interval = setInterval(() => {
-        wss.clients.forEach((ws) => {
-            if (ws.isAlive === false) {
-                console.log(`💀 Terminating zombie connection: ${ws.deviceId || 'unknown'}`);
-                cleanupConnection(ws, ws.deviceId);
-                return ws.terminate();
-            }
+    heartbeat.start();
 
-            ws.isAlive = false;
-            ws.ping(); // Send ping, expect pong response
-        });
-    }, HEARTBEAT_INTERVAL);
-
-    // Clean up interval when server closes
+    // Stop the wheel when server closes
     wss.on('close', () => {
-        clearInterval(interval);
+        heartbeat.stop();
     });
-
-    console.log(`💓 Heartbeat started (interval: ${HEARTBEAT_INTERVAL}ms)`);
 }
 
 // Get connected device count
 function getConnectedDeviceCount() {
-    return devices.size;
+    return registry.stats().totalDevices;
 }
 
 // Get all connected device IDs
 function getConnectedDeviceIds() {
-    return Array.from(devices.keys());
+    return registry.deviceIds();
 }
 
 module.exports = { 
     handleConnection, 
-    devices, 
     setMqttForwarders,
     handleAdminConnection,
     broadcastDeviceUpdates,